@@ -0,0 +1,132 @@
+// Accepts per second, single acceptor versus one SO_REUSEPORT acceptor per
+// I/O loop (TcpServer::kReusePortPerLoop).
+//
+// Client threads connect and close as fast as they can for 1s, the server
+// counts the connections it established. Every mode runs several times in
+// a process of its own, the median is printed.
+//
+// usage: accept_bench [io_threads] [client_threads] [runs] [port]
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "network/EventLoop.h"
+#include "network/InetAddress.h"
+#include "network/TcpServer.h"
+#include "network/util.h"
+
+using namespace network;
+
+namespace {
+
+std::atomic<int64_t> g_established(0);
+std::atomic<bool> g_stop(false);
+
+void connectLoop(uint16_t port) {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  // a plain close, a reset would have the server log an error per
+  // connection; loopback reuses the TIME_WAIT ports
+  while (!g_stop.load(std::memory_order_relaxed)) {
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr);
+    ::close(fd);
+  }
+}
+
+// writes the accepts per second to @c resultFd
+void run(TcpServer::Option option, int ioThreads, int clientThreads,
+         uint16_t port, int resultFd) {
+  EventLoop loop;
+  TcpServer server(&loop, InetAddress(port), "accept_bench", option);
+  server.setThreadNum(ioThreads);
+  server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+      g_established.fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+  server.start();
+
+  std::vector<std::thread> clients;
+  for (int i = 0; i < clientThreads; ++i) {
+    clients.emplace_back(connectLoop, port);
+  }
+  const int64_t start = getMonotonicMs();
+  loop.runAfter(1.0, [&] {
+    g_stop = true;
+    const double seconds = (getMonotonicMs() - start) / 1000.0;
+    const double rate = g_established.load() / seconds;
+    if (::write(resultFd, &rate, sizeof rate) != sizeof rate) {
+      perror("write");
+    }
+    loop.quit();
+  });
+  loop.loop();
+  for (std::thread &t : clients) {
+    t.join();
+  }
+  // skip the teardown, the process exits
+  _exit(0);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  int ioThreads = argc > 1 ? atoi(argv[1]) : 4;
+  int clientThreads = argc > 2 ? atoi(argv[2]) : 4;
+  int runs = argc > 3 ? atoi(argv[3]) : 5;
+  uint16_t port = static_cast<uint16_t>(argc > 4 ? atoi(argv[4]) : 9982);
+
+  printf("%d I/O threads, %d client threads\n", ioThreads, clientThreads);
+  fflush(stdout);
+  struct {
+    const char *name;
+    TcpServer::Option option;
+  } modes[] = {
+      {"single acceptor", TcpServer::kReusePort},
+      {"acceptor per loop", TcpServer::kReusePortPerLoop},
+  };
+  for (auto &m : modes) {
+    std::vector<double> rates;
+    for (int i = 0; i < runs; ++i) {
+      int fds[2];
+      if (::pipe(fds) < 0) {
+        perror("pipe");
+        return 1;
+      }
+      pid_t pid = ::fork();
+      if (pid == 0) {
+        run(m.option, ioThreads, clientThreads, port, fds[1]);
+      }
+      ::waitpid(pid, NULL, 0);
+      double rate = 0;
+      if (::read(fds[0], &rate, sizeof rate) == sizeof rate) {
+        rates.push_back(rate);
+      }
+      ::close(fds[0]);
+      ::close(fds[1]);
+      ++port;
+    }
+    if (rates.empty()) {
+      continue;
+    }
+    std::sort(rates.begin(), rates.end());
+    printf("%-28s %8.0f accepts/s median  (%.0f .. %.0f over %zu runs)\n",
+           m.name, rates[rates.size() / 2], rates.front(), rates.back(),
+           rates.size());
+    fflush(stdout);
+  }
+}
@@ -0,0 +1,120 @@
+// Connection establishment rate under bursts, one accept per readiness event
+// (the old Acceptor) versus batch accept, and an accept rate limit.
+//
+// A client thread opens bursts of non-blocking connections, the server
+// counts the connections it established until every burst is in, then
+// prints the rate and the acceptor counters.
+//
+// usage: accept_burst_bench [bursts] [burst_size] [port]
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "network/Acceptor.h"
+#include "network/EventLoop.h"
+#include "network/InetAddress.h"
+#include "network/TcpServer.h"
+#include "network/util.h"
+
+using namespace network;
+
+namespace {
+
+std::atomic<int64_t> g_established(0);
+
+// the server closes on established, reset so no TIME_WAIT piles up
+void connectBursts(uint16_t port, int bursts, int burstSize) {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  struct linger lg = {1, 0};
+  std::vector<int> fds;
+  for (int b = 0; b < bursts; ++b) {
+    for (int i = 0; i < burstSize; ++i) {
+      int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      ::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr);
+      fds.push_back(fd);
+    }
+    // next burst once the server caught up
+    while (g_established.load(std::memory_order_relaxed) <
+           static_cast<int64_t>(b + 1) * burstSize) {
+      ::usleep(100);
+    }
+    for (int fd : fds) {
+      ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof lg);
+      ::close(fd);
+    }
+    fds.clear();
+  }
+}
+
+void run(const char *name, int maxAccepts, double rate, int bursts,
+         int burstSize, uint16_t port) {
+  EventLoop loop;
+  TcpServer server(&loop, InetAddress(port), "accept_burst_bench");
+  server.setListenBacklog(burstSize);
+  server.setMaxAcceptsPerEvent(maxAccepts);
+  if (rate > 0) {
+    server.setAcceptRateLimit(rate, rate / 10);
+  }
+  const int64_t total = static_cast<int64_t>(bursts) * burstSize;
+  int64_t start = 0;
+  server.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+    if (conn->connected() &&
+        g_established.fetch_add(1, std::memory_order_relaxed) + 1 == total) {
+      const double seconds = (getMonotonicUs() - start) / 1e6;
+      const AcceptStats s = server.acceptStats();
+      printf("%-24s %8.0f conns/s  accepted %ld deferred %ld dropped %ld\n",
+             name, total / seconds, s.accepted, s.deferred, s.dropped);
+      fflush(stdout);
+      loop.quit();
+    }
+  });
+  server.start();
+
+  start = getMonotonicUs();
+  std::thread client(connectBursts, port, bursts, burstSize);
+  loop.loop();
+  client.join();
+  // skip the teardown, the process exits
+  _exit(0);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  int bursts = argc > 1 ? atoi(argv[1]) : 50;
+  int burstSize = argc > 2 ? atoi(argv[2]) : 500;
+  uint16_t port = static_cast<uint16_t>(argc > 3 ? atoi(argv[3]) : 9985);
+
+  printf("%d bursts of %d connections\n", bursts, burstSize);
+  fflush(stdout);
+  struct {
+    const char *name;
+    int maxAccepts;
+    double rate;
+  } modes[] = {
+      {"one accept per event", 1, 0},
+      {"batch accept", Acceptor::kDefaultMaxAcceptsPerEvent, 0},
+      {"batch, 5000/s limit", Acceptor::kDefaultMaxAcceptsPerEvent, 5000},
+  };
+  for (auto &m : modes) {
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      run(m.name, m.maxAccepts, m.rate, bursts, burstSize, port);
+    }
+    ::waitpid(pid, NULL, 0);
+    ++port;
+  }
+}
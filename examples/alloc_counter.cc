@@ -0,0 +1,86 @@
+#include "alloc_counter.h"
+
+#include <dlfcn.h>
+#include <stddef.h>
+
+#include <atomic>
+
+extern "C" void *__libc_malloc(size_t size);
+
+namespace {
+
+std::atomic<int64_t> g_mallocs(0);
+std::atomic<int64_t> g_mallocBytes(0);
+std::atomic<int64_t> g_copied(0);
+thread_local bool t_countingCopies = true;
+
+typedef void *(*CopyFunc)(void *, const void *, size_t);
+
+// byte by byte while dlsym looks the real one up
+void *slowCopy(void *dest, const void *src, size_t n) {
+  volatile char *d = static_cast<volatile char *>(dest);
+  const volatile char *s = static_cast<const volatile char *>(src);
+  if (d < s) {
+    for (size_t i = 0; i < n; ++i) {
+      d[i] = s[i];
+    }
+  } else {
+    for (size_t i = n; i > 0; --i) {
+      d[i - 1] = s[i - 1];
+    }
+  }
+  return dest;
+}
+
+CopyFunc lookup(const char *name) {
+  static thread_local bool resolving = false;
+  if (resolving) {
+    return NULL;
+  }
+  resolving = true;
+  CopyFunc f = reinterpret_cast<CopyFunc>(dlsym(RTLD_NEXT, name));
+  resolving = false;
+  return f;
+}
+
+void countCopy(size_t n) {
+  if (t_countingCopies) {
+    g_copied.fetch_add(n, std::memory_order_relaxed);
+  }
+}
+
+}  // namespace
+
+extern "C" void *malloc(size_t size) {
+  g_mallocs.fetch_add(1, std::memory_order_relaxed);
+  g_mallocBytes.fetch_add(size, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+extern "C" void *memcpy(void *dest, const void *src, size_t n) {
+  static CopyFunc real = NULL;
+  if (!real && !(real = lookup("memcpy"))) {
+    return slowCopy(dest, src, n);
+  }
+  countCopy(n);
+  return real(dest, src, n);
+}
+
+extern "C" void *memmove(void *dest, const void *src, size_t n) {
+  static CopyFunc real = NULL;
+  if (!real && !(real = lookup("memmove"))) {
+    return slowCopy(dest, src, n);
+  }
+  countCopy(n);
+  return real(dest, src, n);
+}
+
+int64_t mallocCount() { return g_mallocs.load(std::memory_order_relaxed); }
+
+int64_t mallocBytes() {
+  return g_mallocBytes.load(std::memory_order_relaxed);
+}
+
+int64_t copiedBytes() { return g_copied.load(std::memory_order_relaxed); }
+
+void countCopies(bool on) { t_countingCopies = on; }
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+// Counters of the benches, linked in with the alloc_counter library: its
+// malloc() counts the mallocs of the whole process, operator new included,
+// its memcpy() and memmove() the bytes the process copies, std::copy of
+// chars included. Totals since the start, take the difference over what is
+// measured.
+
+// mallocs so far
+int64_t mallocCount();
+
+// bytes malloc'd so far
+int64_t mallocBytes();
+
+// bytes memcpy'd and memmove'd so far
+int64_t copiedBytes();
+
+// stops counting the copies of the calling thread until called again with
+// true, to leave out the ones of a side not measured
+void countCopies(bool on);
@@ -0,0 +1,192 @@
+// Mallocs per RPC of a call with nested messages, a Report of 32 samples
+// answered with the samples above average, with the messages on the heap
+// and on a CallArena per call, in both wire formats. Client and server
+// together, in one loop, one call at a time.
+//
+// usage: arena_bench [calls] [port]
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "network/EventLoop.h"
+#include "network/InetAddress.h"
+#include "network/TcpClient.h"
+#include "network/util.h"
+#include "rpc_framework/CallArena.h"
+#include "rpc_framework/RpcChannel.h"
+#include "rpc_framework/RpcServer.h"
+
+#include "rpcbench.pb.h"
+
+#include "alloc_counter.h"
+
+using namespace network;
+
+namespace {
+
+const int kWarmup = 200;
+const int kSamples = 32;
+const int kValues = 8;
+
+class ReportServiceImpl : public rpcbench::ReportService {
+ public:
+  void Aggregate(::google::protobuf::RpcController *,
+                 const rpcbench::Report *request,
+                 rpcbench::ReportSummary *response,
+                 ::google::protobuf::Closure *done) override {
+    google::protobuf::Arena *arena = request->GetArena();
+    // scratch, on the call's arena if there is one
+    rpcbench::Sample *peak =
+        google::protobuf::Arena::CreateMessage<rpcbench::Sample>(arena);
+    double peakMean = 0;
+    for (const rpcbench::Sample &sample : request->samples()) {
+      double sum = 0;
+      for (double value : sample.values()) {
+        sum += value;
+      }
+      const double mean = sample.values_size() ? sum / sample.values_size() : 0;
+      if (mean > 50) {
+        *response->add_outliers() = sample;
+      }
+      if (mean > peakMean) {
+        peakMean = mean;
+        *peak = sample;
+      }
+    }
+    response->set_samples(request->samples_size());
+    if (!arena) {
+      delete peak;
+    }
+    done->Run();
+  }
+};
+
+struct Client {
+  rpcbench::ReportService::Stub *stub;
+  rpcbench::Report request;
+  int remaining;
+  int calls;
+  int64_t startUs;
+  int64_t mallocs;
+  bool arena;
+  const char *name;
+  EventLoop *loop;
+};
+
+void call(Client *client);
+
+// heap responses are deleted by the channel, arena ones with the arena bound
+// to the callback
+void onDone(Client *client, CallArenaPtr) {
+  if (--client->remaining == client->calls) {
+    // warmed up
+    client->startUs = getMonotonicUs();
+    client->mallocs = mallocCount();
+  }
+  if (client->remaining > 0) {
+    call(client);
+    return;
+  }
+  printf("%-12s %7.2f mallocs %8.2f us per RPC\n", client->name,
+         static_cast<double>(mallocCount() - client->mallocs) /
+             client->calls,
+         static_cast<double>(getMonotonicUs() - client->startUs) /
+             client->calls);
+  fflush(stdout);
+  client->loop->quit();
+}
+
+void call(Client *client) {
+  CallArenaPtr arena;
+  rpcbench::ReportSummary *response = NULL;
+  if (client->arena) {
+    arena = std::make_shared<CallArena>();
+    response = google::protobuf::Arena::CreateMessage<rpcbench::ReportSummary>(
+        arena->arena());
+  } else {
+    response = new rpcbench::ReportSummary;
+  }
+  client->stub->Aggregate(NULL, &client->request, response,
+                          ::google::protobuf::NewCallback(&onDone, client,
+                                                          arena));
+}
+
+void fillReport(rpcbench::Report *report) {
+  report->set_source("collector");
+  for (int i = 0; i < kSamples; ++i) {
+    rpcbench::Sample *sample = report->add_samples();
+    sample->set_host("node" + std::to_string(i));
+    sample->set_ts(1760000000000 + i);
+    for (int v = 0; v < kValues; ++v) {
+      sample->add_values((i * 7 + v * 13) % 100);
+    }
+    sample->add_tags("cpu");
+    sample->add_tags(i % 2 ? "rack1" : "rack2");
+  }
+}
+
+void run(const char *name, ProtoRpcCodec::WireFormat format, bool arena,
+         int calls, uint16_t port) {
+  EventLoop loop;
+  ReportServiceImpl impl;
+  RpcServer server(&loop, InetAddress(port));
+  server.registerService(&impl);
+  server.setArenaPerCall(arena);
+  server.start();
+
+  TcpClient tcpClient(&loop, InetAddress("127.0.0.1", port), "bench");
+  RpcChannelPtr channel(new RpcChannel);
+  channel->codec()->setWireFormat(format);
+  channel->setArenaPerCall(arena);
+  rpcbench::ReportService::Stub stub(get_pointer(channel));
+  Client client;
+  client.stub = &stub;
+  fillReport(&client.request);
+  client.remaining = calls + kWarmup;
+  client.calls = calls;
+  client.arena = arena;
+  client.name = name;
+  client.loop = &loop;
+  tcpClient.setMessageCallback(
+      std::bind(&RpcChannel::onMessage, get_pointer(channel), _1, _2));
+  tcpClient.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+      channel->setConnection(conn);
+      call(&client);
+    }
+  });
+  tcpClient.connect();
+  loop.loop();
+  // skip the teardown, the process exits
+  _exit(0);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const int calls = argc > 1 ? atoi(argv[1]) : 20000;
+  uint16_t port = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 9994);
+
+  printf("%d samples of %d values per report\n", kSamples, kValues);
+  struct {
+    const char *name;
+    ProtoRpcCodec::WireFormat format;
+    bool arena;
+  } modes[] = {
+      {"v1 heap", ProtoRpcCodec::kProtobufEnvelope, false},
+      {"v1 arena", ProtoRpcCodec::kProtobufEnvelope, true},
+      {"v2 heap", ProtoRpcCodec::kFlatHeader, false},
+      {"v2 arena", ProtoRpcCodec::kFlatHeader, true},
+  };
+  fflush(stdout);
+  for (auto &m : modes) {
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      run(m.name, m.format, m.arena, calls, port);
+    }
+    ::waitpid(pid, NULL, 0);
+    ++port;
+  }
+}
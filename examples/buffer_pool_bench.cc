@@ -0,0 +1,203 @@
+// Memory of Buffer storage, two runs against an echo server with one loop.
+//
+// idle: many connections each send one 64KB message and go idle. Prints the
+// server RSS once all echoes are back, and again after the loop trimmed its
+// BufferPool.
+// echo: one connection ping-pongs small messages, prints the server mallocs
+// per message in steady state.
+//
+// Clients run in a child process, so every malloc of this process is the
+// server's.
+//
+// usage: buffer_pool_bench [connections] [port]
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "network/BufferPool.h"
+#include "network/EventLoop.h"
+#include "network/InetAddress.h"
+#include "network/TcpServer.h"
+#include "network/util.h"
+
+#include "alloc_counter.h"
+
+using namespace network;
+
+namespace {
+
+const size_t kIdleMessage = 64 * 1024;
+const size_t kEchoMessage = 256;
+const double kEchoDuration = 2.0;
+
+std::atomic<int64_t> g_echoed(0);
+
+double rssMB() {
+  long pages = 0, resident = 0;
+  FILE *fp = fopen("/proc/self/statm", "r");
+  if (fp) {
+    if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    fclose(fp);
+  }
+  return resident * sysconf(_SC_PAGESIZE) / (1024.0 * 1024);
+}
+
+int connectTo(uint16_t port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                sizeof addr) < 0) {
+    perror("connect");
+    _exit(1);
+  }
+  return fd;
+}
+
+void roundTrip(int fd, const char *data, size_t len, char *buf) {
+  if (::write(fd, data, len) != static_cast<ssize_t>(len)) {
+    _exit(1);
+  }
+  for (size_t got = 0; got < len;) {
+    ssize_t n = ::read(fd, buf, len - got);
+    if (n <= 0) {
+      _exit(1);
+    }
+    got += n;
+  }
+}
+
+// child: one message per connection, then hold them open until killed
+void idleClients(uint16_t port, int connections) {
+  std::vector<char> message(kIdleMessage, 'x'), buf(kIdleMessage);
+  std::vector<int> fds;
+  for (int i = 0; i < connections; ++i) {
+    fds.push_back(connectTo(port));
+    roundTrip(fds.back(), message.data(), message.size(), buf.data());
+  }
+  pause();
+  _exit(0);
+}
+
+void echoClient(uint16_t port) {
+  std::vector<char> message(kEchoMessage, 'x'), buf(kEchoMessage);
+  int fd = connectTo(port);
+  while (true) {
+    roundTrip(fd, message.data(), message.size(), buf.data());
+  }
+}
+
+// answers with a new Buffer the way a codec would, the input storage stays
+// with the connection
+void onMessage(const TcpConnectionPtr &conn, Buffer *buf) {
+  Buffer reply;
+  reply.append(buf->peek(), buf->readableBytes());
+  g_echoed.fetch_add(buf->readableBytes(), std::memory_order_relaxed);
+  buf->retrieveAll();
+  conn->send(&reply);
+}
+
+void printPool(const char *when, EventLoop *loop) {
+  BufferPool::Stats s = loop->bufferPool()->stats();
+  printf("  %-22s RSS %8.1f MB, pool cached %6.1f MB (%ld blocks), "
+         "trimmed %8.1f MB\n",
+         when, rssMB(), s.cachedBytes / (1024.0 * 1024),
+         static_cast<long>(s.cachedBlocks),
+         s.trimmedBytes / (1024.0 * 1024));
+  fflush(stdout);
+}
+
+void runIdle(uint16_t port, int connections) {
+  EventLoop loop;
+  TcpServer server(&loop, InetAddress(port), "buffer_pool_bench");
+  server.setMessageCallback(onMessage);
+  server.start();
+  printf("idle: %d connections, one %zu bytes message each\n", connections,
+         kIdleMessage);
+  printPool("before", &loop);
+
+  pid_t child = ::fork();
+  if (child == 0) {
+    idleClients(port, connections);
+  }
+  const int64_t total = static_cast<int64_t>(connections) * kIdleMessage;
+  int64_t doneNs = 0;
+  loop.runEvery(0.1, [&] {
+    if (doneNs == 0 && g_echoed.load() == total) {
+      doneNs = getMonotonicNs();
+      printPool("all echoed", &loop);
+    } else if (doneNs != 0 &&
+               getMonotonicNs() - doneNs >
+                   (BufferPool::kTrimIntervalSec * 2 + 1) * 1000000000LL) {
+      // a block is trimmed when it stayed idle a whole interval
+      printPool("idle, after trim", &loop);
+      loop.quit();
+    }
+  });
+  loop.loop();
+  ::kill(child, SIGKILL);
+  ::waitpid(child, NULL, 0);
+  _exit(0);
+}
+
+void runEcho(uint16_t port) {
+  EventLoop loop;
+  TcpServer server(&loop, InetAddress(port), "buffer_pool_bench");
+  server.setMessageCallback(onMessage);
+  server.start();
+
+  pid_t child = ::fork();
+  if (child == 0) {
+    echoClient(port);
+  }
+  int64_t startMallocs = 0, startEchoed = 0;
+  loop.runAfter(0.5, [&] {
+    startMallocs = mallocCount();
+    startEchoed = g_echoed.load();
+  });
+  loop.runAfter(0.5 + kEchoDuration, [&] {
+    const int64_t n = (g_echoed.load() - startEchoed) / kEchoMessage;
+    printf("echo: %zu bytes messages, %ld messages, %.3f mallocs/message\n",
+           kEchoMessage, static_cast<long>(n),
+           n > 0 ? static_cast<double>(mallocCount() - startMallocs) / n
+                 : 0.0);
+    fflush(stdout);
+    loop.quit();
+  });
+  loop.loop();
+  ::kill(child, SIGKILL);
+  ::waitpid(child, NULL, 0);
+  _exit(0);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  int connections = argc > 1 ? atoi(argv[1]) : 5000;
+  uint16_t port = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 9988);
+
+  pid_t pid = ::fork();
+  if (pid == 0) {
+    runIdle(port, connections);
+  }
+  ::waitpid(pid, NULL, 0);
+  pid = ::fork();
+  if (pid == 0) {
+    runEcho(static_cast<uint16_t>(port + 1));
+  }
+  ::waitpid(pid, NULL, 0);
+}
@@ -0,0 +1,102 @@
+// Channel update cost versus the number of registered channels.
+//
+// Registers N eventfds with one EventLoop, then measures
+//   - hasChannel(), the poller's channel table lookup alone
+//   - enableWriting()/disableWriting() flips, lookup plus epoll_ctl(MOD)
+// on randomly chosen channels.
+//
+// usage: channel_bench [max_channels]
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "network/Channel.h"
+#include "network/EventLoop.h"
+#include "network/util.h"
+
+using namespace network;
+
+namespace {
+
+const int kLookups = 2000000;
+const int kFlips = 200000;
+
+size_t raiseFdLimit() {
+  struct rlimit rl;
+  ::getrlimit(RLIMIT_NOFILE, &rl);
+  rl.rlim_cur = rl.rlim_max;
+  ::setrlimit(RLIMIT_NOFILE, &rl);
+  ::getrlimit(RLIMIT_NOFILE, &rl);
+  return static_cast<size_t>(rl.rlim_cur);
+}
+
+void bench(EventLoop *loop, size_t numChannels) {
+  std::vector<int> fds;
+  std::vector<std::unique_ptr<Channel>> channels;
+  for (size_t i = 0; i < numChannels; ++i) {
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+      break;
+    }
+    fds.push_back(fd);
+    channels.emplace_back(new Channel(loop, fd));
+    channels.back()->enableReading();
+  }
+
+  std::mt19937 rng(42);
+  std::vector<Channel *> picks(4096);
+  for (Channel *&c : picks) {
+    c = channels[rng() % channels.size()].get();
+  }
+
+  int64_t start = getMonotonicUs();
+  size_t found = 0;
+  for (int i = 0; i < kLookups; ++i) {
+    found += loop->hasChannel(picks[i & 4095]);
+  }
+  const double lookupNs = (getMonotonicUs() - start) * 1000.0 / kLookups;
+
+  start = getMonotonicUs();
+  for (int i = 0; i < kFlips; ++i) {
+    Channel *c = picks[i & 4095];
+    if (c->isWriting()) {
+      c->disableWriting();
+    } else {
+      c->enableWriting();
+    }
+  }
+  const double flipNs = (getMonotonicUs() - start) * 1000.0 / kFlips;
+
+  printf("%8zu channels  hasChannel %6.1f ns  update %7.1f ns%s\n",
+         channels.size(), lookupNs, flipNs,
+         found == static_cast<size_t>(kLookups) ? "" : "  (lookup mismatch)");
+
+  for (auto &c : channels) {
+    c->disableAll();
+    c->remove();
+  }
+  channels.clear();
+  for (int fd : fds) {
+    ::close(fd);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  size_t maxChannels = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000;
+  maxChannels = std::min(maxChannels, raiseFdLimit() - 64);
+
+  EventLoop loop(EventLoop::kEpollPoller);
+  for (size_t n = 1000; n < maxChannels; n *= 10) {
+    bench(&loop, n);
+  }
+  bench(&loop, maxChannels);
+}
@@ -0,0 +1,118 @@
+// Compression of MonitorInfo responses, a telemetry text with a line per
+// CPU sample, as ProtoRpcCodec does it for a compressed method: the ratio
+// of the frame payload to the message, and the CPU time to compress and to
+// decompress one message.
+//
+// zlib at level 1 and 6, and at level 6 with a preset dictionary built from
+// other samples of the same kind.
+//
+// usage: compression_bench [MB per size]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include "rpc_framework/Compressor.h"
+
+#include "monitor.pb.h"
+
+using namespace network;
+
+namespace {
+
+double now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// samples of a few hosts, numbers from @c seed
+std::string telemetry(size_t size, unsigned seed) {
+  std::string text;
+  char line[160];
+  int64_t ts = 1760000000000;
+  while (text.size() < size) {
+    seed = seed * 1103515245 + 12345;
+    const unsigned r = seed >> 8;
+    const double user = r % 10000 / 100.0;
+    const double sys = (r / 7) % 2000 / 100.0;
+    snprintf(line, sizeof line,
+             "host=rack%u-node%02u cpu=%u user=%.2f sys=%.2f idle=%.2f "
+             "iowait=%.2f ts=%ld\n",
+             r % 4, r % 32, r % 64, user, sys,
+             std::max(0.0, 100 - user - sys), (r / 13) % 300 / 100.0, ts);
+    ts += r % 50;
+    text += line;
+  }
+  text.resize(size);
+  return text;
+}
+
+void run(const char *name, const Compressor *compressor, size_t size,
+         double mbPerSize) {
+  monitor::TestResponse response;
+  response.set_status(true);
+  response.set_cpu_info(telemetry(size, 1));
+  const std::string raw = response.SerializeAsString();
+  const int rounds =
+      std::max(1, static_cast<int>(mbPerSize * 1024 * 1024 / raw.size()));
+
+  std::string compressed;
+  double compressSeconds = 0;
+  if (compressor) {
+    const double start = now();
+    for (int i = 0; i < rounds; ++i) {
+      compressed.clear();
+      if (!compressor->compress(raw.data(), raw.size(), &compressed)) {
+        fprintf(stderr, "compress failed\n");
+        exit(1);
+      }
+    }
+    compressSeconds = (now() - start) / rounds;
+  } else {
+    compressed = raw;
+  }
+
+  std::string decompressed(raw.size(), '\0');
+  monitor::TestResponse parsed;
+  const double start = now();
+  for (int i = 0; i < rounds; ++i) {
+    if (compressor &&
+        !compressor->decompress(compressed.data(), compressed.size(),
+                                &decompressed[0], decompressed.size())) {
+      fprintf(stderr, "decompress failed\n");
+      exit(1);
+    }
+    const std::string &message = compressor ? decompressed : compressed;
+    parsed.ParseFromArray(message.data(), static_cast<int>(message.size()));
+  }
+  const double decompressSeconds = (now() - start) / rounds;
+  // the codec adds the 4-byte length
+  const size_t payload = compressor ? compressed.size() + 4 : raw.size();
+  printf("%8zu bytes %-14s %8zu payload %6.2f ratio %10.1f us compress "
+         "%10.1f us decompress+parse\n",
+         raw.size(), name, payload, static_cast<double>(raw.size()) / payload,
+         compressSeconds * 1e6, decompressSeconds * 1e6);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const double mbPerSize = argc > 1 ? atof(argv[1]) : 64;
+  // samples of other hosts and times than the ones sent
+  const std::string dictionary = telemetry(4 * 1024, 42);
+  ZlibCompressor fast(1);
+  ZlibCompressor standard(6);
+  ZlibCompressor withDictionary(6, dictionary);
+  const size_t sizes[] = {128, 512, 4096, 64 * 1024, 1024 * 1024};
+  for (size_t size : sizes) {
+    run("none", NULL, size, mbPerSize);
+    run("zlib 1", &fast, size, mbPerSize);
+    run("zlib 6", &standard, size, mbPerSize);
+    run("zlib 6 + dict", &withDictionary, size, mbPerSize);
+    fflush(stdout);
+  }
+  google::protobuf::ShutdownProtobufLibrary();
+}
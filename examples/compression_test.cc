@@ -0,0 +1,138 @@
+// Checks ProtoRpcCodec::uncompress() against forged lengths: a compressed
+// payload announcing more than the compressor can expand it to, or more
+// than setMaxUncompressedBytes(), is rejected before the message is
+// allocated, genuine ones up to the cap go through.
+//
+// Exits with 1 on the first check failing.
+//
+// usage: compression_test
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include <google/protobuf/descriptor.h>
+
+#include "network/Endian.h"
+#include "rpc_framework/Compressor.h"
+#include "rpc_framework/RpcCodec.h"
+
+#include "rpcbench.pb.h"
+
+using namespace network;
+
+namespace {
+
+void check(bool ok, const char *what) {
+  if (!ok) {
+    std::printf("FAILED: %s\n", what);
+    std::exit(1);
+  }
+  std::printf("ok: %s\n", what);
+}
+
+// the payload of a compressed v2 frame: the length announced, then the data
+std::string payloadOf(int32_t len, const std::string &data) {
+  const int32_t be32 = sockets::hostToNetwork32(len);
+  std::string payload(reinterpret_cast<const char *>(&be32), sizeof be32);
+  payload += data;
+  return payload;
+}
+
+std::string compress(const Compressor &compressor, const std::string &raw) {
+  std::string out;
+  if (!compressor.compress(raw.data(), raw.size(), &out)) {
+    check(false, "compress");
+  }
+  return out;
+}
+
+class Uncompressor {
+ public:
+  Uncompressor()
+      : codec_(ProtoRpcCodec::ProtobufMessageCallback()),
+        method_(rpcbench::BenchService::descriptor()->FindMethodByName(
+            "Fast")) {
+    MethodCompression compression;
+    compression.compressor = std::make_shared<ZlibCompressor>();
+    compression.threshold = 0;
+    compressions_[method_] = compression;
+    codec_.setCompressions(&compressions_);
+  }
+
+  ProtoRpcCodec *codec() { return &codec_; }
+
+  bool uncompress(const std::string &payload, std::string *message) {
+    RpcFrame frame;
+    frame.type = RESPONSE;
+    frame.flags = RpcFrame::kCompressed;
+    frame.error = NO_ERROR;
+    frame.id = 1;
+    frame.service = NULL;
+    frame.serviceLen = 0;
+    frame.method = NULL;
+    frame.methodLen = 0;
+    frame.methodId = 0;
+    frame.payload = payload.data();
+    frame.payloadLen = static_cast<int>(payload.size());
+    frame.payloadSlices = NULL;
+    return codec_.uncompress(frame, method_, message);
+  }
+
+ private:
+  ProtoRpcCodec codec_;
+  const google::protobuf::MethodDescriptor *method_;
+  CompressionMap compressions_;
+};
+
+}  // namespace
+
+int main() {
+  ::setvbuf(stdout, NULL, _IOLBF, 0);
+  ZlibCompressor zlib;
+  Uncompressor u;
+  std::string message;
+
+  const std::string text(100 * 1024, 'x');
+  const std::string compressed = compress(zlib, text);
+  check(u.uncompress(payloadOf(static_cast<int32_t>(text.size()), compressed),
+                     &message) &&
+            message == text,
+        "a genuine payload uncompresses");
+
+  // the most compressible payload there is stays within the ratio
+  const std::string zeros(ProtoRpcCodec::kDefaultMaxUncompressedBytes, '\0');
+  message.clear();
+  check(u.uncompress(payloadOf(static_cast<int32_t>(zeros.size()),
+                               compress(zlib, zeros)),
+                     &message) &&
+            message == zeros,
+        "all zeros up to the cap uncompress");
+
+  // 64MB out of a few bytes, what the frame length limit still let through
+  std::string forged;
+  check(!u.uncompress(payloadOf(ProtoRpcCodec::kMaxMessageLen,
+                                compress(zlib, "x")),
+                      &forged),
+        "64MB announced by a few bytes is rejected");
+  check(forged.capacity() < 4096, "nothing was allocated for it");
+
+  // within the cap, beyond what deflate expands the data to
+  check(!u.uncompress(payloadOf(static_cast<int32_t>(compressed.size() *
+                                                     zlib.maxRatio() + 1),
+                                compressed),
+                      &forged),
+        "more than maxRatio() per compressed byte is rejected");
+  check(forged.capacity() < 4096, "nothing was allocated for it");
+
+  check(!u.uncompress(payloadOf(-1, compressed), &forged),
+        "a negative length is rejected");
+
+  // a genuine payload above the cap set
+  u.codec()->setMaxUncompressedBytes(64 * 1024);
+  check(!u.uncompress(payloadOf(static_cast<int32_t>(text.size()), compressed),
+                      &forged),
+        "a genuine payload above setMaxUncompressedBytes() is rejected");
+  check(forged.capacity() < 4096, "nothing was allocated for it");
+  return 0;
+}
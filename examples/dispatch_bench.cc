@@ -0,0 +1,185 @@
+// Cost of resolving a request to its method with 50 services of 20 methods
+// registered: the name map and FindMethodByName of before, and the
+// DispatchTable RpcServer builds. Requests come with the service and method
+// names as bytes of the frame, in random order.
+//
+// usage: dispatch_bench [lookups]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/dynamic_message.h>
+#include <google/protobuf/service.h>
+
+#include "rpc_framework/DispatchTable.h"
+
+#include "alloc_counter.h"
+
+using namespace network;
+
+namespace {
+
+const int kServices = 50;
+const int kMethods = 20;
+
+// what a generated service does, with a descriptor built at run time
+class BenchService : public google::protobuf::Service {
+ public:
+  BenchService(const google::protobuf::ServiceDescriptor *desc,
+               google::protobuf::DynamicMessageFactory *factory)
+      : desc_(desc) {
+    for (int i = 0; i < desc->method_count(); ++i) {
+      requests_.push_back(factory->GetPrototype(desc->method(i)->input_type()));
+      responses_.push_back(
+          factory->GetPrototype(desc->method(i)->output_type()));
+    }
+  }
+
+  const google::protobuf::ServiceDescriptor *GetDescriptor() override {
+    return desc_;
+  }
+  void CallMethod(const google::protobuf::MethodDescriptor *,
+                  google::protobuf::RpcController *,
+                  const google::protobuf::Message *,
+                  google::protobuf::Message *,
+                  google::protobuf::Closure *) override {}
+  const google::protobuf::Message &GetRequestPrototype(
+      const google::protobuf::MethodDescriptor *method) const override {
+    return *requests_[method->index()];
+  }
+  const google::protobuf::Message &GetResponsePrototype(
+      const google::protobuf::MethodDescriptor *method) const override {
+    return *responses_[method->index()];
+  }
+
+ private:
+  const google::protobuf::ServiceDescriptor *desc_;
+  std::vector<const google::protobuf::Message *> requests_;
+  std::vector<const google::protobuf::Message *> responses_;
+};
+
+const google::protobuf::FileDescriptor *buildFile(
+    google::protobuf::DescriptorPool *pool) {
+  google::protobuf::FileDescriptorProto file;
+  file.set_name("dispatch_bench.proto");
+  file.set_package("dispatchbench");
+  file.set_syntax("proto3");
+  google::protobuf::DescriptorProto *payload = file.add_message_type();
+  payload->set_name("Payload");
+  google::protobuf::FieldDescriptorProto *field = payload->add_field();
+  field->set_name("data");
+  field->set_number(1);
+  field->set_type(google::protobuf::FieldDescriptorProto::TYPE_BYTES);
+  field->set_label(google::protobuf::FieldDescriptorProto::LABEL_OPTIONAL);
+  for (int s = 0; s < kServices; ++s) {
+    google::protobuf::ServiceDescriptorProto *service = file.add_service();
+    service->set_name("TelemetryService" + std::to_string(s));
+    for (int m = 0; m < kMethods; ++m) {
+      google::protobuf::MethodDescriptorProto *method = service->add_method();
+      method->set_name("ReportMetrics" + std::to_string(m));
+      method->set_input_type(".dispatchbench.Payload");
+      method->set_output_type(".dispatchbench.Payload");
+    }
+  }
+  return pool->BuildFile(file);
+}
+
+struct Request {
+  const char *service;
+  size_t serviceLen;
+  const char *method;
+  size_t methodLen;
+  const google::protobuf::MethodDescriptor *expected;
+};
+
+double now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void report(const char *name, double seconds, int64_t mallocs, int lookups) {
+  printf("%-28s %8.1f ns %6.2f mallocs per request\n", name,
+         seconds * 1e9 / lookups, static_cast<double>(mallocs) / lookups);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const int lookups = argc > 1 ? atoi(argv[1]) : 2000000;
+
+  google::protobuf::DescriptorPool pool;
+  const google::protobuf::FileDescriptor *file = buildFile(&pool);
+  if (!file) {
+    fprintf(stderr, "bad descriptor\n");
+    return 1;
+  }
+  google::protobuf::DynamicMessageFactory factory(&pool);
+  std::vector<std::unique_ptr<BenchService>> impls;
+  std::map<std::string, google::protobuf::Service *> services;
+  for (int s = 0; s < file->service_count(); ++s) {
+    impls.emplace_back(new BenchService(file->service(s), &factory));
+    services[file->service(s)->full_name()] = impls.back().get();
+  }
+  DispatchTable table;
+  table.build(services, DispatchTable::ExecutorMap());
+
+  // names as they come in frames, random methods
+  std::vector<Request> requests(4096);
+  unsigned seed = 1;
+  for (Request &r : requests) {
+    seed = seed * 1103515245 + 12345;
+    const google::protobuf::ServiceDescriptor *service =
+        file->service((seed >> 8) % kServices);
+    r.expected = service->method((seed >> 16) % kMethods);
+    r.service = service->full_name().data();
+    r.serviceLen = service->full_name().size();
+    r.method = r.expected->name().data();
+    r.methodLen = r.expected->name().size();
+  }
+  printf("%d services of %d methods, %zu request names\n", kServices,
+         kMethods, requests.size());
+
+  // before: the names copied to strings, the service map, the method by
+  // name, both prototypes
+  std::string serviceName, methodName;
+  int64_t mallocs = mallocCount();
+  double start = now();
+  int misses = 0;
+  for (int i = 0; i < lookups; ++i) {
+    const Request &r = requests[i & (requests.size() - 1)];
+    serviceName.assign(r.service, r.serviceLen);
+    methodName.assign(r.method, r.methodLen);
+    auto it = services.find(serviceName);
+    const google::protobuf::MethodDescriptor *method =
+        it->second->GetDescriptor()->FindMethodByName(methodName);
+    const google::protobuf::Message *request =
+        &it->second->GetRequestPrototype(method);
+    const google::protobuf::Message *response =
+        &it->second->GetResponsePrototype(method);
+    misses += method != r.expected || !request || !response;
+  }
+  report("map + FindMethodByName", now() - start, mallocCount() - mallocs,
+         lookups);
+
+  mallocs = mallocCount();
+  start = now();
+  for (int i = 0; i < lookups; ++i) {
+    const Request &r = requests[i & (requests.size() - 1)];
+    const MethodEntry *entry =
+        table.find(r.service, r.serviceLen, r.method, r.methodLen);
+    misses += !entry || entry->method != r.expected ||
+              !entry->requestPrototype || !entry->responsePrototype;
+  }
+  report("DispatchTable", now() - start, mallocCount() - mallocs, lookups);
+  if (misses) {
+    fprintf(stderr, "%d wrong lookups\n", misses);
+    return 1;
+  }
+}
@@ -0,0 +1,196 @@
+// Loopback echo with level-triggered and edge-triggered connections
+// (TcpServer::setEdgeTriggered).
+//
+// The client streams 256 MB in 64 KB chunks with up to 4 MB in flight, so
+// that the server reads more than TcpConnection::kReadBudgetPerEvent per
+// edge and goes through continueRead(). Then it does 100k ping-pongs of
+// 64 bytes. Printed are the throughput, the round trip time, and the
+// iterations, events and queued functors (continueRead() among them) of the
+// server loop for each phase.
+//
+// usage: edge_trigger_bench [port]
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <string>
+
+#include "network/EventLoop.h"
+#include "network/EventLoopThread.h"
+#include "network/InetAddress.h"
+#include "network/TcpClient.h"
+#include "network/TcpServer.h"
+
+using namespace network;
+
+namespace {
+
+const int64_t kStreamBytes = 256 << 20;
+const size_t kChunk = 64 * 1024;
+const int64_t kWindow = 4 << 20;
+const int kPingPongs = 100000;
+const size_t kPingSize = 64;
+
+int64_t nowUs() {
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+class Client {
+ public:
+  Client(EventLoop *loop, const InetAddress &addr, bool edgeTriggered,
+         EventLoop *serverLoop)
+      : loop_(loop),
+        serverLoop_(serverLoop),
+        client_(loop, addr, "edge_trigger_bench"),
+        chunk_(kChunk, 'x'),
+        ping_(kPingSize, 'p'),
+        sent_(0),
+        received_(0),
+        pongs_(0),
+        start_(0) {
+    client_.setEdgeTriggered(edgeTriggered);
+    client_.setConnectionCallback(
+        std::bind(&Client::onConnection, this, _1));
+    client_.setMessageCallback(std::bind(&Client::onMessage, this, _1, _2));
+  }
+
+  void connect() { client_.connect(); }
+
+ private:
+  void onConnection(const TcpConnectionPtr &conn) {
+    if (!conn->connected()) {
+      loop_->quit();
+      return;
+    }
+    conn->setTcpNoDelay(true);
+    startPhase();
+    fill(conn);
+  }
+
+  void onMessage(const TcpConnectionPtr &conn, Buffer *buf) {
+    if (received_ < kStreamBytes) {
+      received_ += buf->readableBytes();
+      buf->retrieveAll();
+      if (received_ < kStreamBytes) {
+        fill(conn);
+        return;
+      }
+      const double seconds = (nowUs() - start_) / 1e6;
+      printf("  stream    %8.1f MB/s  ", kStreamBytes / seconds / (1 << 20));
+      endPhase();
+      startPhase();
+      send(conn, ping_);
+      return;
+    }
+    while (buf->readableBytes() >= kPingSize) {
+      buf->retrieve(kPingSize);
+      if (++pongs_ == kPingPongs) {
+        const double us = double(nowUs() - start_) / kPingPongs;
+        printf("  pingpong  %8.1f us/rtt  ", us);
+        endPhase();
+        loop_->quit();
+        return;
+      }
+      send(conn, ping_);
+    }
+  }
+
+  // send(Buffer *) takes the data of the buffer
+  static void send(const TcpConnectionPtr &conn, const std::string &data) {
+    Buffer buf;
+    buf.append(data);
+    conn->send(&buf);
+  }
+
+  void fill(const TcpConnectionPtr &conn) {
+    while (sent_ < kStreamBytes && sent_ - received_ < kWindow) {
+      send(conn, chunk_);
+      sent_ += kChunk;
+    }
+  }
+
+  void startPhase() {
+    start_ = nowUs();
+    startMetrics_ = serverLoop_->metrics();
+  }
+
+  void endPhase() {
+    EventLoop::Metrics m = serverLoop_->metrics();
+    printf("server iterations %8ld  events %8ld  functors %8ld\n",
+           m.iterations - startMetrics_.iterations,
+           m.events - startMetrics_.events,
+           m.functors - startMetrics_.functors);
+    fflush(stdout);
+  }
+
+  EventLoop *loop_;
+  EventLoop *serverLoop_;
+  TcpClient client_;
+  const std::string chunk_;
+  const std::string ping_;
+  int64_t sent_;
+  int64_t received_;
+  int pongs_;
+  int64_t start_;
+  EventLoop::Metrics startMetrics_;
+};
+
+void run(const char *name, bool edgeTriggered, uint16_t port) {
+  EventLoopThread serverThread;
+  EventLoop *serverLoop = serverThread.startLoop();
+  std::unique_ptr<TcpServer> server;
+  std::promise<void> started;
+  serverLoop->runInLoop([&] {
+    server.reset(
+        new TcpServer(serverLoop, InetAddress(port), "edge_trigger_bench"));
+    server->setEdgeTriggered(edgeTriggered);
+    server->setConnectionCallback([](const TcpConnectionPtr &conn) {
+      if (conn->connected()) {
+        conn->setTcpNoDelay(true);
+      }
+    });
+    server->setMessageCallback(
+        [](const TcpConnectionPtr &conn, Buffer *buf) { conn->send(buf); });
+    server->start();
+    started.set_value();
+  });
+  started.get_future().wait();
+
+  printf("%s\n", name);
+  fflush(stdout);
+  EventLoop loop;
+  Client client(&loop, InetAddress("127.0.0.1", port), edgeTriggered,
+                serverLoop);
+  client.connect();
+  loop.loop();
+  // skip the teardown, the process exits
+  _exit(0);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  uint16_t port = static_cast<uint16_t>(argc > 1 ? atoi(argv[1]) : 9990);
+
+  struct {
+    const char *name;
+    bool edgeTriggered;
+  } modes[] = {
+      {"level-triggered", false},
+      {"edge-triggered", true},
+  };
+  for (auto &m : modes) {
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      run(m.name, m.edgeTriggered, port);
+    }
+    ::waitpid(pid, NULL, 0);
+    ++port;
+  }
+}
@@ -0,0 +1,157 @@
+// Bytes memcpy'd by the receiving side and throughput for requests of 1MB to
+// 32MB, with the frame grown contiguous in the input buffer and gathered in
+// slices parsed with a SliceInputStream, in both wire formats.
+//
+// One client calls a server in the same loop, one call at a time, the
+// response is empty. The copies of the client serializing the request are
+// not counted, those of the server reading it are: the copy out of readFd's
+// stack buffer, the buffer growing, the v1 envelope and the payload parsed
+// into its bytes field.
+//
+// usage: large_message_bench [megabytes per size] [port]
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "network/EventLoop.h"
+#include "network/InetAddress.h"
+#include "network/TcpClient.h"
+#include "network/util.h"
+#include "rpc_framework/RpcChannel.h"
+#include "rpc_framework/RpcServer.h"
+
+#include "rpcbench.pb.h"
+
+#include "alloc_counter.h"
+
+using namespace network;
+
+namespace {
+
+const int kWarmup = 1;
+
+class BenchServiceImpl : public rpcbench::BenchService {
+ public:
+  void Fast(::google::protobuf::RpcController *,
+            const rpcbench::EchoRequest *,
+            rpcbench::EchoResponse *,
+            ::google::protobuf::Closure *done) override {
+    done->Run();
+  }
+};
+
+struct Client {
+  rpcbench::BenchService::Stub *stub;
+  rpcbench::EchoRequest request;
+  int remaining;
+  int calls;
+  int64_t startUs;
+  int64_t copied;
+  EventLoop *loop;
+};
+
+void call(Client *client);
+
+// the channel owns and deletes the responses
+void onDone(Client *client) {
+  if (--client->remaining == client->calls) {
+    // warmed up
+    client->startUs = getMonotonicUs();
+    client->copied = copiedBytes();
+  }
+  if (client->remaining > 0) {
+    call(client);
+    return;
+  }
+  const double elapsed =
+      static_cast<double>(getMonotonicUs() - client->startUs) / 1e6;
+  const double size = static_cast<double>(client->request.payload().size());
+  printf("%6.1f copies %10.1f MB memcpy'd %8.1f MB/s\n",
+         static_cast<double>(copiedBytes() - client->copied) /
+             client->calls / size,
+         static_cast<double>(copiedBytes() - client->copied) /
+             client->calls / (1024 * 1024),
+         size * client->calls / elapsed / (1024 * 1024));
+  fflush(stdout);
+  client->loop->quit();
+}
+
+void call(Client *client) {
+  // the client's serialization is not counted
+  countCopies(false);
+  client->stub->Fast(NULL, &client->request, new rpcbench::EchoResponse,
+                     ::google::protobuf::NewCallback(&onDone, client));
+  countCopies(true);
+}
+
+void run(ProtoRpcCodec::WireFormat format, size_t chainThreshold,
+         size_t size, int calls, uint16_t port) {
+  EventLoop loop;
+  BenchServiceImpl impl;
+  RpcServer server(&loop, InetAddress(port));
+  server.registerService(&impl);
+  server.setChainThreshold(chainThreshold);
+  server.start();
+
+  TcpClient tcpClient(&loop, InetAddress("127.0.0.1", port), "bench");
+  RpcChannelPtr channel(new RpcChannel);
+  channel->codec()->setWireFormat(format);
+  rpcbench::BenchService::Stub stub(get_pointer(channel));
+  Client client;
+  client.stub = &stub;
+  client.request.set_payload(std::string(size, 'x'));
+  client.remaining = calls + kWarmup;
+  client.calls = calls;
+  client.loop = &loop;
+  tcpClient.setMessageCallback(
+      std::bind(&RpcChannel::onMessage, get_pointer(channel), _1, _2));
+  tcpClient.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+      channel->setConnection(conn);
+      call(&client);
+    }
+  });
+  tcpClient.connect();
+  loop.loop();
+  // skip the teardown, the process exits
+  _exit(0);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const int megabytes = argc > 1 ? atoi(argv[1]) : 256;
+  uint16_t port = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 9996);
+
+  const size_t sizes[] = {1 << 20, 4 << 20, 16 << 20, 32 << 20};
+  struct {
+    const char *name;
+    ProtoRpcCodec::WireFormat format;
+    size_t chainThreshold;
+  } modes[] = {
+      {"v1 contiguous", ProtoRpcCodec::kProtobufEnvelope, 0},
+      {"v1 slices", ProtoRpcCodec::kProtobufEnvelope,
+       ProtoRpcCodec::kDefaultChainThreshold},
+      {"v2 contiguous", ProtoRpcCodec::kFlatHeader, 0},
+      {"v2 slices", ProtoRpcCodec::kFlatHeader,
+       ProtoRpcCodec::kDefaultChainThreshold},
+  };
+  for (size_t size : sizes) {
+    const int calls = std::max(
+        2, static_cast<int>((static_cast<size_t>(megabytes) << 20) / size));
+    for (auto &m : modes) {
+      printf("%3zuMB %-14s ", size >> 20, m.name);
+      fflush(stdout);
+      pid_t pid = ::fork();
+      if (pid == 0) {
+        run(m.format, m.chainThreshold, size, calls, port);
+      }
+      ::waitpid(pid, NULL, 0);
+      ++port;
+    }
+  }
+}
@@ -0,0 +1,212 @@
+// Bytes on the wire and server CPU per small RPC, with the service and
+// method names in every request and with the method ids negotiated through
+// MethodTableService, in both wire formats.
+//
+// The server runs in a process of its own, its CPU clock is read around the
+// calls. The bytes are those the client writes and reads, from
+// /proc/self/io. The client keeps a window of calls outstanding.
+//
+// usage: method_id_bench [calls] [port]
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "network/EventLoop.h"
+#include "network/InetAddress.h"
+#include "network/TcpClient.h"
+#include "network/util.h"
+#include "rpc_framework/RpcChannel.h"
+#include "rpc_framework/RpcServer.h"
+
+#include "rpcbench.pb.h"
+
+using namespace network;
+
+namespace {
+
+const int kWarmup = 1000;
+const int kWindow = 32;
+const size_t kPayload = 16;
+
+class BenchServiceImpl : public rpcbench::BenchService {
+ public:
+  void Fast(::google::protobuf::RpcController *,
+            const rpcbench::EchoRequest *request,
+            rpcbench::EchoResponse *response,
+            ::google::protobuf::Closure *done) override {
+    response->set_payload(request->payload());
+    done->Run();
+  }
+};
+
+void serve(uint16_t port) {
+  EventLoop loop;
+  BenchServiceImpl impl;
+  RpcServer server(&loop, InetAddress(port));
+  server.registerService(&impl);
+  server.start();
+  loop.loop();
+}
+
+// rchar and wchar of /proc/self/io
+void ioCounters(int64_t *read, int64_t *written) {
+  FILE *fp = fopen("/proc/self/io", "r");
+  char line[128];
+  while (fp && fgets(line, sizeof line, fp)) {
+    long long value = 0;
+    if (sscanf(line, "rchar: %lld", &value) == 1) {
+      *read = value;
+    } else if (sscanf(line, "wchar: %lld", &value) == 1) {
+      *written = value;
+    }
+  }
+  if (fp) {
+    fclose(fp);
+  }
+}
+
+double cpuSeconds(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return static_cast<double>(ts.tv_sec) + ts.tv_nsec * 1e-9;
+}
+
+struct Client {
+  rpcbench::BenchService::Stub *stub;
+  rpcbench::EchoRequest request;
+  int toCall;  // calls not sent yet
+  int pending;
+  int calls;   // measured, after kWarmup
+  int completed;
+  clockid_t serverClock;
+  double serverCpu;
+  int64_t startUs;
+  int64_t read;
+  int64_t written;
+  const char *name;
+  EventLoop *loop;
+};
+
+void call(Client *client);
+
+// the channel owns and deletes the responses
+void onDone(Client *client) {
+  --client->pending;
+  if (++client->completed == kWarmup) {
+    // the method table is in, a window of calls in flight
+    client->serverCpu = cpuSeconds(client->serverClock);
+    client->startUs = getMonotonicUs();
+    ioCounters(&client->read, &client->written);
+  }
+  if (client->toCall > 0) {
+    call(client);
+    return;
+  }
+  if (client->pending > 0) {
+    return;
+  }
+  const double serverCpu = cpuSeconds(client->serverClock) - client->serverCpu;
+  const int64_t elapsedUs = getMonotonicUs() - client->startUs;
+  int64_t read = 0;
+  int64_t written = 0;
+  ioCounters(&read, &written);
+  // the last window was sent before the counters were read
+  const int calls = client->calls + kWindow;
+  printf("%-10s %6.1f request %6.1f response bytes %7.2f us server CPU "
+         "%7.2f us per RPC\n",
+         client->name, static_cast<double>(written - client->written) / calls,
+         static_cast<double>(read - client->read) / calls,
+         serverCpu * 1e6 / client->calls,
+         static_cast<double>(elapsedUs) / client->calls);
+  fflush(stdout);
+  client->loop->quit();
+}
+
+void call(Client *client) {
+  --client->toCall;
+  ++client->pending;
+  client->stub->Fast(NULL, &client->request, new rpcbench::EchoResponse,
+                     ::google::protobuf::NewCallback(&onDone, client));
+}
+
+void run(const char *name, ProtoRpcCodec::WireFormat format, bool methodIds,
+         pid_t server, int calls, uint16_t port) {
+  EventLoop loop;
+  TcpClient tcpClient(&loop, InetAddress("127.0.0.1", port), "bench");
+  RpcChannelPtr channel(new RpcChannel);
+  channel->codec()->setWireFormat(format);
+  channel->setMethodIds(methodIds);
+  rpcbench::BenchService::Stub stub(get_pointer(channel));
+  Client client;
+  client.stub = &stub;
+  client.request.set_payload(std::string(kPayload, 'x'));
+  client.toCall = calls + kWarmup;
+  client.pending = 0;
+  client.calls = calls;
+  client.completed = 0;
+  if (clock_getcpuclockid(server, &client.serverClock) != 0) {
+    fprintf(stderr, "no CPU clock for the server\n");
+    _exit(1);
+  }
+  client.name = name;
+  client.loop = &loop;
+  tcpClient.setMessageCallback(
+      std::bind(&RpcChannel::onMessage, get_pointer(channel), _1, _2));
+  tcpClient.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+      channel->setConnection(conn);
+      for (int i = 0; i < kWindow; ++i) {
+        call(&client);
+      }
+    }
+  });
+  tcpClient.connect();
+  loop.loop();
+  // skip the teardown, the process exits
+  _exit(0);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const int calls = argc > 1 ? atoi(argv[1]) : 100000;
+  uint16_t port = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 9995);
+
+  printf("rpcbench.BenchService.Fast, %zu bytes payload, %d calls in "
+         "flight\n",
+         kPayload, kWindow);
+  struct {
+    const char *name;
+    ProtoRpcCodec::WireFormat format;
+    bool methodIds;
+  } modes[] = {
+      {"v1 names", ProtoRpcCodec::kProtobufEnvelope, false},
+      {"v1 ids", ProtoRpcCodec::kProtobufEnvelope, true},
+      {"v2 names", ProtoRpcCodec::kFlatHeader, false},
+      {"v2 ids", ProtoRpcCodec::kFlatHeader, true},
+  };
+  fflush(stdout);
+  for (auto &m : modes) {
+    pid_t server = ::fork();
+    if (server == 0) {
+      serve(port);
+      _exit(0);
+    }
+    // listening by then
+    ::usleep(200 * 1000);
+    pid_t client = ::fork();
+    if (client == 0) {
+      run(m.name, m.format, m.methodIds, server, calls, port);
+    }
+    ::waitpid(client, NULL, 0);
+    ::kill(server, SIGKILL);
+    ::waitpid(server, NULL, 0);
+    ++port;
+  }
+}
@@ -0,0 +1,145 @@
+// Server-to-client throughput with 1KB, 64KB and 4MB responses, against
+// readers with a small receive buffer, so writes are partial and responses
+// pile up in the output queue.
+//
+// A reader asks for 4MB worth of responses at a time and keeps two such
+// requests outstanding. The server (one loop) answers the way a codec would:
+// every response is built in a fresh Buffer and handed to
+// TcpConnection::send(Buffer*).
+// Prints the received throughput and the server CPU time per GB.
+//
+// usage: output_queue_bench [clients] [port]
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "network/EventLoop.h"
+#include "network/InetAddress.h"
+#include "network/TcpServer.h"
+#include "network/util.h"
+
+using namespace network;
+
+namespace {
+
+const size_t kBatchBytes = 4 * 1024 * 1024;
+const int kReceiveBuffer = 16 * 1024;
+const double kDuration = 2.0;
+
+std::atomic<int64_t> g_received(0);
+std::atomic<bool> g_stop(false);
+
+size_t batchCount(size_t responseSize) {
+  return std::max<size_t>(kBatchBytes / responseSize, 1);
+}
+
+void onRequest(const TcpConnectionPtr &conn, Buffer *buf,
+               size_t responseSize) {
+  for (; buf->readableBytes() > 0; buf->retrieve(1)) {
+    for (size_t i = 0; i < batchCount(responseSize); ++i) {
+      Buffer response(responseSize);
+      response.ensureWritableBytes(responseSize);
+      memset(response.beginWrite(), 'x', responseSize);
+      response.hasWritten(responseSize);
+      conn->send(&response);
+    }
+  }
+}
+
+void slowReader(uint16_t port, size_t responseSize) {
+  int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  // before connect, the window is negotiated in the handshake
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &kReceiveBuffer,
+               sizeof kReceiveBuffer);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                sizeof addr) < 0) {
+    perror("connect");
+    _exit(1);
+  }
+  // a byte per batch
+  const int64_t batchBytes = batchCount(responseSize) * responseSize;
+  ::write(fd, "rr", 2);
+  int64_t received = 0;
+  std::vector<char> buf(kReceiveBuffer);
+  while (!g_stop.load(std::memory_order_relaxed)) {
+    ssize_t n = ::read(fd, buf.data(), buf.size());
+    if (n <= 0) {
+      break;
+    }
+    if ((received + n) / batchBytes > received / batchBytes) {
+      ::write(fd, "r", 1);
+    }
+    received += n;
+    g_received.fetch_add(n, std::memory_order_relaxed);
+  }
+  ::close(fd);
+}
+
+void run(size_t responseSize, int clients, uint16_t port) {
+  EventLoop loop;
+  TcpServer server(&loop, InetAddress(port), "output_queue_bench");
+  server.setMessageCallback(
+      [responseSize](const TcpConnectionPtr &conn, Buffer *buf) {
+        onRequest(conn, buf, responseSize);
+      });
+  server.start();
+
+  std::vector<std::thread> readers;
+  for (int i = 0; i < clients; ++i) {
+    readers.emplace_back(slowReader, port, responseSize);
+  }
+  int64_t startNs = 0, startCpuNs = 0, startBytes = 0;
+  loop.runAfter(0.2, [&] {
+    startNs = getMonotonicNs();
+    startCpuNs = loop.metrics().cpuTimeNs;
+    startBytes = g_received.load();
+  });
+  loop.runAfter(0.2 + kDuration, [&] {
+    const double seconds = (getMonotonicNs() - startNs) / 1e9;
+    const double bytes = static_cast<double>(g_received.load() - startBytes);
+    const double cpuMs = (loop.metrics().cpuTimeNs - startCpuNs) / 1e6;
+    printf("%8zu bytes %10.1f MB/s %10.1f server CPU ms/GB\n", responseSize,
+           bytes / seconds / (1024 * 1024),
+           bytes > 0 ? cpuMs / (bytes / (1024.0 * 1024 * 1024)) : 0.0);
+    fflush(stdout);
+    g_stop = true;
+    loop.quit();
+  });
+  loop.loop();
+  // skip the teardown, the process exits
+  _exit(0);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  int clients = argc > 1 ? atoi(argv[1]) : 4;
+  uint16_t port = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 9987);
+
+  printf("%d readers with %d bytes SO_RCVBUF\n", clients, kReceiveBuffer);
+  fflush(stdout);
+  const size_t sizes[] = {1024, 64 * 1024, 4 * 1024 * 1024};
+  for (size_t size : sizes) {
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      run(size, clients, port);
+    }
+    ::waitpid(pid, NULL, 0);
+    ++port;
+  }
+}
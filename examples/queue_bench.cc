@@ -0,0 +1,148 @@
+// Cross-thread task throughput into one loop, 1..64 producer threads.
+//
+// Every producer queues kTasks / producers tasks as fast as it can, the time
+// is taken until the loop has run them all. Compared are
+//   - the mutex version: a std::vector swapped under a std::mutex, with an
+//     eventfd write per task, as EventLoop::queueInLoop() used to be
+//   - EventLoop::queueInLoop(): the lock-free MpscQueue, woken only when the
+//     loop sleeps in poll
+//
+// usage: queue_bench [max_producers]
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "network/EventLoop.h"
+#include "network/EventLoopThread.h"
+
+using namespace network;
+
+namespace {
+
+const int kTasks = 2000000;
+
+int64_t nowUs() {
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+///
+/// The former pending functor queue of EventLoop, with an eventfd polled by
+/// its own thread.
+class MutexLoop {
+ public:
+  typedef std::function<void()> Functor;
+
+  MutexLoop()
+      : wakeupFd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), quit_(false) {
+    thread_ = std::thread(&MutexLoop::loop, this);
+  }
+
+  ~MutexLoop() {
+    queueInLoop([this] { quit_ = true; });
+    thread_.join();
+    ::close(wakeupFd_);
+  }
+
+  void queueInLoop(Functor cb) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      pendingFunctors_.push_back(std::move(cb));
+    }
+    uint64_t one = 1;
+    if (::write(wakeupFd_, &one, sizeof one) != sizeof one) {
+      perror("write");
+    }
+  }
+
+ private:
+  void loop() {
+    struct pollfd pfd = {wakeupFd_, POLLIN, 0};
+    while (!quit_) {
+      ::poll(&pfd, 1, 10000);
+      uint64_t n;
+      if (::read(wakeupFd_, &n, sizeof n) < 0 && errno != EAGAIN) {
+        perror("read");
+      }
+      std::vector<Functor> functors;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        functors.swap(pendingFunctors_);
+      }
+      for (const Functor &functor : functors) {
+        functor();
+      }
+    }
+  }
+
+  const int wakeupFd_;
+  bool quit_;  // in loop thread
+  std::mutex mutex_;
+  std::vector<Functor> pendingFunctors_;
+  std::thread thread_;
+};
+
+// tasks run by the loop, read by the loop only
+int64_t g_done = 0;
+
+// returns millions of tasks per second
+template <typename Loop>
+double bench(Loop *loop, int producers) {
+  g_done = 0;
+  const int perProducer = kTasks / producers;
+  const int64_t total = static_cast<int64_t>(perProducer) * producers;
+  std::promise<void> finished;
+  std::atomic<bool> go(false);
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&] {
+      while (!go.load(std::memory_order_acquire)) {
+      }
+      for (int i = 0; i < perProducer; ++i) {
+        loop->queueInLoop([&finished, total] {
+          if (++g_done == total) {
+            finished.set_value();
+          }
+        });
+      }
+    });
+  }
+  const int64_t start = nowUs();
+  go.store(true, std::memory_order_release);
+  finished.get_future().wait();
+  const int64_t elapsedUs = nowUs() - start;
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  return static_cast<double>(total) / elapsedUs;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const int maxProducers = argc > 1 ? atoi(argv[1]) : 64;
+
+  EventLoopThread loopThread;
+  EventLoop *loop = loopThread.startLoop();
+  MutexLoop mutexLoop;
+
+  printf("%9s %12s %12s\n", "producers", "mutex", "lock-free");
+  for (int producers = 1; producers <= maxProducers; producers *= 2) {
+    const double mutexRate = bench(&mutexLoop, producers);
+    const double lockFreeRate = bench(loop, producers);
+    printf("%9d %8.2f M/s %8.2f M/s\n", producers, mutexRate, lockFreeRate);
+    fflush(stdout);
+  }
+}
@@ -0,0 +1,180 @@
+// Latency of a cheap RPC method while a slow one (a 20ms blocking call)
+// is served by the same I/O loop, with the handlers inline in the loop,
+// the slow method on a WorkStealingPool, and every method on the pool.
+//
+// One client calls Fast every 1ms and Slow every 25ms for 2s, prints the
+// latency percentiles of Fast and the number of Slow calls completed.
+//
+// usage: rpc_executor_bench [port]
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "network/EventLoop.h"
+#include "network/EventLoopThread.h"
+#include "network/InetAddress.h"
+#include "network/TcpClient.h"
+#include "network/WorkStealingPool.h"
+#include "network/util.h"
+#include "rpc_framework/RpcChannel.h"
+#include "rpc_framework/RpcServer.h"
+
+#include "rpcbench.pb.h"
+
+using namespace network;
+
+namespace {
+
+const int kWorkers = 4;
+const int64_t kSlowUs = 20000;
+const double kFastInterval = 0.001;
+const double kSlowInterval = 0.025;
+const double kWarmup = 0.2;
+const double kDuration = 2.0;
+
+class BenchServiceImpl : public rpcbench::BenchService {
+ public:
+  void Fast(::google::protobuf::RpcController *,
+            const rpcbench::EchoRequest *request,
+            rpcbench::EchoResponse *response,
+            ::google::protobuf::Closure *done) override {
+    response->set_payload(request->payload());
+    done->Run();
+  }
+
+  void Slow(::google::protobuf::RpcController *,
+            const rpcbench::EchoRequest *request,
+            rpcbench::EchoResponse *response,
+            ::google::protobuf::Closure *done) override {
+    ::usleep(static_cast<useconds_t>(request->sleep_us()));
+    response->set_payload(request->payload());
+    done->Run();
+  }
+};
+
+enum Mode { kAllInline, kSlowOnPool, kAllOnPool };
+
+std::vector<int64_t> g_fastLatencyUs;
+int64_t g_slowDone = 0;
+bool g_measuring = false;
+
+// the channel owns and deletes the responses
+void onFastDone(int64_t startUs) {
+  if (g_measuring) {
+    g_fastLatencyUs.push_back(getMonotonicUs() - startUs);
+  }
+}
+
+void onSlowDone() {
+  if (g_measuring) {
+    ++g_slowDone;
+  }
+}
+
+int64_t percentile(std::vector<int64_t> *v, double p) {
+  if (v->empty()) {
+    return 0;
+  }
+  size_t i = static_cast<size_t>(p * (v->size() - 1));
+  std::nth_element(v->begin(), v->begin() + i, v->end());
+  return (*v)[i];
+}
+
+void run(const char *name, Mode mode, uint16_t port) {
+  // the server in its own loop thread, handlers inline block it
+  EventLoopThread serverThread;
+  EventLoop *serverLoop = serverThread.startLoop();
+  BenchServiceImpl impl;
+  std::unique_ptr<RpcServer> server;
+  std::promise<void> started;
+  serverLoop->runInLoop([&] {
+    server.reset(new RpcServer(serverLoop, InetAddress(port)));
+    server->registerService(&impl);
+    std::shared_ptr<WorkStealingPool> pool(new WorkStealingPool("bench"));
+    pool->setThreadNum(kWorkers);
+    if (mode == kSlowOnPool) {
+      server->setMethodExecutor("rpcbench.BenchService.Slow", pool);
+    } else if (mode == kAllOnPool) {
+      server->setExecutor(pool);
+    }
+    server->start();
+    started.set_value();
+  });
+  started.get_future().wait();
+
+  EventLoop loop;
+  TcpClient client(&loop, InetAddress("127.0.0.1", port), "bench");
+  RpcChannelPtr channel(new RpcChannel);
+  rpcbench::BenchService::Stub stub(get_pointer(channel));
+  client.setMessageCallback(
+      std::bind(&RpcChannel::onMessage, get_pointer(channel), _1, _2));
+  client.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+    if (!conn->connected()) {
+      return;
+    }
+    channel->setConnection(conn);
+    loop.runEvery(kFastInterval, [&stub] {
+      rpcbench::EchoRequest request;
+      request.set_payload("fast");
+      stub.Fast(NULL, &request, new rpcbench::EchoResponse,
+                ::google::protobuf::NewCallback(&onFastDone, getMonotonicUs()));
+    });
+    loop.runEvery(kSlowInterval, [&stub] {
+      rpcbench::EchoRequest request;
+      request.set_sleep_us(kSlowUs);
+      request.set_payload("slow");
+      stub.Slow(NULL, &request, new rpcbench::EchoResponse,
+                ::google::protobuf::NewCallback(&onSlowDone));
+    });
+    loop.runAfter(kWarmup, [] { g_measuring = true; });
+    loop.runAfter(kWarmup + kDuration, [&] {
+      g_measuring = false;
+      std::vector<int64_t> &lat = g_fastLatencyUs;
+      const size_t calls = lat.size();
+      const int64_t p50 = percentile(&lat, 0.5);
+      const int64_t p99 = percentile(&lat, 0.99);
+      const int64_t max = percentile(&lat, 1.0);
+      printf("%-22s %6zu %8ldus %8ldus %8ldus %8ld\n", name, calls, p50, p99,
+             max, g_slowDone);
+      fflush(stdout);
+      loop.quit();
+    });
+  });
+  client.connect();
+  loop.loop();
+  // skip the teardown, the process exits
+  _exit(0);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  uint16_t port = static_cast<uint16_t>(argc > 1 ? atoi(argv[1]) : 9986);
+
+  printf("%-22s %6s %10s %10s %10s %8s\n", "handlers", "fast", "p50", "p99",
+         "max", "slow");
+  fflush(stdout);
+  struct {
+    const char *name;
+    Mode mode;
+  } modes[] = {
+      {"all inline", kAllInline},
+      {"slow on pool", kSlowOnPool},
+      {"all on pool", kAllOnPool},
+  };
+  for (auto &m : modes) {
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      run(m.name, m.mode, port);
+    }
+    ::waitpid(pid, NULL, 0);
+    ++port;
+  }
+  google::protobuf::ShutdownProtobufLibrary();
+}
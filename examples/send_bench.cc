@@ -0,0 +1,176 @@
+// Cost of TcpConnection::send() from a thread other than the loop's: the
+// mallocs and malloc'd bytes per send, over the sending thread and the loop.
+// A copy of the message shows up as a malloc of its size.
+//
+// Messages are built before the measure, a reader in a child process
+// drains the connection.
+//
+// usage: send_bench [messages] [port]
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "network/EventLoop.h"
+#include "network/InetAddress.h"
+#include "network/Slice.h"
+#include "network/TcpServer.h"
+
+#include "alloc_counter.h"
+
+using namespace network;
+
+namespace {
+
+const int kBatchSize = 16;
+
+enum Method {
+  kCopyString,    // send(const std::string &)
+  kSwapBuffer,    // send(Buffer *)
+  kMoveBuffer,    // send(Buffer &&)
+  kMoveString,    // send(std::string &&)
+  kSharedSlice,   // send(const Slice &), the same message every time
+  kSliceBatch,    // send(std::vector<Slice> &&), kBatchSize at a time
+};
+
+const char *methodName(Method method) {
+  switch (method) {
+    case kCopyString:
+      return "const string&";
+    case kSwapBuffer:
+      return "Buffer*";
+    case kMoveBuffer:
+      return "Buffer&&";
+    case kMoveString:
+      return "string&&";
+    case kSharedSlice:
+      return "shared Slice";
+    default:
+      return "Slice batch";
+  }
+}
+
+void reader(uint16_t port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                sizeof addr) < 0) {
+    perror("connect");
+    _exit(1);
+  }
+  std::vector<char> buf(1024 * 1024);
+  while (::read(fd, buf.data(), buf.size()) > 0) {
+  }
+  _exit(0);
+}
+
+// sends @c count messages of @c size from this thread
+void sendAll(const TcpConnectionPtr &conn, Method method, int count,
+             size_t size) {
+  const std::string message(size, 'x');
+  std::vector<Buffer> buffers;
+  std::vector<std::string> strings;
+  if (method == kSwapBuffer || method == kMoveBuffer) {
+    buffers.resize(count);
+    for (Buffer &buf : buffers) {
+      buf.append(message.data(), message.size());
+    }
+  } else if (method == kMoveString) {
+    strings.assign(count, message);
+  }
+  const Slice shared = Slice::fromString(std::string(message));
+
+  const int64_t mallocs = mallocCount();
+  const int64_t bytes = mallocBytes();
+  for (int i = 0; i < count; ++i) {
+    switch (method) {
+      case kCopyString:
+        conn->send(message);
+        break;
+      case kSwapBuffer:
+        conn->send(&buffers[i]);
+        break;
+      case kMoveBuffer:
+        conn->send(std::move(buffers[i]));
+        break;
+      case kMoveString:
+        conn->send(std::move(strings[i]));
+        break;
+      case kSharedSlice:
+        conn->send(shared);
+        break;
+      case kSliceBatch:
+        if (i % kBatchSize == 0) {
+          conn->send(std::vector<Slice>(kBatchSize, shared));
+        }
+        break;
+    }
+  }
+  // wait for the loop to be done with them
+  std::promise<void> done;
+  conn->getLoop()->queueInLoop([&done] { done.set_value(); });
+  done.get_future().wait();
+  printf("%8zu bytes %-14s %6.2f mallocs %10.1f bytes malloc'd per send\n",
+         size, methodName(method),
+         static_cast<double>(mallocCount() - mallocs) / count,
+         static_cast<double>(mallocBytes() - bytes) / count);
+  fflush(stdout);
+}
+
+void run(int count, uint16_t port) {
+  EventLoop loop;
+  TcpServer server(&loop, InetAddress(port), "send_bench");
+  std::promise<TcpConnectionPtr> connected;
+  server.setConnectionCallback([&connected](const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+      connected.set_value(conn);
+    }
+  });
+  server.start();
+
+  pid_t child = ::fork();
+  if (child == 0) {
+    reader(port);
+  }
+  std::thread sender([&] {
+    TcpConnectionPtr conn = connected.get_future().get();
+    const size_t sizes[] = {1024, 64 * 1024};
+    for (size_t size : sizes) {
+      for (int method = kCopyString; method <= kSliceBatch; ++method) {
+        sendAll(conn, static_cast<Method>(method), count, size);
+      }
+    }
+    loop.quit();
+  });
+  loop.loop();
+  sender.join();
+  ::kill(child, SIGKILL);
+  ::waitpid(child, NULL, 0);
+  // skip the teardown, the process exits
+  _exit(0);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  int count = argc > 1 ? atoi(argv[1]) : 20000;
+  uint16_t port = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 9991);
+  // rounded to whole batches
+  count = std::max(count / kBatchSize, 1) * kBatchSize;
+  run(count, port);
+}
@@ -0,0 +1,157 @@
+// Bytes memcpy'd and mallocs per request sent by ProtoRpcCodec::sendRequest,
+// in the loop of the connection and from another thread, in both wire
+// formats, for payloads of 256B to 64KB.
+//
+// The requests go out in bursts, faster than the reader in a child process
+// drains them, so that the output queue is backlogged most of the time.
+// Serializing the payload, a bytes field, is a copy of its own: 1.0 is what
+// is left when nothing else copies it. The copies of the loop writing the
+// queued bytes to the socket are the kernel's, not counted.
+//
+// usage: send_copy_bench [kilobytes per size] [port]
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "network/EventLoop.h"
+#include "network/InetAddress.h"
+#include "network/TcpServer.h"
+#include "rpc_framework/RpcCodec.h"
+
+#include "rpcbench.pb.h"
+
+#include "alloc_counter.h"
+
+using namespace network;
+
+namespace {
+
+const int kBurst = 64;
+
+void reader(uint16_t port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  // a small window and slower than the sender, the output queue backs up
+  int window = 64 * 1024;
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &window, sizeof window);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                sizeof addr) < 0) {
+    perror("connect");
+    _exit(1);
+  }
+  std::vector<char> buf(64 * 1024);
+  while (::read(fd, buf.data(), buf.size()) > 0) {
+    ::usleep(1000);
+  }
+  _exit(0);
+}
+
+// waits for the loop to be done with what was sent
+void drain(EventLoop *loop) {
+  std::promise<void> done;
+  loop->queueInLoop([&done] { done.set_value(); });
+  done.get_future().wait();
+}
+
+void sendBurst(ProtoRpcCodec *codec, const TcpConnectionPtr &conn,
+               const ::google::protobuf::MethodDescriptor *method,
+               const rpcbench::EchoRequest &request, int64_t *id) {
+  for (int i = 0; i < kBurst; ++i) {
+    codec->sendRequest(conn, ++*id, method, request);
+  }
+}
+
+void sendAll(ProtoRpcCodec *codec, const TcpConnectionPtr &conn,
+             ProtoRpcCodec::WireFormat format, bool inLoop, int count,
+             size_t size) {
+  const ::google::protobuf::MethodDescriptor *method =
+      rpcbench::BenchService::descriptor()->FindMethodByName("Fast");
+  rpcbench::EchoRequest request;
+  request.set_payload(std::string(size, 'x'));
+  codec->setWireFormat(format);
+  EventLoop *loop = conn->getLoop();
+  int64_t id = 0;
+
+  const int64_t copied = copiedBytes();
+  const int64_t mallocs = mallocCount();
+  for (int sent = 0; sent < count; sent += kBurst) {
+    if (inLoop) {
+      loop->runInLoop([&] { sendBurst(codec, conn, method, request, &id); });
+    } else {
+      sendBurst(codec, conn, method, request, &id);
+    }
+    drain(loop);
+  }
+  printf("%6zu bytes %-3s %-12s %5.2f copies %6.2f mallocs per request\n",
+         size, format == ProtoRpcCodec::kFlatHeader ? "v2" : "v1",
+         inLoop ? "in loop" : "cross-thread",
+         static_cast<double>(copiedBytes() - copied) / count / size,
+         static_cast<double>(mallocCount() - mallocs) / count);
+  fflush(stdout);
+}
+
+void run(int kilobytes, uint16_t port) {
+  EventLoop loop;
+  TcpServer server(&loop, InetAddress(port), "send_copy_bench");
+  std::promise<TcpConnectionPtr> connected;
+  server.setConnectionCallback([&connected](const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+      connected.set_value(conn);
+    }
+  });
+  server.start();
+  ProtoRpcCodec codec([](const TcpConnectionPtr &, const RpcMessagePtr &) {});
+
+  pid_t child = ::fork();
+  if (child == 0) {
+    reader(port);
+  }
+  std::thread sender([&] {
+    TcpConnectionPtr conn = connected.get_future().get();
+    const size_t sizes[] = {256, 4 * 1024, 64 * 1024};
+    const ProtoRpcCodec::WireFormat formats[] = {
+        ProtoRpcCodec::kProtobufEnvelope, ProtoRpcCodec::kFlatHeader};
+    for (size_t size : sizes) {
+      // whole bursts
+      const int count = std::max(
+          static_cast<int>((static_cast<size_t>(kilobytes) << 10) / size /
+                           kBurst),
+          1) * kBurst;
+      for (ProtoRpcCodec::WireFormat format : formats) {
+        sendAll(&codec, conn, format, true, count, size);
+        sendAll(&codec, conn, format, false, count, size);
+      }
+    }
+    loop.quit();
+  });
+  loop.loop();
+  sender.join();
+  ::kill(child, SIGKILL);
+  ::waitpid(child, NULL, 0);
+  // skip the teardown, the process exits
+  _exit(0);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const int kilobytes = argc > 1 ? atoi(argv[1]) : 16 * 1024;
+  uint16_t port = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 9997);
+  run(kilobytes, port);
+}
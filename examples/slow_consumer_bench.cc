@@ -0,0 +1,166 @@
+// Server memory under slow consumers: every client keeps sending requests
+// but reads its responses slowly. Each request byte asks for a 16KB
+// response.
+//
+// Runs the server (one loop) with no protection, with reading paused at the
+// high water mark, and with a hard cap on the output. Prints the server RSS,
+// the output queued over all connections and the connections closed by the
+// cap, after a few seconds.
+//
+// usage: slow_consumer_bench [clients] [port]
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <vector>
+
+#include "network/EventLoop.h"
+#include "network/InetAddress.h"
+#include "network/TcpServer.h"
+#include "network/util.h"
+
+using namespace network;
+
+namespace {
+
+const size_t kResponseSize = 16 * 1024;
+const size_t kHighWaterMark = 1024 * 1024;
+const size_t kLowWaterMark = 256 * 1024;
+const size_t kMaxOutputBytes = 4 * 1024 * 1024;
+const double kDuration = 6.0;
+
+enum Mode { kUnbounded, kPauseReading, kCap };
+
+const char *modeName(Mode mode) {
+  switch (mode) {
+    case kUnbounded:
+      return "unbounded";
+    case kPauseReading:
+      return "pause reading";
+    default:
+      return "cap";
+  }
+}
+
+double rssMB() {
+  long pages = 0, resident = 0;
+  FILE *fp = fopen("/proc/self/statm", "r");
+  if (fp) {
+    if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    fclose(fp);
+  }
+  return resident * sysconf(_SC_PAGESIZE) / (1024.0 * 1024);
+}
+
+// child: a request and a 4KB read per connection every 5ms, the server
+// writes 16KB per request
+void slowClients(uint16_t port, int clients) {
+  std::vector<int> fds;
+  for (int i = 0; i < clients; ++i) {
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr);
+    fds.push_back(fd);
+  }
+  char buf[4096];
+  while (true) {
+    for (int fd : fds) {
+      ::write(fd, "r", 1);
+      ::read(fd, buf, sizeof buf);
+    }
+    ::usleep(5000);
+  }
+}
+
+void run(Mode mode, int clients, uint16_t port) {
+  EventLoop loop;
+  TcpServer server(&loop, InetAddress(port), "slow_consumer_bench");
+  std::set<TcpConnectionPtr> conns;
+  int closed = 0;
+  server.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+      if (mode == kPauseReading) {
+        conn->setHighWaterMarkCallback(HighWaterMarkCallback(),
+                                       kHighWaterMark);
+        conn->setLowWaterMarkCallback(LowWaterMarkCallback(), kLowWaterMark);
+        conn->setPauseReadingAtHighWaterMark(true);
+      } else if (mode == kCap) {
+        conn->setMaxOutputBytes(kMaxOutputBytes);
+      }
+      conns.insert(conn);
+    } else {
+      conns.erase(conn);
+      ++closed;
+    }
+  });
+  server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf) {
+    // a request per byte, the rest waits while backpressured
+    for (; buf->readableBytes() > 0 && conn->connected() &&
+           !conn->backpressured();
+         buf->retrieve(1)) {
+      Buffer response;
+      response.ensureWritableBytes(kResponseSize);
+      memset(response.beginWrite(), 'x', kResponseSize);
+      response.hasWritten(kResponseSize);
+      conn->send(&response);
+    }
+  });
+  server.start();
+
+  pid_t child = ::fork();
+  if (child == 0) {
+    slowClients(port, clients);
+  }
+  loop.runAfter(kDuration, [&] {
+    size_t output = 0, peak = 0;
+    for (const TcpConnectionPtr &conn : conns) {
+      TcpConnection::MemoryStats stats = conn->memoryStats();
+      output += stats.outputBytes;
+      peak = std::max(peak, stats.peakOutputBytes);
+    }
+    printf("%-14s RSS %8.1f MB, output %8.1f MB, peak per connection "
+           "%6.1f MB, closed %d\n",
+           modeName(mode), rssMB(), output / (1024.0 * 1024),
+           peak / (1024.0 * 1024), closed);
+    fflush(stdout);
+    loop.quit();
+  });
+  loop.loop();
+  ::kill(child, SIGKILL);
+  ::waitpid(child, NULL, 0);
+  // skip the teardown, the process exits
+  _exit(0);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  int clients = argc > 1 ? atoi(argv[1]) : 50;
+  uint16_t port = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 9990);
+
+  printf("%d slow clients, %zu bytes per response, %.0fs\n", clients,
+         kResponseSize, kDuration);
+  fflush(stdout);
+  const Mode modes[] = {kUnbounded, kPauseReading, kCap};
+  for (Mode mode : modes) {
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      run(mode, clients, port);
+    }
+    ::waitpid(pid, NULL, 0);
+    ++port;
+  }
+}
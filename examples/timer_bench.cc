@@ -0,0 +1,179 @@
+// Timer arm and cancel cost with many outstanding timers.
+//
+// Arms N timers with deadlines spread over the next minute, then measures
+//   - arm, linking all N
+//   - cancel+arm, canceling a random timer and arming it with a new deadline
+//     while N are outstanding (an RPC deadline armed and met per call)
+//   - cancel, unlinking all N
+// for a std::set ordered by (expiration, timer), the usual sorted timer
+// queue, for the TimingWheel alone, and for EventLoop::runAfter()/cancel()
+// through the TimerQueue (callback, free list and timerfd included).
+//
+// usage: timer_bench [timers]
+#include <time.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "network/EventLoop.h"
+#include "network/Timer.h"
+#include "network/TimerId.h"
+#include "network/TimingWheel.h"
+#include "network/util.h"
+
+using namespace network;
+
+namespace {
+
+const int kChurn = 1000000;
+const int64_t kSpreadMs = 60000;
+
+int64_t nowUs() {
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+struct Result {
+  double armNs;
+  double churnNs;
+  double cancelNs;
+};
+
+void print(const char *name, size_t n, const Result &r) {
+  printf("%-12s %8zu timers  arm %6.1f ns  cancel+arm %6.1f ns  "
+         "cancel %6.1f ns\n",
+         name, n, r.armNs, r.churnNs, r.cancelNs);
+}
+
+Result benchSet(const std::vector<int64_t> &deadlines,
+                const std::vector<size_t> &picks) {
+  typedef std::pair<int64_t, Timer *> Entry;
+  const size_t n = deadlines.size();
+  std::vector<std::unique_ptr<Timer>> timers(n);
+  for (auto &t : timers) {
+    t.reset(new Timer);
+  }
+  std::set<Entry> queue;
+  Result r;
+
+  int64_t start = nowUs();
+  for (size_t i = 0; i < n; ++i) {
+    timers[i]->reset(TimerCallback(), deadlines[i], 0);
+    queue.insert(Entry(deadlines[i], timers[i].get()));
+  }
+  r.armNs = (nowUs() - start) * 1000.0 / n;
+
+  start = nowUs();
+  for (int i = 0; i < kChurn; ++i) {
+    Timer *t = timers[picks[i]].get();
+    queue.erase(Entry(t->expiration(), t));
+    t->reset(TimerCallback(), deadlines[picks[kChurn - 1 - i]], 0);
+    queue.insert(Entry(t->expiration(), t));
+  }
+  r.churnNs = (nowUs() - start) * 1000.0 / kChurn;
+
+  start = nowUs();
+  for (auto &t : timers) {
+    queue.erase(Entry(t->expiration(), t.get()));
+  }
+  r.cancelNs = (nowUs() - start) * 1000.0 / n;
+  return r;
+}
+
+Result benchWheel(int64_t now, const std::vector<int64_t> &deadlines,
+                  const std::vector<size_t> &picks) {
+  const size_t n = deadlines.size();
+  std::vector<std::unique_ptr<Timer>> timers(n);
+  for (auto &t : timers) {
+    t.reset(new Timer);
+  }
+  TimingWheel wheel(now);
+  Result r;
+
+  int64_t start = nowUs();
+  for (size_t i = 0; i < n; ++i) {
+    timers[i]->reset(TimerCallback(), deadlines[i], 0);
+    wheel.add(timers[i].get());
+  }
+  r.armNs = (nowUs() - start) * 1000.0 / n;
+
+  start = nowUs();
+  for (int i = 0; i < kChurn; ++i) {
+    Timer *t = timers[picks[i]].get();
+    wheel.remove(t);
+    t->reset(TimerCallback(), deadlines[picks[kChurn - 1 - i]], 0);
+    wheel.add(t);
+  }
+  r.churnNs = (nowUs() - start) * 1000.0 / kChurn;
+
+  start = nowUs();
+  for (auto &t : timers) {
+    wheel.remove(t.get());
+  }
+  r.cancelNs = (nowUs() - start) * 1000.0 / n;
+  return r;
+}
+
+Result benchLoop(EventLoop *loop, const std::vector<int64_t> &deadlines,
+                 const std::vector<size_t> &picks, int64_t now) {
+  const size_t n = deadlines.size();
+  std::vector<TimerId> ids(n);
+  Result r;
+
+  int64_t start = nowUs();
+  for (size_t i = 0; i < n; ++i) {
+    ids[i] = loop->runAfter((deadlines[i] - now) / 1000.0, [] {});
+  }
+  r.armNs = (nowUs() - start) * 1000.0 / n;
+
+  start = nowUs();
+  for (int i = 0; i < kChurn; ++i) {
+    const size_t k = picks[i];
+    loop->cancel(ids[k]);
+    ids[k] = loop->runAfter(
+        (deadlines[picks[kChurn - 1 - i]] - now) / 1000.0, [] {});
+  }
+  r.churnNs = (nowUs() - start) * 1000.0 / kChurn;
+
+  start = nowUs();
+  for (const TimerId &id : ids) {
+    loop->cancel(id);
+  }
+  r.cancelNs = (nowUs() - start) * 1000.0 / n;
+  return r;
+}
+
+void bench(EventLoop *loop, size_t n) {
+  std::mt19937_64 rng(42);
+  const int64_t now = getMonotonicMs();
+  std::vector<int64_t> deadlines(n);
+  for (int64_t &d : deadlines) {
+    d = now + 1000 + static_cast<int64_t>(rng() % kSpreadMs);
+  }
+  std::vector<size_t> picks(kChurn);
+  for (size_t &p : picks) {
+    p = rng() % n;
+  }
+  print("std::set", n, benchSet(deadlines, picks));
+  print("TimingWheel", n, benchWheel(now, deadlines, picks));
+  print("EventLoop", n, benchLoop(loop, deadlines, picks, now));
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const size_t maxTimers = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+
+  EventLoop loop;
+  for (size_t n = 1000; n < maxTimers; n *= 10) {
+    bench(&loop, n);
+  }
+  bench(&loop, maxTimers);
+}
@@ -0,0 +1,148 @@
+// Cost per RPC of the v1 wire format, a RpcMessage holding the message
+// serialized again, and of v2, a flat header followed by the message: the
+// mallocs, the bytes malloc'd (a copy of the payload shows up as a malloc of
+// its size) and the time, client and server together.
+//
+// One client calls Echo on a server in the same loop, one call at a time.
+//
+// usage: wire_format_bench [calls] [port]
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "network/EventLoop.h"
+#include "network/InetAddress.h"
+#include "network/TcpClient.h"
+#include "network/util.h"
+#include "rpc_framework/RpcChannel.h"
+#include "rpc_framework/RpcServer.h"
+
+#include "rpcbench.pb.h"
+
+#include "alloc_counter.h"
+
+using namespace network;
+
+namespace {
+
+const int kWarmup = 200;
+
+class BenchServiceImpl : public rpcbench::BenchService {
+ public:
+  void Fast(::google::protobuf::RpcController *,
+            const rpcbench::EchoRequest *request,
+            rpcbench::EchoResponse *response,
+            ::google::protobuf::Closure *done) override {
+    response->set_payload(request->payload());
+    done->Run();
+  }
+};
+
+struct Client {
+  rpcbench::BenchService::Stub *stub;
+  rpcbench::EchoRequest request;
+  int remaining;
+  int64_t startUs;
+  int64_t mallocs;
+  int64_t mallocBytes;
+  int calls;
+  size_t size;
+  ProtoRpcCodec::WireFormat format;
+  EventLoop *loop;
+};
+
+void call(Client *client);
+
+// the channel owns and deletes the responses
+void onDone(Client *client) {
+  if (--client->remaining == client->calls) {
+    // warmed up
+    client->startUs = getMonotonicUs();
+    client->mallocs = mallocCount();
+    client->mallocBytes = mallocBytes();
+  }
+  if (client->remaining > 0) {
+    call(client);
+    return;
+  }
+  const double elapsedUs =
+      static_cast<double>(getMonotonicUs() - client->startUs);
+  printf("%8zu bytes %-3s %7.2f mallocs %10.1f bytes malloc'd %8.2f us "
+         "per RPC\n",
+         client->size,
+         client->format == ProtoRpcCodec::kFlatHeader ? "v2" : "v1",
+         static_cast<double>(mallocCount() - client->mallocs) /
+             client->calls,
+         static_cast<double>(mallocBytes() - client->mallocBytes) /
+             client->calls,
+         elapsedUs / client->calls);
+  fflush(stdout);
+  client->loop->quit();
+}
+
+void call(Client *client) {
+  client->stub->Fast(NULL, &client->request, new rpcbench::EchoResponse,
+                     ::google::protobuf::NewCallback(&onDone, client));
+}
+
+void run(ProtoRpcCodec::WireFormat format, size_t size, int calls,
+         uint16_t port) {
+  EventLoop loop;
+  BenchServiceImpl impl;
+  RpcServer server(&loop, InetAddress(port));
+  server.registerService(&impl);
+  server.start();
+
+  TcpClient tcpClient(&loop, InetAddress("127.0.0.1", port), "bench");
+  RpcChannelPtr channel(new RpcChannel);
+  channel->codec()->setWireFormat(format);
+  rpcbench::BenchService::Stub stub(get_pointer(channel));
+  Client client;
+  client.stub = &stub;
+  client.request.set_payload(std::string(size, 'x'));
+  client.remaining = calls + kWarmup;
+  client.calls = calls;
+  client.size = size;
+  client.format = format;
+  client.loop = &loop;
+  tcpClient.setMessageCallback(
+      std::bind(&RpcChannel::onMessage, get_pointer(channel), _1, _2));
+  tcpClient.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+      channel->setConnection(conn);
+      call(&client);
+    }
+  });
+  tcpClient.connect();
+  loop.loop();
+  // skip the teardown, the process exits
+  _exit(0);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const int calls = argc > 1 ? atoi(argv[1]) : 20000;
+  uint16_t port = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 9992);
+
+  const size_t sizes[] = {64, 4096, 256 * 1024};
+  const ProtoRpcCodec::WireFormat formats[] = {
+      ProtoRpcCodec::kProtobufEnvelope, ProtoRpcCodec::kFlatHeader};
+  for (size_t size : sizes) {
+    for (ProtoRpcCodec::WireFormat format : formats) {
+      // at most 1GB each way
+      const int n = std::max(
+          1, std::min(calls, static_cast<int>((1 << 30) / size)));
+      pid_t pid = ::fork();
+      if (pid == 0) {
+        run(format, size, n, port);
+      }
+      ::waitpid(pid, NULL, 0);
+      ++port;
+    }
+  }
+}
@@ -0,0 +1,102 @@
+// Checks that every task submitted to a WorkStealingPool runs: the ones
+// queued before stop(), the ones submitted while it stops, and the ones
+// submitted after it, which run in the submitting thread.
+//
+// Exits with 1 on the first check failing.
+//
+// usage: work_stealing_pool_test
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "network/WorkStealingPool.h"
+
+using namespace network;
+
+namespace {
+
+const int kWorkers = 4;
+const int kSubmitters = 4;
+
+void check(bool ok, const char *what) {
+  if (!ok) {
+    std::printf("FAILED: %s\n", what);
+    std::exit(1);
+  }
+  std::printf("ok: %s\n", what);
+}
+
+void queuedBeforeStop() {
+  WorkStealingPool pool;
+  pool.setThreadNum(kWorkers);
+  pool.start();
+  std::atomic<int> ran(0);
+  for (int i = 0; i < 10000; ++i) {
+    pool.submit([&ran] { ran.fetch_add(1); });
+  }
+  pool.stop();
+  check(ran.load() == 10000, "tasks queued before stop() run");
+  check(pool.queueSize() == 0, "nothing left queued after stop()");
+}
+
+void submittedAfterStop() {
+  WorkStealingPool pool;
+  pool.setThreadNum(kWorkers);
+  pool.start();
+  pool.stop();
+  std::thread::id ranIn;
+  pool.submit([&ranIn] { ranIn = std::this_thread::get_id(); });
+  check(ranIn == std::this_thread::get_id(),
+        "a task submitted after stop() runs in the caller");
+  check(pool.queueSize() == 0, "it isn't left queued");
+}
+
+void submittedWhileStopping() {
+  for (int round = 0; round < 50; ++round) {
+    WorkStealingPool pool;
+    pool.setThreadNum(kWorkers);
+    pool.start();
+    std::atomic<bool> stopped(false);
+    std::atomic<int64_t> submitted(0);
+    std::atomic<int64_t> ran(0);
+    std::vector<std::thread> submitters;
+    for (int i = 0; i < kSubmitters; ++i) {
+      submitters.emplace_back([&] {
+        // a few submits after stop() returned too
+        for (int after = 0; after < 100;) {
+          if (stopped.load()) {
+            ++after;
+          }
+          submitted.fetch_add(1);
+          pool.submit([&ran] { ran.fetch_add(1); });
+        }
+      });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    pool.stop();
+    stopped = true;
+    for (std::thread &t : submitters) {
+      t.join();
+    }
+    if (ran.load() != submitted.load()) {
+      std::printf("round %d: %lld submitted, %lld ran\n", round,
+                  static_cast<long long>(submitted.load()),
+                  static_cast<long long>(ran.load()));
+      check(false, "tasks submitted while stop() runs all run");
+    }
+  }
+  check(true, "tasks submitted while stop() runs all run");
+}
+
+}  // namespace
+
+int main() {
+  ::setvbuf(stdout, NULL, _IOLBF, 0);
+  queuedBeforeStop();
+  submittedAfterStop();
+  submittedWhileStopping();
+  return 0;
+}
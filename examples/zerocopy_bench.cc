@@ -0,0 +1,157 @@
+// Server-to-client throughput of 4MB responses, copied into the kernel or
+// sent with MSG_ZEROCOPY.
+//
+// A reader asks for 16MB worth of responses at a time and keeps two such
+// requests outstanding. The server (one loop) answers the way the RPC codec
+// would: every response is built in a fresh Buffer and handed to
+// TcpConnection::send(Buffer*).
+// Prints the received throughput, the server CPU time per GB, and how many
+// zero-copy sends the kernel copied anyway (all of them over loopback).
+//
+// usage: zerocopy_bench [clients] [host] [port]
+// With a host, the readers connect there instead, e.g. to the address of a
+// real NIC of this machine, where MSG_ZEROCOPY can really skip the copy.
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "network/EventLoop.h"
+#include "network/InetAddress.h"
+#include "network/TcpServer.h"
+#include "network/util.h"
+
+using namespace network;
+
+namespace {
+
+const size_t kResponseSize = 4 * 1024 * 1024;
+const int kResponsesPerRequest = 4;
+const size_t kZeroCopyThreshold = 256 * 1024;
+const double kDuration = 3.0;
+
+std::atomic<int64_t> g_received(0);
+std::atomic<bool> g_stop(false);
+
+std::vector<char> g_payload(kResponseSize, 'x');
+
+void onRequest(const TcpConnectionPtr &conn, Buffer *buf) {
+  for (; buf->readableBytes() > 0; buf->retrieve(1)) {
+    for (int i = 0; i < kResponsesPerRequest; ++i) {
+      Buffer response(kResponseSize);
+      response.append(g_payload.data(), g_payload.size());
+      conn->send(&response);
+    }
+  }
+}
+
+void reader(const char *host, uint16_t port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  ::inet_pton(AF_INET, host, &addr.sin_addr);
+  if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                sizeof addr) < 0) {
+    perror("connect");
+    _exit(1);
+  }
+  // a byte per request
+  const int64_t requestBytes = kResponsesPerRequest * kResponseSize;
+  ::write(fd, "rr", 2);
+  int64_t received = 0;
+  std::vector<char> buf(256 * 1024);
+  while (!g_stop.load(std::memory_order_relaxed)) {
+    ssize_t n = ::read(fd, buf.data(), buf.size());
+    if (n <= 0) {
+      break;
+    }
+    if ((received + n) / requestBytes > received / requestBytes) {
+      ::write(fd, "r", 1);
+    }
+    received += n;
+    g_received.fetch_add(n, std::memory_order_relaxed);
+  }
+  ::close(fd);
+}
+
+void run(bool zeroCopy, int clients, const char *host, uint16_t port) {
+  EventLoop loop;
+  TcpServer server(&loop, InetAddress(port), "zerocopy_bench");
+  std::vector<TcpConnectionPtr> conns;
+  server.setConnectionCallback([&conns, zeroCopy](const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+      if (zeroCopy && !conn->setZeroCopyThreshold(kZeroCopyThreshold)) {
+        printf("SO_ZEROCOPY not supported\n");
+        _exit(1);
+      }
+      conns.push_back(conn);
+    }
+  });
+  server.setMessageCallback(onRequest);
+  server.start();
+
+  std::vector<std::thread> readers;
+  for (int i = 0; i < clients; ++i) {
+    readers.emplace_back(reader, host, port);
+  }
+  int64_t startNs = 0, startCpuNs = 0, startBytes = 0;
+  loop.runAfter(0.5, [&] {
+    startNs = getMonotonicNs();
+    startCpuNs = loop.metrics().cpuTimeNs;
+    startBytes = g_received.load();
+  });
+  loop.runAfter(0.5 + kDuration, [&] {
+    const double seconds = (getMonotonicNs() - startNs) / 1e9;
+    const double bytes = static_cast<double>(g_received.load() - startBytes);
+    const double cpuMs = (loop.metrics().cpuTimeNs - startCpuNs) / 1e6;
+    OutputQueue::ZeroCopyStats total = {0, 0, 0};
+    for (const TcpConnectionPtr &conn : conns) {
+      OutputQueue::ZeroCopyStats s = conn->outputQueue()->zeroCopyStats();
+      total.sends += s.sends;
+      total.completions += s.completions;
+      total.copied += s.copied;
+    }
+    printf("%-8s %10.1f MB/s %10.1f server CPU ms/GB, zero-copy sends %ld "
+           "completed %ld copied %ld\n",
+           zeroCopy ? "zerocopy" : "copy", bytes / seconds / (1024 * 1024),
+           bytes > 0 ? cpuMs / (bytes / (1024.0 * 1024 * 1024)) : 0.0,
+           static_cast<long>(total.sends), static_cast<long>(total.completions),
+           static_cast<long>(total.copied));
+    fflush(stdout);
+    g_stop = true;
+    loop.quit();
+  });
+  loop.loop();
+  // skip the teardown, the process exits
+  _exit(0);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  int clients = argc > 1 ? atoi(argv[1]) : 2;
+  const char *host = argc > 2 ? argv[2] : "127.0.0.1";
+  uint16_t port = static_cast<uint16_t>(argc > 3 ? atoi(argv[3]) : 9989);
+
+  printf("%d readers of %zu bytes responses from %s\n", clients,
+         kResponseSize, host);
+  fflush(stdout);
+  for (bool zeroCopy : {false, true}) {
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      run(zeroCopy, clients, host, port);
+    }
+    ::waitpid(pid, NULL, 0);
+    ++port;
+  }
+}
@@ -1,23 +1,40 @@
 #pragma once
 
+#include <stdint.h>
+
+#include <atomic>
 #include <functional>
 
 #include "network/Channel.h"
 #include "network/Socket.h"
+#include "network/TimerId.h"
 
 namespace network {
 
 class EventLoop;
 class InetAddress;
 
+/// Acceptor counters, see Acceptor::stats().
+struct AcceptStats {
+  int64_t accepted;  // handed to the NewConnectionCallback
+  int64_t deferred;  // times accepting paused with the bucket empty
+  int64_t dropped;   // closed right after accept, over rate or EMFILE
+};
+
 ///
 /// Acceptor of incoming TCP connections.
 ///
+/// Accepts up to maxAcceptsPerEvent connections per readiness event, and
+/// optionally no more than a token bucket allows. Connections over the rate
+/// are left in the kernel backlog (deferred, reading is paused until a token
+/// is available) or accepted and closed at once (dropped).
 class Acceptor {
  public:
   typedef std::function<void(int sockfd, const InetAddress &)>
       NewConnectionCallback;
 
+  static const int kDefaultMaxAcceptsPerEvent = 64;
+
   Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
   ~Acceptor();
   
@@ -26,16 +43,52 @@ class Acceptor {
     newConnectionCallback_ = cb;
   }
 
+  /// Must be called before listen(), SOMAXCONN by default.
+  void setBacklog(int backlog) { backlog_ = backlog; }
+  /// Bounds the work of one readiness event, at least 1.
+  void setMaxAcceptsPerEvent(int n) { maxAcceptsPerEvent_ = n > 0 ? n : 1; }
+  ///
+  /// Accepts at most @c ratePerSecond connections per second on average,
+  /// with bursts of up to @c burst. 0 disables the limit (the default).
+  /// With @c dropExcess, connections over the rate are accepted and closed,
+  /// clients fail fast instead of waiting in the backlog.
+  /// Not thread safe, but in loop.
+  void setRateLimit(double ratePerSecond, double burst, bool dropExcess);
+
+  /// Safe to call from other threads.
+  AcceptStats stats() const;
+
   void listen();
 
+  /// Steers each SYN to the listening socket of index (current CPU %
+  /// @c numSockets) in the SO_REUSEPORT group, with a classic BPF program.
+  /// Sockets are indexed in the order they started listening.
+  /// return true if success.
+  bool attachCpuSteering(int numSockets);
+
   bool listening() const { return listening_; }
 
+  /// The bound address, with the actual port if bound to port 0.
+  InetAddress localAddress() const;
+
   // Deprecated, use the correct spelling one above.
   // Leave the wrong spelling here in case one needs to grep it for error
   // messages. bool listenning() const { return listening(); }
 
  private:
   void handleRead();
+  // token bucket, true if a connection may be accepted now
+  bool takeToken(int64_t nowUs);
+  void pauseAccepting();
+  void resumeAccepting();
+  // accept and close, to shed load or to free the idle fd trick, false
+  // if there was nothing to accept
+  bool dropOne();
+
+  static void addRelaxed(std::atomic<int64_t> &counter, int64_t delta) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta,
+                  std::memory_order_relaxed);
+  }
 
   EventLoop *loop_;
   Socket acceptSocket_;
@@ -43,6 +96,21 @@ class Acceptor {
   NewConnectionCallback newConnectionCallback_;
   bool listening_;
   int idleFd_;   // 备用的文件描述符，用于处理文件描述符耗尽的情况
+  int backlog_;
+  int maxAcceptsPerEvent_;
+
+  // 令牌桶限速
+  double ratePerUs_;  // 0 means unlimited
+  double burst_;
+  bool dropExcess_;
+  double tokens_;
+  int64_t lastRefillUs_;
+  bool paused_;
+  TimerId resumeTimer_;
+
+  std::atomic<int64_t> accepted_;
+  std::atomic<int64_t> deferred_;
+  std::atomic<int64_t> dropped_;
 };
 
 }  // namespace network
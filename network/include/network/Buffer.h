@@ -13,6 +13,11 @@
 namespace network {
 
 /// A buffer class modeled after org.jboss.netty.buffer.ChannelBuffer
+///
+/// The storage comes from BufferPool, the pool of the current EventLoop
+/// thread if any. It is taken on the first write, and given back by
+/// releaseIfEmpty() or the dtor, a Buffer with nothing in it costs no
+/// memory.
 /// 缓冲区的数据流动模型
 /// @code
 /// +-------------------+------------------+------------------+
@@ -25,23 +30,53 @@ namespace network {
 class Buffer {
  public:
   static const size_t kCheapPrepend = 8;         // 预留的头部空间大小
-  static const size_t kInitialSize = 1024 * 4;   // 缓冲区的初始大小
+  // 缓冲区的初始大小, with the prepend a 4KB block of the pool
+  static const size_t kInitialSize = 1024 * 4 - kCheapPrepend;
 
+  /// Storage of at least @c initialSize writable bytes is taken on the
+  /// first write.
   explicit Buffer(size_t initialSize = kInitialSize)
-      : buffer_(kCheapPrepend + initialSize),
+      : data_(NULL),
+        capacity_(0),
+        initialSize_(initialSize),
         readerIndex_(kCheapPrepend),
         writerIndex_(kCheapPrepend) {
     assert(readableBytes() == 0);
-    assert(writableBytes() == initialSize);
     assert(prependableBytes() == kCheapPrepend);
   }
 
-  // implicit copy-ctor, move-ctor, dtor and assignment are fine
-  // NOTE: implicit move-ctor is added in g++ 4.6
+  Buffer(const Buffer &rhs);
+  Buffer(Buffer &&rhs) noexcept
+      : data_(rhs.data_),
+        capacity_(rhs.capacity_),
+        initialSize_(rhs.initialSize_),
+        readerIndex_(rhs.readerIndex_),
+        writerIndex_(rhs.writerIndex_) {
+    rhs.data_ = NULL;
+    rhs.capacity_ = 0;
+    rhs.readerIndex_ = kCheapPrepend;
+    rhs.writerIndex_ = kCheapPrepend;
+  }
+  Buffer &operator=(Buffer rhs) {
+    swap(rhs);
+    return *this;
+  }
+  ~Buffer() { releaseStorage(); }
+
+  void swap(Buffer &rhs) {
+    std::swap(data_, rhs.data_);
+    std::swap(capacity_, rhs.capacity_);
+    std::swap(initialSize_, rhs.initialSize_);
+    std::swap(readerIndex_, rhs.readerIndex_);
+    std::swap(writerIndex_, rhs.writerIndex_);
+  }
 
   size_t readableBytes() const { return writerIndex_ - readerIndex_; }
 
-  size_t writableBytes() const { return buffer_.size() - writerIndex_; }
+  /// 0 until the storage is taken, see ensureWritableBytes().
+  size_t writableBytes() const {
+    return data_ ? capacity_ - writerIndex_ : 0;
+  }
 
   size_t prependableBytes() const { return readerIndex_; }
   //begin() + readerIndex_;
@@ -231,12 +266,23 @@ class Buffer {
   //读空间头部插入
   void prepend(const void * /*restrict*/ data, size_t len) {
     assert(len <= prependableBytes());
+    if (data_ == NULL) {
+      allocate(kCheapPrepend + initialSize_);
+    }
     readerIndex_ -= len;
     const char *d = static_cast<const char *>(data);
     std::copy(d, d + len, begin() + readerIndex_);
   }
 
-  size_t internalCapacity() const { return buffer_.capacity(); }
+  size_t internalCapacity() const { return capacity_; }
+
+  /// Gives the storage back to the pool if nothing is readable, e.g. once
+  /// a connection has consumed its input.
+  void releaseIfEmpty() {
+    if (data_ && readableBytes() == 0) {
+      releaseStorage();
+    }
+  }
 
   /// Read data directly into buffer.
   ///
@@ -246,29 +292,26 @@ class Buffer {
   ssize_t readFd(int fd, int *savedErrno);
 
  private:
-  char *begin() { return &*buffer_.begin(); }
+  // an empty buffer without storage peeks at an empty static array
+  char *begin() { return data_ ? data_ : emptyStorage(); }
 
-  const char *begin() const { return &*buffer_.begin(); }
-  // 申请新空间 len
-  void makeSpace(size_t len) {
-    if (writableBytes() + prependableBytes() < len + kCheapPrepend) {
-      // FIXME: move readable data
-      buffer_.resize(writerIndex_ + len);
-    } else {
-      // move readable data to the front, make space inside buffer
-      // 预留空间和read之间有空间时
-      assert(kCheapPrepend < readerIndex_);
-      size_t readable = readableBytes();
-      std::copy(begin() + readerIndex_, begin() + writerIndex_,
-                begin() + kCheapPrepend);
-      readerIndex_ = kCheapPrepend;
-      writerIndex_ = readerIndex_ + readable;
-      assert(readable == readableBytes());
-    }
+  const char *begin() const { return data_ ? data_ : emptyStorage(); }
+
+  static char *emptyStorage() {
+    static char storage[kCheapPrepend];
+    return storage;
   }
 
+  // takes a block of at least @c size bytes, there must be none
+  void allocate(size_t size);
+  void releaseStorage();
+  // 申请新空间 len
+  void makeSpace(size_t len);
+
  private:
-  std::vector<char> buffer_;
+  char *data_;        // from BufferPool, NULL until the first write
+  size_t capacity_;
+  size_t initialSize_;
   size_t readerIndex_;
   size_t writerIndex_;
 
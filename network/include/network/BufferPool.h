@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+namespace network {
+
+///
+/// Per-EventLoop cache of Buffer storage, in power of two size classes
+/// from kMinBlockSize to kMaxBlockSize.
+///
+/// Blocks come from malloc (posix_memalign for huge pages) and can always
+/// be given back with free(), so a block may be freed into whichever pool
+/// is current on the freeing thread, or to malloc if there is none. Bigger
+/// blocks bypass the pool.
+///
+/// Freed blocks are kept for reuse, trim() returns those that stayed
+/// unused since the previous trim(). The EventLoop trims its pool every
+/// kTrimIntervalSec seconds.
+///
+/// Not thread safe, but in loop. stats() is thread safe.
+/// 按 2 的幂分级缓存 Buffer 内存，每个 EventLoop 一个
+class BufferPool {
+ public:
+  static const size_t kMinBlockSize = 1024;
+  static const size_t kMaxBlockSize = 4 * 1024 * 1024;
+  static const int kNumClasses = 13;  // 1KB .. 4MB
+  static const size_t kHugePageSize = 2 * 1024 * 1024;
+  static const int kTrimIntervalSec = 5;
+
+  /// Counters, safe to read from other threads.
+  struct Stats {
+    int64_t cachedBlocks;  // free blocks kept for reuse
+    int64_t cachedBytes;
+    int64_t hits;          // allocations served from the cache
+    int64_t misses;        // allocations that went to malloc
+    int64_t trimmedBytes;  // given back to malloc by trim() or the cap
+  };
+
+  BufferPool();
+  ~BufferPool();
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  /// Size of the block allocate(@c size) returns, a size class or @c size
+  /// itself above kMaxBlockSize.
+  static size_t blockSize(size_t size);
+
+  /// A block of blockSize(@c size) bytes, from the pool of the current
+  /// thread if any.
+  static char *allocate(size_t size);
+  /// @c size as passed to allocate().
+  static void deallocate(char *block, size_t size);
+
+  /// The pool of the current thread, set by its EventLoop, may be NULL.
+  static BufferPool *current();
+  static void setCurrent(BufferPool *pool);
+
+  /// Backs blocks of kHugePageSize and more with transparent huge pages.
+  /// Blocks already cached are unaffected.
+  void setHugePages(bool on) { hugePages_ = on; }
+  /// Upper bound of the bytes kept for reuse, 64MB by default.
+  void setMaxCachedBytes(size_t bytes) { maxCachedBytes_ = bytes; }
+
+  /// Frees the blocks no allocation needed since the last trim().
+  void trim();
+  /// Frees every cached block.
+  void clear();
+
+  Stats stats() const;
+
+ private:
+  struct SizeClass {
+    std::vector<char *> blocks;
+    size_t lowWater = 0;  // fewest cached blocks since the last trim
+  };
+
+  static int classIndex(size_t size);
+  char *get(size_t size);
+  void put(char *block, size_t size);
+  char *newBlock(size_t size);
+  void release(SizeClass *sc, size_t count, size_t size);
+
+  // written in loop only
+  static void addRelaxed(std::atomic<int64_t> &counter, int64_t delta) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta,
+                  std::memory_order_relaxed);
+  }
+
+  SizeClass classes_[kNumClasses];
+  bool hugePages_;
+  size_t maxCachedBytes_;
+  std::atomic<int64_t> cachedBlocks_;
+  std::atomic<int64_t> cachedBytes_;
+  std::atomic<int64_t> hits_;
+  std::atomic<int64_t> misses_;
+  std::atomic<int64_t> trimmedBytes_;
+};
+
+}  // namespace network
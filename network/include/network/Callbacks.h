@@ -32,6 +32,8 @@ typedef std::function<void(const TcpConnectionPtr &)> CloseCallback;
 typedef std::function<void(const TcpConnectionPtr &)> WriteCompleteCallback;
 typedef std::function<void(const TcpConnectionPtr &, size_t)>
     HighWaterMarkCallback;  // 当发送缓冲区达到预设的高水位标记时触发
+typedef std::function<void(const TcpConnectionPtr &, size_t)>
+    LowWaterMarkCallback;  // 达到高水位后发送缓冲区回落到低水位时触发
 
 // the data has been read to (buf, len)
 typedef std::function<void(const TcpConnectionPtr &, Buffer *)> MessageCallback;
@@ -39,6 +39,14 @@ class Channel {
 
   int fd() const { return fd_; }
   int events() const { return events_; }
+  // used by pollers, the interest set actually registered
+  int pollEvents() const {
+    if (!edgeTriggered_ || isNoneEvent()) {
+      return events_;
+    }
+    // EPOLLOUT stays registered, so enable/disableWriting needs no epoll_ctl
+    return events_ | EventType::WriteEvent | static_cast<int>(EPOLLET);
+  }
   // used by pollers
   void set_revents(int revt) { revents_ = revt; }
   // int revents() const { return revents_; }
@@ -67,6 +75,20 @@ class Channel {
   bool isWriting() const { return events_ & EventType::WriteEvent; }
   bool isReading() const { return events_ & EventType::ReadEvent; }
 
+  /// Registers with EPOLLET, must be called before enabling any event.
+  /// The owner has to read/write until EAGAIN.
+  /// Ignored unless the loop polls with epoll.
+  void setEdgeTriggered(bool on);
+  bool edgeTriggered() const { return edgeTriggered_; }
+
+  /// Completion based reads and writes through the poller instead of
+  /// readiness (EventLoop::readChannel() and writeChannel()), must be called
+  /// before enabling any event. Reading means a receive is in flight, the
+  /// read callback runs once it completed; the write callback runs when a
+  /// write completed. Ignored unless the poller supports it (io_uring).
+  void setAsyncIo(bool on);
+  bool asyncIo() const { return asyncIo_; }
+
   // for Poller
   int index() { return index_; }
   void set_index(int idx) { index_ = idx; }
@@ -86,6 +108,9 @@ class Channel {
   int events_;
   int revents_;  // it's the received event types of epoll or poll
   int index_;    // 注册顺序或位置 used by Poller.
+  int registeredEvents_;  // last pollEvents() passed to Poller
+  bool edgeTriggered_;
+  bool asyncIo_;
 
   std::weak_ptr<void> tie_;
   std::atomic<bool> event_handling_;
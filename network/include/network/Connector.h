@@ -5,12 +5,13 @@
 #include <memory>
 
 #include "network/InetAddress.h"
+#include "network/TimerId.h"
 namespace network {
 
 class Channel;
 class EventLoop;
 
-class Connector {
+class Connector : public std::enable_shared_from_this<Connector> {
  public:
   typedef std::function<void(int sockfd)> NewConnectionCallback;
 
@@ -50,6 +51,7 @@ class Connector {
   std::unique_ptr<Channel> channel_;
   NewConnectionCallback newConnectionCallback_;
   int retryDelayMs_;
+  TimerId retryTimer_;  // 重连定时器
 };
 
 }  // namespace network
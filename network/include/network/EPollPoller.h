@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+#include "network/Poller.h"
+
+struct epoll_event;
+namespace network {
+class Channel;
+///
+/// IO Multiplexing with epoll(4).
+///
+/// I/O 事件的分发器
+class EPollPoller : public Poller {
+ public:
+  EPollPoller(EventLoop *loop);
+  ~EPollPoller() override;
+
+  void poll(int timeoutMs, ChannelList *activeChannels) override;
+  void updateChannel(Channel *channel) override;
+  void removeChannel(Channel *channel) override;
+
+ private:
+  static const int kInitEventListSize = 16;
+
+  static const char *operationToString(int op);
+
+  void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
+  void update(int operation, Channel *channel);
+
+  typedef std::vector<struct epoll_event> EventList;
+
+  int epollfd_;
+  EventList events_;   // 存储 epoll 触发的事件，用于在 epoll_wait 调用后处理发生的事件
+};
+
+}  // namespace network
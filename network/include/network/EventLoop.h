@@ -1,20 +1,29 @@
 #pragma once
 
+#include <pthread.h>
 #include <sys/syscall.h>
+#include <sys/types.h>
+#include <time.h>
 
 #include <atomic>
 #include <functional>
-#include <mutex>
+#include <memory>
 #include <vector>
 
 #include <boost/any.hpp>
 
 #include "network/Callbacks.h"
+#include "network/MpscQueue.h"
+#include "network/TimerId.h"
 #include "network/util.h"
 namespace network {
 
+class Buffer;
+class BufferPool;
 class Channel;
+class OutputQueue;
 class Poller;
+class TimerQueue;
 
 ///
 /// Reactor, at most one per thread.
@@ -25,7 +34,27 @@ class EventLoop {
  public:
   typedef std::function<void()> Functor;
 
-  EventLoop();
+  /// I/O multiplexing backend.
+  enum PollerType {
+    kDefaultPoller,  // epoll, or io_uring if NETWORK_USE_IO_URING is set
+    kEpollPoller,
+    kIoUringPoller,  // falls back to epoll if the kernel lacks support
+  };
+
+  /// Snapshot of the loop's runtime counters, see metrics().
+  struct Metrics {
+    int64_t iterations;             // poll calls
+    int64_t events;                 // channels returned by poll, in total
+    int64_t maxEventsPerPoll;
+    int64_t pollTimeNs;             // blocked or spinning in poll
+    int64_t handleEventTimeNs;      // in Channel::handleEvent
+    int64_t pendingFunctorsTimeNs;  // in doPendingFunctors
+    int64_t functors;               // queued functors run
+    int64_t queueHighWater;         // deepest functor queue seen by the loop
+    int64_t cpuTimeNs;              // CPU time of the loop thread, -1 if gone
+  };
+
+  explicit EventLoop(PollerType pollerType = kDefaultPoller);
   ~EventLoop();  // force out-line dtor, for std::unique_ptr members.
 
   ///
@@ -41,7 +70,47 @@ class EventLoop {
   /// better to call through shared_ptr<EventLoop> for 100% safety.
   void quit();
 
-  int64_t iteration() const { return iteration_; }
+  int64_t iteration() const {
+    return iteration_.load(std::memory_order_relaxed);
+  }
+
+  ///
+  /// Busy polling, trades a core for latency.
+  ///
+  /// After the last event or task the loop keeps polling with a zero timeout
+  /// for @c windowUs microseconds before it blocks again, so a request coming
+  /// in meanwhile skips the sleep/wakeup. Connections created for this loop
+  /// get SO_BUSY_POLL too. 0 (the default) disables it.
+  /// Safe to call from other threads, takes effect on the next iteration.
+  void setBusyPollUs(int64_t windowUs) {
+    busyPollUs_.store(windowUs, std::memory_order_relaxed);
+  }
+  int64_t busyPollUs() const {
+    return busyPollUs_.load(std::memory_order_relaxed);
+  }
+  /// Microseconds spent polling without blocking, in busy poll mode.
+  int64_t spinTimeUs() const {
+    return spinTimeUs_.load(std::memory_order_relaxed);
+  }
+  /// Microseconds spent blocked in poll, in busy poll mode.
+  int64_t sleepTimeUs() const {
+    return sleepTimeUs_.load(std::memory_order_relaxed);
+  }
+
+  ///
+  /// Runtime counters, to see where a saturated loop spends its time.
+  /// Events per poll is events / iterations.
+  /// Safe to call from other threads while the loop is alive. Counters are
+  /// read one by one, a snapshot may straddle an iteration.
+  Metrics metrics() const;
+
+  /// Storage of the Buffers used in this loop's thread, e.g. for its
+  /// stats() or setHugePages(). Idle storage is trimmed every
+  /// BufferPool::kTrimIntervalSec seconds.
+  BufferPool *bufferPool() const { return bufferPool_.get(); }
+
+  /// The backend in use, after fallback.
+  PollerType pollerType() const;
 
   /// Runs callback immediately in the loop thread.
   /// It wakes up the loop, and run the cb.
@@ -50,16 +119,54 @@ class EventLoop {
   void runInLoop(Functor cb);
   /// Queues callback in the loop thread.
   /// Runs after finish pooling.
-  /// Safe to call from other threads.
+  /// Safe to call from other threads, lock free.
+  /// The loop is only woken up if it's blocked in poll.
   void queueInLoop(Functor cb);
 
   size_t queueSize() const;
 
+  /// Live TcpConnections owned by this loop. Thread safe.
+  int numConnections() const {
+    return numConnections_.load(std::memory_order_relaxed);
+  }
+
+  // timers
+
+  ///
+  /// Runs callback at 'time' (milliseconds since epoch, as getNowMs()).
+  /// Safe to call from other threads.
+  ///
+  TimerId runAt(int64_t timeMs, TimerCallback cb);
+  ///
+  /// Runs callback after @c delay seconds.
+  /// Safe to call from other threads.
+  ///
+  TimerId runAfter(double delay, TimerCallback cb);
+  ///
+  /// Runs callback every @c interval seconds.
+  /// Safe to call from other threads.
+  ///
+  TimerId runEvery(double interval, TimerCallback cb);
+  ///
+  /// Cancels the timer.
+  /// Safe to call from other threads.
+  ///
+  void cancel(TimerId timerId);
+
   // internal usage
   void wakeup();
   void updateChannel(Channel *channel);
   void removeChannel(Channel *channel);
   bool hasChannel(Channel *channel);
+  // completion based socket I/O, see Poller
+  bool supportsAsyncIo() const;
+  ssize_t readChannel(Channel *channel, Buffer *buf, int *savedErrno);
+  void writeChannel(Channel *channel, const OutputQueue &output);
+  bool channelWriting(Channel *channel) const;
+  ssize_t takeWrite(Channel *channel, int *savedErrno);
+  void addConnections(int delta) {
+    numConnections_.fetch_add(delta, std::memory_order_relaxed);
+  }
 
   // pid_t threadId() const { return threadId_; }
   void assertInLoopThread() {
@@ -83,20 +190,38 @@ class EventLoop {
  private:
   void abortNotInLoopThread();
   void handleRead();  // waked up
+  void pollBlocking();
+  // polls without blocking within the busy poll window
+  void pollBusy(int64_t busyPollUs);
   //执行排队回调
   void doPendingFunctors();
 
   void printActiveChannels() const;  // DEBUG
 
+  // written by the loop thread only, no read-modify-write needed
+  static void addRelaxed(std::atomic<int64_t> &counter, int64_t delta) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta,
+                  std::memory_order_relaxed);
+  }
+
   typedef std::vector<Channel *> ChannelList;
 
+  // 跨线程任务节点
+  struct Task : MpscNode {
+    explicit Task(Functor f) : functor(std::move(f)) {}
+    Functor functor;
+  };
+
   bool looping_; /* atomic */
   std::atomic<bool> quit_;
   bool eventHandling_;          /* atomic */
   bool callingPendingFunctors_; /* atomic */
-  int64_t iteration_;           /* 记录事件循环的迭代次数 */
+  std::atomic<int64_t> iteration_;  /* 记录事件循环的迭代次数 */
   pid_t threadId_;              /* 事件循环线程 id */
+  // before anything that may hold a Buffer, destroyed after them
+  std::unique_ptr<BufferPool> bufferPool_;
   std::unique_ptr<Poller> poller_;
+  std::unique_ptr<TimerQueue> timerQueue_;  /* 定时器队列 */
   int wakeupFd_;                /* 唤醒事件循环fd */
   // unlike in TimerQueue, which is an internal class,
   // we don't expose Channel to client.
@@ -107,8 +232,30 @@ class EventLoop {
   ChannelList activeChannels_;
   Channel *currentActiveChannel_;
 
-  mutable std::mutex mutex_;
-  std::vector<Functor> pendingFunctors_;
+  std::atomic<bool> sleeping_;  // blocked (or about to block) in poll
+  std::atomic<size_t> pendingCount_;
+  std::atomic<int> numConnections_;
+  MpscQueue pendingFunctors_;
+
+  std::atomic<int64_t> busyPollUs_;  // 忙轮询窗口，0 表示关闭
+  std::atomic<int64_t> spinTimeUs_;
+  std::atomic<int64_t> sleepTimeUs_;
+  int64_t lastActiveUs_;  // 最近一次有事件或任务的时间
+  int64_t lastTrimNs_;    // 上次归还空闲 Buffer 内存的时间
+
+  clockid_t cpuClockId_;  // loop 线程的 CPU 时钟
+  // written by the loop thread only, on their own cache lines so that the
+  // producers of queueInLoop() and the readers of metrics() don't disturb it
+  struct alignas(64) Counters {
+    std::atomic<int64_t> events{0};
+    std::atomic<int64_t> maxEventsPerPoll{0};
+    std::atomic<int64_t> pollTimeNs{0};
+    std::atomic<int64_t> handleEventTimeNs{0};
+    std::atomic<int64_t> pendingFunctorsTimeNs{0};
+    std::atomic<int64_t> functors{0};
+    std::atomic<int64_t> queueHighWater{0};
+  };
+  Counters counters_;
 };
 
 }  // namespace network
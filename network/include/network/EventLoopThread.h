@@ -7,16 +7,17 @@
 #include <mutex>
 #include <thread>
 
-namespace network {
+#include "network/EventLoop.h"
 
-class EventLoop;
+namespace network {
 
 class EventLoopThread {
  public:
   typedef std::function<void(EventLoop *)> ThreadInitCallback;
 
   EventLoopThread(const ThreadInitCallback &cb = ThreadInitCallback(),
-                  const std::string &name = std::string());
+                  const std::string &name = std::string(),
+                  EventLoop::PollerType pollerType = EventLoop::kDefaultPoller);
   ~EventLoopThread();
   EventLoop *startLoop();
 
@@ -29,6 +30,7 @@ class EventLoopThread {
   std::mutex mutex_;
   std::condition_variable cv_;
   ThreadInitCallback callback_;
+  EventLoop::PollerType pollerType_;
 };
 
 }  // namespace network
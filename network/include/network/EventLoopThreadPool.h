@@ -2,12 +2,16 @@
 
 #include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 
+#include "network/EventLoop.h"
+#include "network/LoopPlacement.h"
+
 namespace network {
 
-class EventLoop;
 class EventLoopThread;
+class InetAddress;
 
 class EventLoopThreadPool {
  public:
@@ -16,15 +20,33 @@ class EventLoopThreadPool {
   EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg);
   ~EventLoopThreadPool();
   void setThreadNum(int numThreads) { numThreads_ = numThreads; }
+  /// Backend of the loops created by start(), the base loop is untouched.
+  void setPollerType(EventLoop::PollerType type) { pollerType_ = type; }
+  /// Busy poll window of the loops created by start(), see
+  /// EventLoop::setBusyPollUs. Use a dedicated pool for the hot services,
+  /// or set it per loop from getAllLoops().
+  void setBusyPollUs(int64_t windowUs) { busyPollUs_ = windowUs; }
+  /// How getLoopFor() picks a loop, round-robin by default.
+  void setPlacementPolicy(std::unique_ptr<LoopPlacementPolicy> policy) {
+    policy_ = std::move(policy);
+  }
   void start(const ThreadInitCallback &cb = ThreadInitCallback());
 
   // valid after calling start()
   /// round-robin
   EventLoop *getNextLoop();
 
+  /// the loop for a new connection from @c peerAddr, by the placement policy
+  EventLoop *getLoopFor(const InetAddress &peerAddr);
+
   /// with the same hash code, it will always return the same EventLoop
   EventLoop *getLoopForHash(size_t hashCode);
+  /// The loop of @c loops (not empty) getLoopForHash() picks for
+  /// @c hashCode, e.g. for a placement policy.
+  static EventLoop *getLoopForHash(const std::vector<EventLoop *> &loops,
+                                   size_t hashCode);
 
+  /// Thread safe after start(), e.g. to snapshot EventLoop::metrics().
   std::vector<EventLoop *> getAllLoops();
 
   bool started() const { return started_; }
@@ -37,8 +59,11 @@ class EventLoopThreadPool {
   bool started_ = false;
   int numThreads_;     // 线程池中的线程数量,每个线程将运行一个 EventLoop 对象
   int next_;    // 记录当前正在选择的下一个 EventLoop，实现轮询调度策略。
+  EventLoop::PollerType pollerType_;
+  int64_t busyPollUs_;
   std::vector<std::unique_ptr<EventLoopThread>> threads_;
   std::vector<EventLoop *> loops_;  // 线程池中所有 EventLoop 对象的指针数组
+  std::unique_ptr<LoopPlacementPolicy> policy_;
 };
 
 }  // namespace network
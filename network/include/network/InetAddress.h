@@ -33,6 +33,8 @@ class InetAddress {
   std::string toIp() const;
   std::string toIpPort() const;
   uint16_t port() const;
+  /// 127.0.0.0/8, ::1 or ::ffff:127.0.0.0/104
+  bool isLoopback() const;
 
   // default copy/assignment are Okay
 
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+
+#include <glog/logging.h>
+
+///
+/// Trace/debug logging for the hot paths of network and rpc_framework.
+///
+///   LOG_TRACE << "fd = " << fd;   // per event / per interest change
+///   LOG_DEBUG << "ctor " << this; // per connection / per channel
+///
+/// A statement below NETWORK_MIN_LOG_LEVEL is compiled out, its operands are
+/// never evaluated. Above it, the cost of a disabled statement is one relaxed
+/// load and a branch, nothing is formatted. Enabled statements go to glog at
+/// INFO severity. Anything else keeps using LOG(INFO/WARNING/ERROR).
+/// 热路径日志，编译期按级别裁剪，运行期开销只有一次比较
+
+#define NETWORK_LOG_LEVEL_TRACE 0
+#define NETWORK_LOG_LEVEL_DEBUG 1
+#define NETWORK_LOG_LEVEL_OFF 2
+
+// -DNETWORK_MIN_LOG_LEVEL=NETWORK_LOG_LEVEL_OFF strips them all
+#ifndef NETWORK_MIN_LOG_LEVEL
+#ifdef NDEBUG
+#define NETWORK_MIN_LOG_LEVEL NETWORK_LOG_LEVEL_DEBUG
+#else
+#define NETWORK_MIN_LOG_LEVEL NETWORK_LOG_LEVEL_TRACE
+#endif
+#endif
+
+namespace network {
+
+enum LogLevel {
+  kLogTrace = NETWORK_LOG_LEVEL_TRACE,
+  kLogDebug = NETWORK_LOG_LEVEL_DEBUG,
+  kLogOff = NETWORK_LOG_LEVEL_OFF,
+};
+
+namespace detail {
+// initialized from NETWORK_LOG_TRACE / NETWORK_LOG_DEBUG environment variables
+extern std::atomic<int> g_logLevel;
+}  // namespace detail
+
+/// Thread safe. Default is kLogOff, unless set by the environment.
+inline void setLogLevel(LogLevel level) {
+  detail::g_logLevel.store(level, std::memory_order_relaxed);
+}
+
+inline LogLevel logLevel() {
+  return static_cast<LogLevel>(
+      detail::g_logLevel.load(std::memory_order_relaxed));
+}
+
+inline bool logEnabled(LogLevel level) {
+  return level >= detail::g_logLevel.load(std::memory_order_relaxed);
+}
+
+}  // namespace network
+
+#define NETWORK_LOG_AT(level)                                        \
+  if (NETWORK_MIN_LOG_LEVEL > (level) || !::network::logEnabled(level)) \
+    ;                                                                \
+  else                                                               \
+    LOG(INFO)
+
+#define LOG_TRACE NETWORK_LOG_AT(::network::kLogTrace)
+#define LOG_DEBUG NETWORK_LOG_AT(::network::kLogDebug)
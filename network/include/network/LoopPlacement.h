@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+namespace network {
+
+class EventLoop;
+class InetAddress;
+
+///
+/// Picks the I/O loop of a new connection, see
+/// EventLoopThreadPool::setPlacementPolicy.
+///
+/// select() is called in the base loop thread with the pool's loops
+/// (never empty), it may read their counters from there.
+/// 新连接分配到哪个 EventLoop 的策略
+class LoopPlacementPolicy {
+ public:
+  virtual ~LoopPlacementPolicy();
+
+  virtual EventLoop *select(const std::vector<EventLoop *> &loops,
+                            const InetAddress &peerAddr) = 0;
+
+  /// The default, same as EventLoopThreadPool::getNextLoop().
+  static std::unique_ptr<LoopPlacementPolicy> newRoundRobin();
+  /// Fewest live TcpConnections, see EventLoop::numConnections().
+  static std::unique_ptr<LoopPlacementPolicy> newLeastConnections();
+  /// Least recent busy time plus queued functors, see
+  /// LeastPendingWorkPolicy.
+  static std::unique_ptr<LoopPlacementPolicy> newLeastPendingWork();
+  /// Same peer IP, same loop, see EventLoopThreadPool::getLoopForHash.
+  static std::unique_ptr<LoopPlacementPolicy> newPeerHash();
+};
+
+///
+/// Estimates the load of each loop from EventLoop::metrics():
+/// the share of the last @c sampleIntervalMs the loop spent in handleEvent
+/// and doPendingFunctors, plus the queued functors at their average cost.
+///
+/// Loads are sampled at most once per interval, the connections placed in
+/// between add their loop's average per-connection load, so a burst of
+/// accepts doesn't land on the same loop.
+class LeastPendingWorkPolicy : public LoopPlacementPolicy {
+ public:
+  explicit LeastPendingWorkPolicy(int64_t sampleIntervalMs = 100);
+
+  EventLoop *select(const std::vector<EventLoop *> &loops,
+                    const InetAddress &peerAddr) override;
+
+ private:
+  struct Sample {
+    int64_t busyNs;  // handleEvent + doPendingFunctors time at last sample
+    double load;     // estimated share of the loop thread in use
+    double perConnection;
+  };
+
+  void resample(const std::vector<EventLoop *> &loops, int64_t nowNs);
+
+  const int64_t sampleIntervalNs_;
+  int64_t lastSampleNs_;
+  std::vector<Sample> samples_;  // parallel to loops
+};
+
+}  // namespace network
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+
+namespace network {
+
+///
+/// Node of MpscQueue, embed it in the element type.
+///
+struct MpscNode {
+  MpscNode() : next(nullptr) {}
+
+  std::atomic<MpscNode *> next;
+};
+
+///
+/// Intrusive lock-free multi-producer single-consumer queue.
+///
+/// Dmitry Vyukov's node based queue: push() is wait-free (one exchange),
+/// pop() is lock-free and must only be called from the consumer thread.
+/// The queue doesn't own the nodes.
+/// 无锁多生产者单消费者队列，EventLoop 用它传递跨线程任务
+class MpscQueue {
+ public:
+  MpscQueue() : head_(&stub_), tail_(&stub_) {}
+
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  /// Thread safe.
+  void push(MpscNode *node) {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    MpscNode *prev = head_.exchange(node);
+    // the queue is inconsistent until the next line, pop() returns nullptr
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  /// Consumer only.
+  /// Returns nullptr if empty, or if a producer is in the middle of push().
+  MpscNode *pop() {
+    MpscNode *tail = tail_;
+    MpscNode *next = tail->next.load(std::memory_order_acquire);
+    if (tail == &stub_) {
+      if (next == nullptr) {
+        return nullptr;
+      }
+      tail_ = next;
+      tail = next;
+      next = next->next.load(std::memory_order_acquire);
+    }
+    if (next) {
+      tail_ = next;
+      return tail;
+    }
+    if (tail != head_.load()) {
+      return nullptr;
+    }
+    push(&stub_);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next) {
+      tail_ = next;
+      return tail;
+    }
+    return nullptr;
+  }
+
+  /// Consumer only.
+  /// The last node pushed, pop() up to it to drain a snapshot of the queue.
+  MpscNode *back() const { return head_.load(); }
+
+  /// Consumer only, sequentially consistent with push().
+  bool empty() const {
+    return tail_ == &stub_ && head_.load() == &stub_;
+  }
+
+ private:
+  std::atomic<MpscNode *> head_;  // producers push here
+  char pad_[64 - sizeof(std::atomic<MpscNode *>)];  // keep tail_ off the line
+  MpscNode *tail_;                                  // consumer pops here
+  MpscNode stub_;
+};
+
+}  // namespace network
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "network/Slice.h"
+
+struct iovec;
+
+namespace network {
+
+///
+/// Output queue of a TcpConnection, a chain of segments flushed with
+/// writev(2).
+///
+/// Small writes are copied into the free space of the last slab (storage
+/// from BufferPool, given back once the queue drains), bigger ones are
+/// queued by reference to their owner (see Slice). Written bytes are
+/// dropped by moving past them, queued data is never copied or moved again.
+///
+/// With a zero-copy threshold, writes of that size go with MSG_ZEROCOPY.
+/// Their segments stay referenced (pinned) after being dropped, until the
+/// kernel reports the send complete with completeZeroCopy().
+/// 链式输出队列，用 writev 发送，已排队的数据不再搬移
+class OutputQueue {
+ public:
+  /// Size of the slabs small writes are copied into.
+  static const size_t kSlabSize = 16 * 1024;
+  /// Buffers at least this big are queued by reference, smaller ones are
+  /// copied, a segment per small write would make writev() slower.
+  static const size_t kAppendByRefThreshold = 4 * 1024;
+  /// writeFd() stops gathering segments past this many bytes.
+  static const size_t kMaxBytesPerWrite = 1024 * 1024;
+
+  /// MSG_ZEROCOPY sends, read in loop only.
+  struct ZeroCopyStats {
+    int64_t sends;        // writes done with MSG_ZEROCOPY
+    int64_t completions;  // sends reported complete
+    int64_t copied;       // of them, the kernel copied the data anyway
+  };
+
+  OutputQueue();
+  ~OutputQueue();
+  OutputQueue(const OutputQueue &) = delete;
+  OutputQueue &operator=(const OutputQueue &) = delete;
+
+  size_t readableBytes() const { return readableBytes_; }
+  bool empty() const { return readableBytes_ == 0; }
+  size_t numSegments() const { return segments_.size(); }
+
+  /// Copies @c len bytes.
+  void append(const void *data, size_t len);
+  /// Queues @c slice, by reference if big enough.
+  void append(const Slice &slice);
+  /// Queues @c slice by reference whatever its size, for data written
+  /// right away.
+  void appendRef(const Slice &slice);
+
+  /// Contiguous room for @c len bytes at the end of the queue, for data
+  /// written in place: the free space of the last slab if it has enough,
+  /// else a new slab of at least @c len bytes.
+  char *reserve(size_t len);
+  /// Queues the first @c len bytes of the room reserve() returned, with
+  /// nothing else appended in between.
+  void commit(size_t len);
+
+  /// Writes as much as possible with one writev(2) of at most IOV_MAX
+  /// segments (and about kMaxBytesPerWrite), and drops what was written.
+  /// @return result of writev(2), @c errno is saved
+  ssize_t writeFd(int fd, int *savedErrno);
+
+  /// Fills @c vec with the segments writeFd() would write, without
+  /// dropping them, for a write that completes later. @c owners gets what
+  /// keeps their data alive until then.
+  /// @return the number of segments
+  int peekSegments(struct iovec *vec, int maxIov,
+                   std::vector<std::shared_ptr<const void>> *owners) const;
+
+  /// Drops @c len bytes from the front.
+  void retrieve(size_t len);
+  void retrieveAll();
+
+  /// Writes of at least @c bytes go with MSG_ZEROCOPY, 0 (the default)
+  /// turns it off. SO_ZEROCOPY must be on.
+  void setZeroCopyThreshold(size_t bytes) { zeroCopyThreshold_ = bytes; }
+  size_t zeroCopyThreshold() const { return zeroCopyThreshold_; }
+  /// The kernel is done with the MSG_ZEROCOPY sends @c lo to @c hi, their
+  /// data is released.
+  void completeZeroCopy(uint32_t lo, uint32_t hi, bool copied);
+  /// Bytes of MSG_ZEROCOPY sends the kernel may still read.
+  size_t pinnedBytes() const { return pinnedBytes_; }
+  /// Gives away the owners of the pinned data, e.g. to keep it alive a
+  /// while after the connection is gone.
+  std::vector<std::shared_ptr<const void>> takePinned();
+  ZeroCopyStats zeroCopyStats() const { return zeroCopyStats_; }
+
+ private:
+  struct Slab;
+  struct Segment {
+    std::shared_ptr<const void> owner;  // keeps data alive
+    const char *data;
+    size_t len;
+  };
+
+  // data of a MSG_ZEROCOPY send, until its completion
+  struct Pinned {
+    uint32_t id;
+    size_t bytes;  // 0 once complete
+    std::vector<std::shared_ptr<const void>> owners;
+  };
+
+  // the slab small writes go to, with room for at least one byte
+  Slab *writableSlab();
+  // up to @c maxIov segments from the front, about kMaxBytesPerWrite
+  int gather(struct iovec *vec, int maxIov, size_t *bytes) const;
+  // pins the owners of the first @c len bytes, sent with MSG_ZEROCOPY
+  void pin(size_t len);
+
+  std::deque<Segment> segments_;
+  std::shared_ptr<Slab> tail_;  // last slab, NULL or partly filled
+  size_t readableBytes_;
+  size_t zeroCopyThreshold_;
+  uint32_t nextZeroCopyId_;  // the kernel's number of the next send
+  std::deque<Pinned> pinned_;
+  size_t pinnedBytes_;
+  ZeroCopyStats zeroCopyStats_;
+};
+
+}  // namespace network
@@ -1,45 +1,100 @@
 #pragma once
 
-#include <map>
+#include <stddef.h>
+#include <sys/types.h>
+
 #include <vector>
 
 #include "network/EventLoop.h"
-struct epoll_event;
+
 namespace network {
+
+class Buffer;
 class Channel;
+class OutputQueue;
+
+///
+/// Channels of a Poller, a flat table indexed by fd.
 ///
-/// IO Multiplexing with epoll(4).
+/// fds are small dense integers, a lookup is one load instead of a tree
+/// walk. The table grows on demand, up to the process fd limit.
+/// 以 fd 为下标的 Channel 表
+class ChannelMap {
+ public:
+  ChannelMap() : size_(0) {}
+
+  /// NULL if no channel is registered for @c fd.
+  Channel *find(int fd) const {
+    return static_cast<size_t>(fd) < channels_.size() ? channels_[fd] : NULL;
+  }
+  void insert(int fd, Channel *channel);
+  void erase(int fd);
+  /// Number of registered channels.
+  size_t size() const { return size_; }
+
+ private:
+  std::vector<Channel *> channels_;
+  size_t size_;
+};
+
 ///
-/// I/O 事件的分发器
+/// Base class for IO Multiplexing
+///
+/// This class doesn't own the Channel objects.
+/// I/O 事件分发器的接口，具体实现见 EPollPoller 和 UringPoller
 class Poller {
  public:
   typedef std::vector<Channel *> ChannelList;
-  Poller(EventLoop *loop);
-  ~Poller();
 
-  void poll(int timeoutMs, ChannelList *activeChannels);
-  void updateChannel(Channel *channel);
-  void removeChannel(Channel *channel);
+  Poller(EventLoop *loop, EventLoop::PollerType type);
+  virtual ~Poller();
 
-  void assertInLoopThread() const { ownerLoop_->assertInLoopThread(); }
-  bool hasChannel(Channel *channel) const;
+  /// Polls the I/O events.
+  /// Must be called in the loop thread.
+  virtual void poll(int timeoutMs, ChannelList *activeChannels) = 0;
 
- private:
-  EventLoop *ownerLoop_;  // 确保 Poller 在正确的线程上操作
-  static const int kInitEventListSize = 16;
+  /// Changes the interested I/O events.
+  /// Must be called in the loop thread.
+  virtual void updateChannel(Channel *channel) = 0;
+
+  /// Remove the channel, when it destructs.
+  /// Must be called in the loop thread.
+  virtual void removeChannel(Channel *channel) = 0;
 
-  static const char *operationToString(int op);
+  virtual bool hasChannel(Channel *channel) const;
 
-  void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
-  void update(int operation, Channel *channel);
+  /// Completion based socket I/O of channels set to Channel::asyncIo(),
+  /// see UringPoller. Must be called in the loop thread.
+  /// Other pollers don't support it, the defaults read and write right away.
+  virtual bool supportsAsyncIo() const { return false; }
+  /// Takes what arrived for @c channel into @c buf.
+  /// @return as Buffer::readFd()
+  virtual ssize_t readChannel(Channel *channel, Buffer *buf, int *savedErrno);
+  /// Starts writing the front of @c output in place, its segments stay
+  /// referenced until the write completed. The write callback of the
+  /// channel runs then, see takeWrite().
+  virtual void writeChannel(Channel *, const OutputQueue &) {}
+  /// A write started by writeChannel() wasn't taken yet.
+  virtual bool channelWriting(Channel *) const { return false; }
+  /// Result of the write started by writeChannel(), as write(2), 0 if none
+  /// completed.
+  virtual ssize_t takeWrite(Channel *, int *) { return 0; }
 
-  typedef std::vector<struct epoll_event> EventList;
+  /// The backend actually in use.
+  EventLoop::PollerType type() const { return type_; }
 
-  int epollfd_;
-  EventList events_;   // 存储 epoll 触发的事件，用于在 epoll_wait 调用后处理发生的事件
+  /// Creates the poller of @c type, falls back to epoll if the kernel
+  /// doesn't support it.
+  static Poller *newDefaultPoller(EventLoop *loop, EventLoop::PollerType type);
 
-  typedef std::map<int, Channel *> ChannelMap;
+  void assertInLoopThread() const { ownerLoop_->assertInLoopThread(); }
+
+ protected:
   ChannelMap channels_;   // 存储所有注册到 Poller 的 Channel 对象，通过文件描述符来快速查找对应的 Channel
+
+ private:
+  EventLoop *ownerLoop_;  // 确保 Poller 在正确的线程上操作
+  const EventLoop::PollerType type_;
 };
 
 }  // namespace network
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <cassert>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "network/Buffer.h"
+
+namespace network {
+
+///
+/// Immutable bytes kept alive by a reference counted owner, what
+/// TcpConnection::send() queues without copying. Copying a Slice copies the
+/// reference, e.g. to send a message serialized once to many connections.
+///
+/// The owner's bytes must not change while a Slice refers to them.
+/// 引用计数的只读数据片段
+class Slice {
+ public:
+  Slice() : data_(NULL), len_(0) {}
+  Slice(std::shared_ptr<const void> owner, const char *data, size_t len)
+      : owner_(std::move(owner)), data_(data), len_(len) {}
+
+  /// Takes the string over, its characters are not copied.
+  static Slice fromString(std::string &&str) {
+    std::shared_ptr<const std::string> owner =
+        std::make_shared<const std::string>(std::move(str));
+    return Slice(owner, owner->data(), owner->size());
+  }
+
+  /// Takes the readable bytes of the buffer over, they are not copied.
+  static Slice fromBuffer(Buffer &&buf) {
+    std::shared_ptr<const Buffer> owner =
+        std::make_shared<const Buffer>(std::move(buf));
+    return Slice(owner, owner->peek(), owner->readableBytes());
+  }
+
+  const char *data() const { return data_; }
+  size_t size() const { return len_; }
+  bool empty() const { return len_ == 0; }
+  const std::shared_ptr<const void> &owner() const { return owner_; }
+
+  /// @c len bytes from @c offset, with the same owner.
+  Slice subslice(size_t offset, size_t len) const {
+    assert(offset + len <= len_);
+    return Slice(owner_, data_ + offset, len);
+  }
+
+  void removePrefix(size_t n) {
+    assert(n <= len_);
+    data_ += n;
+    len_ -= n;
+  }
+
+ private:
+  std::shared_ptr<const void> owner_;
+  const char *data_;
+  size_t len_;
+};
+
+}  // namespace network
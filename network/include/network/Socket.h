@@ -1,5 +1,7 @@
 #pragma once
 
+#include <sys/socket.h>
+
 struct tcp_info;
 
 namespace network {
@@ -25,7 +27,8 @@ class Socket {
   /// abort if address in use
   void bindAddress(const InetAddress &localaddr);
   /// abort if address in use
-  void listen();
+  /// @c backlog is capped by net.core.somaxconn.
+  void listen(int backlog = SOMAXCONN);
 
   /// On success, returns a non-negative integer that is
   /// a descriptor for the accepted socket, which has been
@@ -55,6 +58,19 @@ class Socket {
   ///
   void setKeepAlive(bool on);
 
+  ///
+  /// Set SO_BUSY_POLL, busy poll the device queue for up to @c usec
+  /// microseconds on a blocking receive.
+  /// Going above net.core.busy_read needs CAP_NET_ADMIN.
+  /// return true if success.
+  bool setBusyPoll(int usec);
+
+  ///
+  /// Enable/disable SO_ZEROCOPY, allows sends with MSG_ZEROCOPY.
+  /// Needs Linux 4.14.
+  /// return true if success.
+  bool setZeroCopy(bool on);
+
  private:
   const int sockfd_;
 };
@@ -18,6 +18,18 @@ int accept(int sockfd, struct sockaddr_in6 *addr);
 ssize_t read(int sockfd, void *buf, size_t count);
 ssize_t readv(int sockfd, const struct iovec *iov, int iovcnt);
 ssize_t write(int sockfd, const void *buf, size_t count);
+ssize_t writev(int sockfd, const struct iovec *iov, int iovcnt);
+/// writev() with MSG_ZEROCOPY, SO_ZEROCOPY must be on. The kernel reads
+/// the data until the send is reported complete, see
+/// readZeroCopyCompletion(). Sends are numbered from 0, one number per
+/// call that sent something.
+ssize_t sendZeroCopy(int sockfd, const struct iovec *iov, int iovcnt);
+/// Reads a MSG_ZEROCOPY completion from the socket error queue: sends
+/// @c *lo to @c *hi are done, @c *copied if the kernel copied the data
+/// anyway (e.g. over loopback).
+/// return false if there is none.
+bool readZeroCopyCompletion(int sockfd, uint32_t *lo, uint32_t *hi,
+                            bool *copied);
 void close(int sockfd);
 void shutdownWrite(int sockfd);
 
@@ -28,6 +28,9 @@ class TcpClient {
   EventLoop *getLoop() const { return loop_; }
   bool retry() const { return retry_; }
   void enableRetry() { retry_ = true; }
+  /// Registers the connection with EPOLLET, see TcpServer::setEdgeTriggered.
+  /// Takes effect on the next connection.
+  void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
 
   const std::string &name() const { return name_; }
 
@@ -63,6 +66,7 @@ class TcpClient {
   WriteCompleteCallback writeCompleteCallback_;
   bool retry_;    // atomic
   bool connect_;  // atomic
+  bool edgeTriggered_;
   // always in loop thread
   int nextConnId_;
   mutable std::mutex mutex_;
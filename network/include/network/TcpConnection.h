@@ -1,12 +1,16 @@
 #pragma once
 
+#include <cassert>
 #include <memory>
+#include <vector>
 
 #include <boost/any.hpp>
 
 #include "network/Buffer.h"
 #include "network/Callbacks.h"
 #include "network/InetAddress.h"
+#include "network/OutputQueue.h"
+#include "network/Slice.h"
 
 // struct tcp_info is in <netinet/tcp.h>
 struct tcp_info;
@@ -41,17 +45,42 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
   bool getTcpInfo(struct tcp_info *) const;
   std::string getTcpInfoString() const;
 
-  // void send(string&& message); // C++11
-  // void send(const void *message, int len);
-  // void send(const std::string &message);
-  // void send(Buffer&& message); // C++11
+  /// Thread safe. From another thread, the message is handed to the loop,
+  /// a copy only for the overloads taking const references to bytes.
+  void send(const void *message, size_t len);
+  void send(const std::string &message);
+  /// Big messages are swapped out of @c message and queued by reference.
   void send(Buffer *message);  // this one will swap data
+  /// Take the message over, it is not copied even from another thread.
+  void send(Buffer &&message);
+  void send(std::string &&message);
+  void send(const Slice &message);
+  /// Sends @c messages in order, with one task from another thread and one
+  /// writev() if nothing is queued.
+  void send(std::vector<Slice> &&messages);
+  /// Sending in place, in loop only: reserveOutput() returns contiguous
+  /// room for @c len bytes at the end of the output queue, e.g. to
+  /// serialize a message into, commitOutput() queues the @c len bytes
+  /// written there and sends them, with one write if nothing was queued.
+  /// A small message with nothing queued is written aside instead and only
+  /// what the socket doesn't take is queued, an idle connection holds no
+  /// output storage. Nothing else may be sent in between.
+  char *reserveOutput(size_t len);
+  void commitOutput(size_t len);
   void shutdown();             // NOT thread safe, no simultaneous calling
   // void shutdownAndForceCloseAfter(double seconds); // NOT thread safe, no
   // simultaneous calling
   void forceClose();
   void forceCloseWithDelay(double seconds);
   void setTcpNoDelay(bool on);
+  /// Writes of at least @c bytes go with MSG_ZEROCOPY: the kernel sends
+  /// from the queued data instead of copying it, which keeps it alive until
+  /// the completion comes on the socket error queue. Pays off for messages
+  /// of a few hundred KB and up, handed over with send(Buffer*) so they are
+  /// queued by reference. Loopback copies anyway. 0 turns it off.
+  /// In loop, e.g. from the connection callback.
+  /// return false if the kernel has no SO_ZEROCOPY.
+  bool setZeroCopyThreshold(size_t bytes);
   // reading or not
   void startRead();
   void stopRead();
@@ -59,6 +88,12 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
     return reading_;
   };  // NOT thread safe, may race with start/stopReadInLoop
 
+  /// Registers the socket with EPOLLET, reads are drained until EAGAIN
+  /// (at most kReadBudgetPerEvent bytes per event).
+  /// Must be called before connectEstablished().
+  void setEdgeTriggered(bool on);
+  bool edgeTriggered() const;
+
   void setContext(const boost::any &context) { context_ = context; }
 
   const boost::any &getContext() const { return context_; }
@@ -77,16 +112,57 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
     writeCompleteCallback_ = cb;
   }
 
-  // void setHighWaterMarkCallback(const HighWaterMarkCallback &cb,
-  //                               size_t highWaterMark) {
-  //   highWaterMarkCallback_ = cb;
-  //   highWaterMark_ = highWaterMark;
-  // }
+  /// Output counts the queued bytes and those pinned by MSG_ZEROCOPY.
+  /// The callbacks run in loop, after the send that crossed the mark.
+
+  /// Called when the output reaches @c highWaterMark, once until it drains
+  /// back to the low water mark, which must be below it.
+  void setHighWaterMarkCallback(const HighWaterMarkCallback &cb,
+                                size_t highWaterMark) {
+    assert(highWaterMark == 0 || lowWaterMark_ < highWaterMark);
+    highWaterMarkCallback_ = cb;
+    highWaterMark_ = highWaterMark;
+  }
+
+  /// Called when the output drains to @c lowWaterMark (0 by default) after
+  /// reaching the high water mark.
+  void setLowWaterMarkCallback(const LowWaterMarkCallback &cb,
+                               size_t lowWaterMark) {
+    assert(highWaterMark_ == 0 || lowWaterMark < highWaterMark_);
+    lowWaterMarkCallback_ = cb;
+    lowWaterMark_ = lowWaterMark;
+  }
+
+  /// Stops reading from the peer once the output reaches the high water
+  /// mark and resumes at the low water mark, so a peer that doesn't read
+  /// its responses can't send more requests. Independent of
+  /// startRead()/stopRead(): reading resumes only if neither holds it.
+  void setPauseReadingAtHighWaterMark(bool on) {
+    pauseReadingAtHighWaterMark_ = on;
+  }
+  /// While reading is paused by the high water mark. A message callback
+  /// should stop dispatching the messages left in the input buffer, it is
+  /// called again with them once the output drains.
+  bool backpressured() const { return readingPaused_; }
+
+  /// Drops the output and closes the connection when the output reaches
+  /// @c maxBytes, 0 (the default) for no limit. The close is queued to the
+  /// loop, sends until then are dropped.
+  void setMaxOutputBytes(size_t maxBytes) { maxOutputBytes_ = maxBytes; }
+
+  /// Memory held for this connection, read in loop.
+  struct MemoryStats {
+    size_t inputBytes;        // storage of the input buffer
+    size_t outputBytes;       // queued or pinned output
+    size_t peakOutputBytes;
+    int64_t highWaterMarks;   // times the high water mark was reached
+  };
+  MemoryStats memoryStats() const;
 
   /// Advanced interface
   Buffer *inputBuffer() { return &inputBuffer_; }
 
-  Buffer *outputBuffer() { return &outputBuffer_; }
+  OutputQueue *outputQueue() { return &outputQueue_; }
 
   /// Internal use only.
   void setCloseCallback(const CloseCallback &cb) { closeCallback_ = cb; }
@@ -98,13 +174,47 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
 
  private:
   enum StateE { kDisconnected, kConnecting, kConnected, kDisconnecting };
+  // bytes read per readiness event before yielding to other connections
+  static const size_t kReadBudgetPerEvent = 256 * 1024;
+  // how long data of MSG_ZEROCOPY sends outlives a closed connection, the
+  // kernel may still be sending it
+  static const int kZeroCopyLingerSec = 30;
+
   void handleRead();
+  void continueRead();
+  // hands the input left by a backpressured message callback over again
+  void deliverInput();
   void handleWrite();
   void handleClose();
   void handleError();
+  // releases the data of completed MSG_ZEROCOPY sends, returns how many
+  // completions were read
+  int reapZeroCopy();
+  size_t outputBytes() const {
+    return outputQueue_.readableBytes() + outputQueue_.pinnedBytes();
+  }
+  // checks the output against the water marks and the limit, after it
+  // changed
+  void checkOutput();
   // void sendInLoop(string&& message);
   void sendInLoop(const std::string &message);
   void sendInLoop(const void *message, size_t len);
+  void sendSliceInLoop(const Slice &message);
+  void sendSlicesInLoop(const std::vector<Slice> &messages);
+  // after queuing output the socket didn't take: watches writability, or
+  // with completion based I/O starts writing it
+  void watchOutput();
+  // writes from the output queue, watches writability while some is left
+  void writeQueued();
+  // completion based: starts writing the queue through the poller
+  void writeQueuedAsync();
+  // completion based: takes the result of the write, goes on with the rest
+  void writeCompleted();
+  // whether reserveOutput() of @c len bytes gives room in outputScratch_
+  bool writesAside(size_t len) const;
+  // writes directly if nothing is queued, returns the bytes written, or -1
+  // on a fatal error
+  ssize_t writeDirect(const void *data, size_t len);
   void shutdownInLoop();
   // void shutdownAndForceCloseInLoop(double seconds);
   void forceCloseInLoop();
@@ -125,11 +235,21 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
   ConnectionCallback connectionCallback_;
   MessageCallback messageCallback_;
   WriteCompleteCallback writeCompleteCallback_;
-  // HighWaterMarkCallback highWaterMarkCallback_;
+  HighWaterMarkCallback highWaterMarkCallback_;
+  LowWaterMarkCallback lowWaterMarkCallback_;
   CloseCallback closeCallback_;
-  // size_t highWaterMark_;
+  size_t highWaterMark_;  // 0 for none
+  size_t lowWaterMark_;
+  size_t maxOutputBytes_;  // 0 for none
+  bool outputDropped_;     // over maxOutputBytes_, closing
+  bool pauseReadingAtHighWaterMark_;
+  bool aboveHighWaterMark_;
+  bool readingPaused_;  // by the high water mark, reading_ is the user's
+  size_t peakOutputBytes_;
+  int64_t highWaterMarks_;
   Buffer inputBuffer_;
-  Buffer outputBuffer_;  // FIXME: use list<Buffer> as output buffer.
+  OutputQueue outputQueue_;
+  Buffer outputScratch_;  // for reserveOutput() when idle, empty otherwise
   boost::any context_;
   // FIXME: creationTime_, lastReceiveTime_
   //        bytesReceived_, bytesSent_
@@ -2,14 +2,18 @@
 
 #include <atomic>
 #include <map>
+#include <memory>
+#include <vector>
 
 #include "network/TcpConnection.h"
 
 namespace network {
 
 class Acceptor;
+struct AcceptStats;
 class EventLoop;
 class EventLoopThreadPool;
+class LoopPlacementPolicy;
 
 ///
 /// TCP server, supports single-threaded and thread-pool models.
@@ -21,6 +25,9 @@ class TcpServer {
   enum Option {
     kNoReusePort,
     kReusePort,
+    /// Every I/O loop listens on its own SO_REUSEPORT socket and accepts
+    /// the connections it owns, the base loop is out of the accept path.
+    kReusePortPerLoop,
   };
 
   // TcpServer(EventLoop* loop, const InetAddress& listenAddr);
@@ -46,6 +53,44 @@ class TcpServer {
   void setThreadInitCallback(const ThreadInitCallback &cb) {
     threadInitCallback_ = cb;
   }
+  /// Registers connections with EPOLLET and drains reads until EAGAIN,
+  /// fewer epoll_wait returns and epoll_ctl calls for busy connections.
+  /// Must be called before @c start
+  void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+  /// Busy polls the I/O loops for @c windowUs microseconds after activity,
+  /// see EventLoop::setBusyPollUs.
+  /// Must be called before @c start
+  void setBusyPollUs(int64_t windowUs);
+  /// How new connections are spread over the I/O loops, round-robin by
+  /// default, see LoopPlacementPolicy.
+  /// Must be called before @c start
+  void setPlacementPolicy(std::unique_ptr<LoopPlacementPolicy> policy);
+  /// With kReusePortPerLoop, lets the kernel pick the listening socket of
+  /// the I/O loop with index (CPU receiving the SYN % number of loops).
+  /// Only useful if loop i is pinned to CPU i, e.g. in the
+  /// ThreadInitCallback. Placement policies don't apply then.
+  /// Must be called before @c start
+  void setReusePortCpuSteering(bool on) { cpuSteering_ = on; }
+  /// Length of the listen queue, SOMAXCONN by default (the kernel caps it
+  /// at net.core.somaxconn).
+  /// Must be called before @c start
+  void setListenBacklog(int backlog) { listenBacklog_ = backlog; }
+  /// Connections accepted per readiness of the listening socket, 64 by
+  /// default. 1 accepts one connection per poll.
+  /// Must be called before @c start
+  void setMaxAcceptsPerEvent(int n) { maxAcceptsPerEvent_ = n; }
+  /// Token bucket on accepts, see Acceptor::setRateLimit. With
+  /// kReusePortPerLoop every acceptor gets an equal share of the rate.
+  /// Must be called before @c start
+  void setAcceptRateLimit(double ratePerSecond, double burst,
+                          bool dropExcess = false) {
+    acceptRate_ = ratePerSecond;
+    acceptBurst_ = burst;
+    dropExcessAccepts_ = dropExcess;
+  }
+  /// Accepted, deferred and dropped connections over all acceptors.
+  /// Thread safe, after @c start
+  AcceptStats acceptStats() const;
   /// valid after calling start()
   std::shared_ptr<EventLoopThreadPool> threadPool() { return threadPool_; }
 
@@ -84,6 +129,19 @@ class TcpServer {
   /// 在事件循环的线程中执行，用于从连接映射中删除一个连接
   void removeConnectionInLoop(const TcpConnectionPtr &conn);
 
+  // kReusePortPerLoop, the acceptor and connections of an I/O loop
+  struct LoopAcceptor;
+  void startLoopAcceptors();
+  void configureAcceptor(Acceptor *acceptor, int numAcceptors);
+  /// Not thread safe, but in the I/O loop
+  void newConnectionInLoop(LoopAcceptor *la, int sockfd,
+                           const InetAddress &peerAddr);
+  /// Not thread safe, but in the I/O loop
+  void removeLoopConnection(LoopAcceptor *la, const TcpConnectionPtr &conn);
+  TcpConnectionPtr createConnection(EventLoop *ioLoop,
+                                    const std::string &connName, int sockfd,
+                                    const InetAddress &peerAddr);
+
   typedef std::map<std::string, TcpConnectionPtr> ConnectionMap; // 一个映射
 
   EventLoop *loop_;  // the acceptor loop
@@ -97,6 +155,15 @@ class TcpServer {
   WriteCompleteCallback writeCompleteCallback_;  // 写完成回调函数，用于在数据写入完成时调用
   ThreadInitCallback threadInitCallback_; // 线程初始化回调函数，用于在线程池中的线程初始化时调用
 
+  const Option option_;
+  bool cpuSteering_;
+  int listenBacklog_;
+  int maxAcceptsPerEvent_;
+  double acceptRate_;  // 0 means unlimited
+  double acceptBurst_;
+  bool dropExcessAccepts_;
+  std::vector<std::unique_ptr<LoopAcceptor>> loopAcceptors_;
+  bool edgeTriggered_;
   std::atomic<bool> started_;
   // always in loop thread
   int nextConnId_;
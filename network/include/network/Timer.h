@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "network/Callbacks.h"
+
+namespace network {
+
+///
+/// Intrusive doubly linked list node.
+///
+/// A default constructed node links to itself, so it also serves as the
+/// sentinel head of a list (e.g. a TimingWheel bucket).
+struct TimerNode {
+  TimerNode() : prev(this), next(this) {}
+
+  TimerNode(const TimerNode &) = delete;
+  TimerNode &operator=(const TimerNode &) = delete;
+
+  // for a sentinel head: no element in the list
+  bool empty() const { return next == this; }
+
+  void pushBack(TimerNode *node) {
+    node->prev = prev;
+    node->next = this;
+    prev->next = node;
+    prev = node;
+  }
+
+  void unlink() {
+    prev->next = next;
+    next->prev = prev;
+    prev = this;
+    next = this;
+  }
+
+  // moves all elements of @c other to the end of this list
+  void splice(TimerNode *other) {
+    if (other->empty()) {
+      return;
+    }
+    other->next->prev = prev;
+    prev->next = other->next;
+    other->prev->next = this;
+    prev = other->prev;
+    other->prev = other;
+    other->next = other;
+  }
+
+  TimerNode *prev;
+  TimerNode *next;
+};
+
+///
+/// Internal class for timer event.
+///
+/// Timer objects are recycled by TimerQueue, every arming gets a new sequence
+/// so that a stale TimerId can be detected.
+class Timer : public TimerNode {
+ public:
+  enum State {
+    kIdle,     // in the free list
+    kPending,  // created in another thread, not yet added to the wheel
+    kLinked,   // in a TimingWheel bucket
+    kExpired,  // moved out of the wheel, waiting to run
+    kRunning,  // callback is running
+  };
+
+  Timer()
+      : expiration_(0),
+        interval_(0),
+        sequence_(0),
+        bucket_(-1),
+        state_(kIdle),
+        canceled_(false) {}
+
+  void reset(TimerCallback cb, int64_t when, int64_t interval) {
+    callback_ = std::move(cb);
+    expiration_ = when;
+    interval_ = interval;
+    sequence_ = s_numCreated_.fetch_add(1) + 1;
+    canceled_ = false;
+  }
+
+  void clear() {
+    callback_ = TimerCallback();
+    sequence_ = 0;
+    bucket_ = -1;
+    state_ = kIdle;
+    canceled_ = false;
+  }
+
+  void run() const { callback_(); }
+
+  void restart(int64_t now) { expiration_ = now + interval_; }
+
+  int64_t expiration() const { return expiration_; }  // monotonic ms
+  bool repeat() const { return interval_ > 0; }
+  int64_t sequence() const { return sequence_; }
+
+  // used by TimingWheel
+  int bucket() const { return bucket_; }
+  void set_bucket(int bucket) { bucket_ = bucket; }
+
+  State state() const { return state_; }
+  void set_state(State state) { state_ = state; }
+
+  bool canceled() const { return canceled_; }
+  void cancel() { canceled_ = true; }
+
+  static int64_t numCreated() { return s_numCreated_; }
+
+ private:
+  TimerCallback callback_;
+  int64_t expiration_;
+  int64_t interval_;  // 重复间隔(ms)，0 表示只触发一次
+  int64_t sequence_;
+  int bucket_;
+  State state_;
+  bool canceled_;
+
+  static std::atomic<int64_t> s_numCreated_;
+};
+
+}  // namespace network
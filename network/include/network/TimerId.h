@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace network {
+
+class Timer;
+
+///
+/// An opaque identifier, for canceling Timer.
+///
+class TimerId {
+ public:
+  TimerId() : timer_(NULL), sequence_(0) {}
+
+  TimerId(Timer *timer, int64_t seq) : timer_(timer), sequence_(seq) {}
+
+  // default copy-ctor, dtor and assignment are okay
+
+  bool valid() const { return timer_ != NULL; }
+
+  friend class TimerQueue;
+
+ private:
+  Timer *timer_;
+  int64_t sequence_;
+};
+
+}  // namespace network
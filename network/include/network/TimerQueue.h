@@ -0,0 +1,66 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "network/Callbacks.h"
+#include "network/Channel.h"
+#include "network/Timer.h"
+#include "network/TimerId.h"
+#include "network/TimingWheel.h"
+
+namespace network {
+
+class EventLoop;
+
+///
+/// A best efforts timer queue.
+/// No guarantee that the callback will be on time.
+///
+/// Timers are kept in a TimingWheel and recycled through a free list, so
+/// arming and canceling are O(1) and don't allocate in steady state.
+/// The timerfd is only re-armed when the earliest wake-up moves earlier.
+/// 定时器队列，由 timerfd 驱动
+class TimerQueue {
+ public:
+  explicit TimerQueue(EventLoop *loop);
+  ~TimerQueue();
+
+  TimerQueue(const TimerQueue &) = delete;
+  TimerQueue &operator=(const TimerQueue &) = delete;
+
+  ///
+  /// Schedules the callback to be run after @c delayMs milliseconds,
+  /// repeats every @c intervalMs milliseconds if it's positive.
+  /// Must be thread safe. Usually be called from other threads.
+  TimerId addTimer(TimerCallback cb, int64_t delayMs, int64_t intervalMs);
+
+  void cancel(TimerId timerId);
+
+  // number of armed timers, not thread safe
+  size_t size() const { return wheel_.size(); }
+
+ private:
+  void addTimerInLoop(Timer *timer);
+  void adoptTimerInLoop(Timer *timer);
+  void cancelInLoop(TimerId timerId);
+  // called when timerfd alarms
+  void handleRead();
+  void runExpired(int64_t now);
+  void resetTimerfd();
+
+  Timer *allocTimer();
+  void releaseTimer(Timer *timer);
+
+  EventLoop *loop_;
+  const int timerfd_;
+  Channel timerfdChannel_;
+  TimingWheel wheel_;
+  TimerNode expired_;
+  int64_t armedTick_;  // timerfd 当前设置的到期时间
+
+  std::vector<std::unique_ptr<Timer>> timers_;  // owns every Timer
+  std::vector<Timer *> freeTimers_;
+};
+
+}  // namespace network
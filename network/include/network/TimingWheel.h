@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "network/Timer.h"
+
+namespace network {
+
+///
+/// Hierarchical timing wheel with 1 ms ticks.
+///
+/// The root wheel has 256 buckets of one tick each, followed by four levels
+/// of 64 buckets, so timers up to 2^32 ms (about 49 days) ahead are linked in
+/// O(1); longer ones are clamped and re-linked when they cascade.
+/// add() and remove() are O(1), finding the next expiry is a few bit scans.
+///
+/// This class doesn't own the timers, and is not thread safe.
+/// 分层时间轮，TimerQueue 的内部数据结构
+class TimingWheel {
+ public:
+  static const int64_t kNever = INT64_MAX;
+
+  explicit TimingWheel(int64_t nowTick);
+  ~TimingWheel();
+
+  TimingWheel(const TimingWheel &) = delete;
+  TimingWheel &operator=(const TimingWheel &) = delete;
+
+  /// Links the timer by its expiration().
+  /// Already expired timers fire on the next tick.
+  void add(Timer *timer);
+  /// Unlinks a timer previously added.
+  void remove(Timer *timer);
+
+  /// Moves every timer expiring at or before @c nowTick to @c expired,
+  /// in expiration order.
+  void advance(int64_t nowTick, TimerNode *expired);
+
+  /// The earliest tick the wheel needs to be advanced to,
+  /// either an expiration or a cascade of an upper level bucket.
+  /// kNever if there is no timer.
+  int64_t nextTick() const;
+
+  int64_t currentTick() const { return currentTick_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  static const int kRootBits = 8;
+  static const int kRootSize = 1 << kRootBits;
+  static const int kLevelBits = 6;
+  static const int kLevelSize = 1 << kLevelBits;
+  static const int kNumLevels = 5;  // root included
+  static const int kNumBuckets = kRootSize + (kNumLevels - 1) * kLevelSize;
+  static const int kNumWords = kNumBuckets / 64;
+
+  void link(int bucket, Timer *timer);
+  void cascade(int level, int64_t tick);
+  int64_t nextTickOfLevel(int level) const;
+
+  int64_t currentTick_;  // the next tick to process
+  size_t size_;
+  TimerNode buckets_[kNumBuckets];
+  uint64_t occupied_[kNumWords];  // one bit per non-empty bucket
+};
+
+}  // namespace network
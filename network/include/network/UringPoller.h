@@ -0,0 +1,162 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "network/Poller.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+namespace network {
+
+class Channel;
+
+///
+/// IO Multiplexing with io_uring(7).
+///
+/// Every interested fd has a one-shot IORING_OP_POLL_ADD in flight, fired
+/// ones are re-armed before the next wait. Interest changes, re-arms and the
+/// wait itself go to the kernel in a single io_uring_enter(2), so unlike
+/// epoll there is no epoll_ctl(2) per change.
+/// Semantics are level-triggered, EPOLLET is not supported.
+///
+/// Channels set to asyncIo() (TcpConnection sockets) don't poll, their
+/// reads and writes are submitted with the rest:
+///   - a reading channel has an IORING_OP_RECV in flight, the kernel picks
+///     a buffer of the loop's provided buffer ring only when data arrives,
+///     so idle connections hold none. When the ring is empty the channel
+///     polls once and reads with read(2).
+///   - writes send the segments at the front of the output in place with
+///     IORING_OP_SENDMSG, one at a time per channel. The request keeps the
+///     owners of the segments, so the data lives until it completes even
+///     if the queue is dropped meanwhile.
+/// The buffer ring is set up in the constructor, if the kernel refuses
+/// (before 5.19) every channel polls.
+/// 基于 io_uring 的 I/O 事件分发器
+class UringPoller : public Poller {
+ public:
+  UringPoller(EventLoop *loop);
+  ~UringPoller() override;
+
+  void poll(int timeoutMs, ChannelList *activeChannels) override;
+  void updateChannel(Channel *channel) override;
+  void removeChannel(Channel *channel) override;
+
+  bool supportsAsyncIo() const override { return asyncIo_; }
+  ssize_t readChannel(Channel *channel, Buffer *buf,
+                      int *savedErrno) override;
+  void writeChannel(Channel *channel, const OutputQueue &output) override;
+  bool channelWriting(Channel *channel) const override;
+  ssize_t takeWrite(Channel *channel, int *savedErrno) override;
+
+  /// The kernel has io_uring with the features we need
+  /// (IORING_FEAT_NODROP, IORING_FEAT_EXT_ARG, IORING_FEAT_POLL_32BITS).
+  static bool isSupported();
+
+ private:
+  static const unsigned kSqEntries = 256;
+  static const unsigned kCqEntries = 4096;
+  // provided buffers for receives, not pinned
+  static const unsigned kRecvBuffers = 128;  // a power of 2
+  static const size_t kRecvBufferSize = 64 * 1024;
+  static const uint16_t kRecvGroup = 0;
+  // segments gathered by a send
+  static const int kMaxWriteSegments = 64;
+
+  struct WriteRequest;
+
+  // request state of a fd
+  struct Entry {
+    Entry()
+        : channel(NULL),
+          generation(1),
+          armedEvents(0),
+          armed(false),
+          recvGeneration(1),
+          recvArmed(false),
+          recvDone(false),
+          recvFallback(false),
+          recvResult(0),
+          recvBuffer(-1),
+          writeRequest(-1),
+          writeDone(false),
+          writeResult(0),
+          revents(0) {}
+
+    Channel *channel;
+    uint32_t generation;  // completions of older generations are stale
+    int armedEvents;
+    bool armed;
+    // asyncIo() channels
+    uint32_t recvGeneration;  // as generation, for receives
+    bool recvArmed;
+    bool recvDone;      // completed, not taken by readChannel() yet
+    bool recvFallback;  // out of buffers, poll and read(2) once
+    int recvResult;
+    int recvBuffer;     // provided buffer holding the data, -1 if none
+    int writeRequest;   // send in flight, index in writes_, or -1
+    bool writeDone;     // completed, not taken by takeWrite() yet
+    int writeResult;
+    int revents;        // gathered while reaping completions
+  };
+
+  Entry &entry(int fd);
+  void arm(int fd, Entry &e, int events);
+  void disarm(Entry &e, int fd);
+  // puts in flight what an asyncIo() channel needs
+  void armAsync(int fd, Entry &e);
+  void armRecv(int fd, Entry &e, bool pollFirst);
+  void cancel(uint64_t userData);
+  void setupAsyncIo();
+  char *recvBuffer(int bid) const;
+  void recycleRecvBuffer(int bid);
+  void releaseWrite(int index);
+  io_uring_sqe *getSqe();
+  int enter(unsigned toSubmit, bool wait, int timeoutMs);
+  void fillActiveChannels(ChannelList *activeChannels);
+  void complete(int fd, Entry &e, int revents);
+
+  int ringFd_;
+  // mmap-ed rings
+  void *sqRing_;
+  size_t sqRingSize_;
+  void *cqRing_;
+  size_t cqRingSize_;
+  io_uring_sqe *sqes_;
+  size_t sqesSize_;
+
+  unsigned *sqHead_;
+  unsigned *sqTail_;
+  unsigned *sqFlags_;
+  unsigned *sqArray_;
+  unsigned sqMask_;
+  unsigned sqEntries_;
+  unsigned sqeTail_;   // local tail, published by enter()
+  unsigned toSubmit_;  // queued sqes not submitted yet
+
+  unsigned *cqHead_;
+  unsigned *cqTail_;
+  unsigned cqMask_;
+  io_uring_cqe *cqes_;
+
+  std::vector<Entry> entries_;  // indexed by fd
+  std::vector<int> rearm_;      // fired in the last poll()
+  std::vector<int> ready_;      // with a completion to hand out right away
+  std::vector<int> completed_;  // scratch of fillActiveChannels()
+
+  bool asyncIo_;
+  io_uring_buf_ring *recvRing_;  // shared with the kernel
+  size_t recvRingSize_;
+  uint16_t recvRingTail_;
+  char *recvBuffers_;
+  std::vector<std::unique_ptr<WriteRequest>> writes_;
+  std::vector<int> freeWrites_;
+  int writesInFlight_;
+};
+
+}  // namespace network
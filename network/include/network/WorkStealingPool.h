@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace network {
+
+///
+/// Fixed pool of worker threads for blocking or CPU heavy work that must
+/// stay off the I/O loops, e.g. RPC handlers (see RpcServer::setExecutor).
+///
+/// Every worker owns a queue. submit() from a worker pushes to its own queue,
+/// from any other thread to the queues in turn. An idle worker takes the
+/// oldest task of its queue, then steals the oldest task of the others, so
+/// one slow task only holds up the tasks behind it until a worker is free.
+/// 工作窃取线程池，任务在 I/O 线程之外执行
+class WorkStealingPool {
+ public:
+  typedef std::function<void()> Task;
+
+  explicit WorkStealingPool(const std::string &nameArg = "WorkStealingPool");
+  /// Runs the tasks still queued, then joins the workers.
+  ~WorkStealingPool();
+
+  /// Must be called before @c start, at least 1.
+  void setThreadNum(int numThreads) { numThreads_ = numThreads; }
+  /// Starts the workers, harmless to call it multiple times.
+  void start();
+  /// Runs the tasks still queued, then joins the workers.
+  /// Must not be called from a worker.
+  void stop();
+
+  /// Thread safe. The task runs on one of the workers, in no particular
+  /// order with respect to the other queues. Once stop() began it runs
+  /// right away in the calling thread.
+  void submit(Task task);
+
+  /// Tasks submitted and not yet taken by a worker. Thread safe.
+  size_t queueSize() const {
+    return static_cast<size_t>(pending_.load(std::memory_order_relaxed));
+  }
+
+  bool started() const { return started_; }
+  int numThreads() const { return numThreads_; }
+  const std::string &name() const { return name_; }
+
+ private:
+  struct alignas(64) WorkQueue {
+    WorkQueue() : closed(false) {}
+
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    bool closed;  // by stop(), submit() runs the task in the caller
+  };
+
+  void threadFunc(int index);
+  // own queue first, then the others starting with the next one
+  bool takeTask(int index, Task *task);
+
+  const std::string name_;
+  int numThreads_;
+  bool started_;
+  std::atomic<bool> running_;
+  std::atomic<unsigned> next_;   // round-robin for outside submitters
+  std::atomic<int64_t> pending_;
+  std::atomic<int> idle_;        // workers waiting on cv_
+
+  std::mutex mutex_;  // guards the sleep/wake up of workers
+  std::condition_variable cv_;
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace network
@@ -12,6 +12,15 @@ pid_t getThreadId();
 
 // 返回当前时间的毫秒数
 int64_t getNowMs();     
+
+// 返回单调时钟的毫秒数，不受系统时间调整影响，用于定时器
+int64_t getMonotonicMs();
+
+// 返回单调时钟的微秒数
+int64_t getMonotonicUs();
+
+// 返回单调时钟的纳秒数
+int64_t getMonotonicNs();
                          
 // 从网络字节序的字节数组中提取一个 32 位整数
 int32_t getInt32FromNetByte(const char *buf);    
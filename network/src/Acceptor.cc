@@ -2,14 +2,19 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/filter.h>
+#include <sys/socket.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 
 #include <glog/logging.h>
 
 #include "network/EventLoop.h"
 #include "network/InetAddress.h"
 #include "network/SocketsOps.h"
+#include "network/util.h"
 // #include <sys/types.h>
 // #include <sys/stat.h>
 #include <unistd.h>
@@ -22,7 +27,18 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr,
       acceptSocket_(sockets::createNonblockingOrDie(listenAddr.family())),
       acceptChannel_(loop, acceptSocket_.fd()),
       listening_(false),
-      idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC)) {
+      idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC)),
+      backlog_(SOMAXCONN),
+      maxAcceptsPerEvent_(kDefaultMaxAcceptsPerEvent),
+      ratePerUs_(0),
+      burst_(0),
+      dropExcess_(false),
+      tokens_(0),
+      lastRefillUs_(0),
+      paused_(false),
+      accepted_(0),
+      deferred_(0),
+      dropped_(0) {
   assert(idleFd_ >= 0);
   acceptSocket_.setReuseAddr(true);
   acceptSocket_.setReusePort(reuseport);
@@ -31,42 +47,155 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr,
 }
 
 Acceptor::~Acceptor() {
+  if (paused_) {
+    loop_->cancel(resumeTimer_);
+  }
   acceptChannel_.disableAll();
   acceptChannel_.remove();
   ::close(idleFd_);
 }
 
+InetAddress Acceptor::localAddress() const {
+  return InetAddress(sockets::getLocalAddr(acceptSocket_.fd()));
+}
+
 void Acceptor::listen() {
   loop_->assertInLoopThread();
   listening_ = true;
-  acceptSocket_.listen();
+  acceptSocket_.listen(backlog_);
   acceptChannel_.enableReading();
 }
 
+void Acceptor::setRateLimit(double ratePerSecond, double burst,
+                            bool dropExcess) {
+  ratePerUs_ = ratePerSecond > 0 ? ratePerSecond / 1e6 : 0;
+  burst_ = std::max(burst, 1.0);
+  dropExcess_ = dropExcess;
+  tokens_ = burst_;
+  lastRefillUs_ = getMonotonicUs();
+}
+
+AcceptStats Acceptor::stats() const {
+  AcceptStats s;
+  s.accepted = accepted_.load(std::memory_order_relaxed);
+  s.deferred = deferred_.load(std::memory_order_relaxed);
+  s.dropped = dropped_.load(std::memory_order_relaxed);
+  return s;
+}
+
+bool Acceptor::attachCpuSteering(int numSockets) {
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+  assert(numSockets > 0);
+  // A = cpu % numSockets; return A
+  struct sock_filter code[] = {
+      {BPF_LD | BPF_W | BPF_ABS, 0, 0,
+       static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)},
+      {BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<uint32_t>(numSockets)},
+      {BPF_RET | BPF_A, 0, 0, 0},
+  };
+  struct sock_fprog prog;
+  prog.len = sizeof code / sizeof code[0];
+  prog.filter = code;
+  // applies to the whole group
+  return ::setsockopt(acceptSocket_.fd(), SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                      &prog, static_cast<socklen_t>(sizeof prog)) == 0;
+#else
+  (void)numSockets;
+  return false;
+#endif
+}
+
 void Acceptor::handleRead() {
   loop_->assertInLoopThread();
-  InetAddress peerAddr;
-  // FIXME loop until no more
-  int connfd = acceptSocket_.accept(&peerAddr);
-  if (connfd >= 0) {
-    // string hostport = peerAddr.toIpPort();
-    // LOG_TRACE << "Accepts of " << hostport;
-    if (newConnectionCallback_) {
-      newConnectionCallback_(connfd, peerAddr);
-    } else {
-      sockets::close(connfd);
+  const int64_t now = ratePerUs_ > 0 ? getMonotonicUs() : 0;
+  // drain the backlog, but give the other channels a chance
+  for (int i = 0; i < maxAcceptsPerEvent_; ++i) {
+    if (ratePerUs_ > 0 && !takeToken(now)) {
+      if (dropExcess_) {
+        if (!dropOne()) {
+          break;  // the backlog is empty
+        }
+        continue;
+      }
+      pauseAccepting();
+      return;
+    }
+    InetAddress peerAddr;
+    int connfd = acceptSocket_.accept(&peerAddr);
+    if (connfd >= 0) {
+      addRelaxed(accepted_, 1);
+      if (newConnectionCallback_) {
+        newConnectionCallback_(connfd, peerAddr);
+      } else {
+        sockets::close(connfd);
+      }
+      continue;
     }
-  } else {
-    LOG(ERROR) << "in Acceptor::handleRead";
-    // Read the section named "The special problem of
-    // accept()ing when you can't" in libev's doc.
-    // By Marc Lehmann, author of libev.
-    if (errno == EMFILE) {
+
+    const int savedErrno = errno;
+    if (ratePerUs_ > 0) {
+      // nothing accepted, give the token back
+      tokens_ = std::min(burst_, tokens_ + 1);
+    }
+    if (savedErrno == EMFILE) {
+      LOG(ERROR) << "in Acceptor::handleRead";
+      // Read the section named "The special problem of
+      // accept()ing when you can't" in libev's doc.
+      // By Marc Lehmann, author of libev.
       ::close(idleFd_);
       idleFd_ = ::accept(acceptSocket_.fd(), NULL, NULL);
-      ::close(idleFd_);
+      if (idleFd_ >= 0) {
+        addRelaxed(dropped_, 1);
+        ::close(idleFd_);
+      }
       idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    } else if (savedErrno == ECONNABORTED || savedErrno == EINTR) {
+      continue;  // aborted before we got to it, try the next one
     }
+    // EAGAIN: the backlog is empty
+    break;
+  }
+}
+
+bool Acceptor::takeToken(int64_t nowUs) {
+  if (nowUs > lastRefillUs_) {
+    tokens_ = std::min(burst_,
+                       tokens_ + (nowUs - lastRefillUs_) * ratePerUs_);
+    lastRefillUs_ = nowUs;
+  }
+  if (tokens_ < 1) {
+    return false;
+  }
+  tokens_ -= 1;
+  return true;
+}
+
+void Acceptor::pauseAccepting() {
+  // level triggered, we would be woken up again right away
+  addRelaxed(deferred_, 1);
+  paused_ = true;
+  acceptChannel_.disableReading();
+  const double waitUs = (1 - tokens_) / ratePerUs_;
+  const int64_t waitMs = static_cast<int64_t>(std::ceil(waitUs / 1000));
+  resumeTimer_ = loop_->runAfter(std::max<int64_t>(waitMs, 1) / 1000.0,
+                                 std::bind(&Acceptor::resumeAccepting, this));
+}
+
+void Acceptor::resumeAccepting() {
+  loop_->assertInLoopThread();
+  paused_ = false;
+  if (listening_) {
+    acceptChannel_.enableReading();
+  }
+}
+
+bool Acceptor::dropOne() {
+  int connfd = ::accept4(acceptSocket_.fd(), NULL, NULL, SOCK_CLOEXEC);
+  if (connfd >= 0) {
+    addRelaxed(dropped_, 1);
+    ::close(connfd);
+    return true;
   }
+  return errno == ECONNABORTED || errno == EINTR;
 }
 }  // namespace network
\ No newline at end of file
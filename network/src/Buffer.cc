@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <sys/uio.h>
 
+#include "network/BufferPool.h"
 #include "network/SocketsOps.h"
 
 namespace network {
@@ -11,6 +12,62 @@ const char Buffer::kCRLF[] = "\r\n";
 const size_t Buffer::kCheapPrepend;
 const size_t Buffer::kInitialSize;
 
+Buffer::Buffer(const Buffer &rhs)
+    : data_(NULL),
+      capacity_(0),
+      initialSize_(rhs.initialSize_),
+      readerIndex_(kCheapPrepend),
+      writerIndex_(kCheapPrepend) {
+  if (rhs.readableBytes() > 0) {
+    append(rhs.peek(), rhs.readableBytes());
+  }
+}
+
+void Buffer::allocate(size_t size) {
+  assert(data_ == NULL);
+  capacity_ = BufferPool::blockSize(size);
+  data_ = BufferPool::allocate(capacity_);
+  readerIndex_ = kCheapPrepend;
+  writerIndex_ = kCheapPrepend;
+}
+
+void Buffer::releaseStorage() {
+  if (data_) {
+    BufferPool::deallocate(data_, capacity_);
+    data_ = NULL;
+    capacity_ = 0;
+  }
+  readerIndex_ = kCheapPrepend;
+  writerIndex_ = kCheapPrepend;
+}
+
+void Buffer::makeSpace(size_t len) {
+  if (data_ == NULL) {
+    allocate(kCheapPrepend + std::max(len, initialSize_));
+  } else if (writableBytes() + prependableBytes() < len + kCheapPrepend) {
+    // a bigger block, the readable data moves to its front
+    const size_t readable = readableBytes();
+    const char *from = data_ + readerIndex_;
+    char *old = data_;
+    const size_t oldCapacity = capacity_;
+    data_ = NULL;
+    allocate(kCheapPrepend + readable + len);
+    std::copy(from, from + readable, data_ + kCheapPrepend);
+    BufferPool::deallocate(old, oldCapacity);
+    writerIndex_ = kCheapPrepend + readable;
+  } else {
+    // move readable data to the front, make space inside buffer
+    // 预留空间和read之间有空间时
+    assert(kCheapPrepend < readerIndex_);
+    size_t readable = readableBytes();
+    std::copy(begin() + readerIndex_, begin() + writerIndex_,
+              begin() + kCheapPrepend);
+    readerIndex_ = kCheapPrepend;
+    writerIndex_ = readerIndex_ + readable;
+    assert(readable == readableBytes());
+  }
+}
+
 //从文件描述符 fd 中读取数据到 Buffer 对象中
 ssize_t Buffer::readFd(int fd, int *savedErrno) {
   // saved an ioctl()/FIONREAD call to tell how much to read
@@ -30,6 +87,9 @@ ssize_t Buffer::readFd(int fd, int *savedErrno) {
 
   // // saved an ioctl()/FIONREAD call to tell how much to read
   char extrabuf[1024 * 1024];
+  if (data_ == NULL) {
+    allocate(kCheapPrepend + initialSize_);
+  }
   struct iovec vec[2];
   const size_t writable = writableBytes();
   vec[0].iov_base = begin() + writerIndex_;
@@ -45,7 +105,7 @@ ssize_t Buffer::readFd(int fd, int *savedErrno) {
   } else if (size_t(n) <= writable) {
     writerIndex_ += n;
   } else {
-    writerIndex_ = buffer_.size();
+    writerIndex_ = capacity_;
     append(extrabuf, n - writable);
   }
   // if (n == writable + sizeof extrabuf)
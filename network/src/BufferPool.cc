@@ -0,0 +1,169 @@
+#include "network/BufferPool.h"
+
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cassert>
+#include <new>
+
+namespace network {
+
+namespace {
+
+thread_local BufferPool *t_bufferPool = NULL;
+
+}  // namespace
+
+const size_t BufferPool::kMinBlockSize;
+const size_t BufferPool::kMaxBlockSize;
+const int BufferPool::kNumClasses;
+const size_t BufferPool::kHugePageSize;
+const int BufferPool::kTrimIntervalSec;
+
+BufferPool::BufferPool()
+    : hugePages_(false),
+      maxCachedBytes_(64 * 1024 * 1024),
+      cachedBlocks_(0),
+      cachedBytes_(0),
+      hits_(0),
+      misses_(0),
+      trimmedBytes_(0) {
+  static_assert(kMinBlockSize << (kNumClasses - 1) == kMaxBlockSize,
+                "size classes");
+}
+
+BufferPool::~BufferPool() {
+  clear();
+  if (t_bufferPool == this) {
+    t_bufferPool = NULL;
+  }
+}
+
+size_t BufferPool::blockSize(size_t size) {
+  if (size > kMaxBlockSize) {
+    return size;
+  }
+  return kMinBlockSize << classIndex(size);
+}
+
+int BufferPool::classIndex(size_t size) {
+  int index = 0;
+  while ((kMinBlockSize << index) < size) {
+    ++index;
+  }
+  return index;
+}
+
+char *BufferPool::allocate(size_t size) {
+  size = blockSize(size);
+  BufferPool *pool = t_bufferPool;
+  if (pool && size <= kMaxBlockSize) {
+    return pool->get(size);
+  }
+  char *block = static_cast<char *>(::malloc(size));
+  if (block == NULL) {
+    throw std::bad_alloc();
+  }
+  return block;
+}
+
+void BufferPool::deallocate(char *block, size_t size) {
+  size = blockSize(size);
+  BufferPool *pool = t_bufferPool;
+  if (pool && size <= kMaxBlockSize) {
+    pool->put(block, size);
+  } else {
+    ::free(block);
+  }
+}
+
+BufferPool *BufferPool::current() { return t_bufferPool; }
+
+void BufferPool::setCurrent(BufferPool *pool) { t_bufferPool = pool; }
+
+char *BufferPool::get(size_t size) {
+  SizeClass &sc = classes_[classIndex(size)];
+  if (sc.blocks.empty()) {
+    addRelaxed(misses_, 1);
+    return newBlock(size);
+  }
+  char *block = sc.blocks.back();
+  sc.blocks.pop_back();
+  sc.lowWater = std::min(sc.lowWater, sc.blocks.size());
+  addRelaxed(hits_, 1);
+  addRelaxed(cachedBlocks_, -1);
+  addRelaxed(cachedBytes_, -static_cast<int64_t>(size));
+  return block;
+}
+
+void BufferPool::put(char *block, size_t size) {
+  if (cachedBytes_.load(std::memory_order_relaxed) +
+          static_cast<int64_t>(size) >
+      static_cast<int64_t>(maxCachedBytes_)) {
+    addRelaxed(trimmedBytes_, size);
+    ::free(block);
+    return;
+  }
+  classes_[classIndex(size)].blocks.push_back(block);
+  addRelaxed(cachedBlocks_, 1);
+  addRelaxed(cachedBytes_, size);
+}
+
+char *BufferPool::newBlock(size_t size) {
+  void *block = NULL;
+  if (hugePages_ && size >= kHugePageSize) {
+    if (::posix_memalign(&block, kHugePageSize, size) == 0) {
+      ::madvise(block, size, MADV_HUGEPAGE);
+    }
+  } else {
+    block = ::malloc(size);
+  }
+  if (block == NULL) {
+    throw std::bad_alloc();
+  }
+  return static_cast<char *>(block);
+}
+
+void BufferPool::release(SizeClass *sc, size_t count, size_t size) {
+  for (size_t i = 0; i < count; ++i) {
+    ::free(sc->blocks.back());
+    sc->blocks.pop_back();
+  }
+  const int64_t bytes = static_cast<int64_t>(count * size);
+  addRelaxed(cachedBlocks_, -static_cast<int64_t>(count));
+  addRelaxed(cachedBytes_, -bytes);
+  addRelaxed(trimmedBytes_, bytes);
+}
+
+void BufferPool::trim() {
+  for (int i = 0; i < kNumClasses; ++i) {
+    SizeClass &sc = classes_[i];
+    // that many blocks sat in the cache the whole interval
+    release(&sc, sc.lowWater, kMinBlockSize << i);
+    if (sc.blocks.empty()) {
+      std::vector<char *>().swap(sc.blocks);
+    }
+    sc.lowWater = sc.blocks.size();
+  }
+}
+
+void BufferPool::clear() {
+  for (int i = 0; i < kNumClasses; ++i) {
+    SizeClass &sc = classes_[i];
+    release(&sc, sc.blocks.size(), kMinBlockSize << i);
+    sc.lowWater = 0;
+  }
+}
+
+BufferPool::Stats BufferPool::stats() const {
+  Stats s;
+  s.cachedBlocks = cachedBlocks_.load(std::memory_order_relaxed);
+  s.cachedBytes = cachedBytes_.load(std::memory_order_relaxed);
+  s.hits = hits_.load(std::memory_order_relaxed);
+  s.misses = misses_.load(std::memory_order_relaxed);
+  s.trimmedBytes = trimmedBytes_.load(std::memory_order_relaxed);
+  return s;
+}
+
+}  // namespace network
@@ -15,6 +15,9 @@ Channel::Channel(EventLoop *loop, int fd__)
       events_(0),
       revents_(0),
       index_(-1),
+      registeredEvents_(0),
+      edgeTriggered_(false),
+      asyncIo_(false),
       event_handling_(false),
       addedToLoop_(false) {}
 
@@ -26,14 +29,30 @@ Channel::~Channel() {
   }
 }
 
+void Channel::setEdgeTriggered(bool on) {
+  assert(isNoneEvent());
+  edgeTriggered_ = on && loop_->pollerType() == EventLoop::kEpollPoller;
+}
+
+void Channel::setAsyncIo(bool on) {
+  assert(isNoneEvent());
+  asyncIo_ = on && loop_->supportsAsyncIo();
+}
+
 void Channel::update() {
+  if (addedToLoop_ && pollEvents() == registeredEvents_) {
+    // nothing changes for the poller, save an epoll_ctl
+    return;
+  }
   addedToLoop_ = true;
+  registeredEvents_ = pollEvents();
   loop_->updateChannel(this);
 }
 
 void Channel::remove() {
   assert(isNoneEvent());
   addedToLoop_ = false;
+  registeredEvents_ = 0;
   loop_->removeChannel(this);
 }
 
@@ -47,7 +66,9 @@ void Channel::handleEvent() {
   if (revents_ & (POLLIN | POLLPRI | POLLRDHUP)) {
     if (readCallback_) readCallback_();
   }
-  if (revents_ & POLLOUT) {
+  // in edge-triggered mode EPOLLOUT is reported even if we have nothing to
+  // write
+  if ((revents_ & POLLOUT) && (!edgeTriggered_ || isWriting())) {
     if (writeCallback_) writeCallback_();
   }
 
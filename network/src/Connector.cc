@@ -2,10 +2,13 @@
 
 #include <errno.h>
 
+#include <algorithm>
+
 #include <glog/logging.h>
 
 #include "network/Channel.h"
 #include "network/EventLoop.h"
+#include "network/Logging.h"
 #include "network/SocketsOps.h"
 
 using namespace network;
@@ -18,11 +21,11 @@ Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
       connect_(false),
       state_(kDisconnected),
       retryDelayMs_(kInitRetryDelayMs) {
-  LOG(INFO) << "ctor[" << this << "]";
+  LOG_DEBUG << "ctor[" << this << "]";
 }
 
 Connector::~Connector() {
-  LOG(INFO) << "dtor[" << this << "]";
+  LOG_DEBUG << "dtor[" << this << "]";
   assert(!channel_);
 }
 
@@ -44,11 +47,12 @@ void Connector::startInLoop() {
 void Connector::stop() {
   connect_ = false;
   loop_->queueInLoop(std::bind(&Connector::stopInLoop, this));  // FIXME: unsafe
-  // FIXME: cancel timer
 }
 
 void Connector::stopInLoop() {
   loop_->assertInLoopThread();
+  // retryTimer_ is only touched in the loop
+  loop_->cancel(retryTimer_);
   if (state_ == kConnecting) {
     setState(kDisconnected);
     int sockfd = removeAndResetChannel();
@@ -130,7 +134,7 @@ int Connector::removeAndResetChannel() {
 void Connector::resetChannel() { channel_.reset(); }
 
 void Connector::handleWrite() {
-  LOG(INFO) << "Connector::handleWrite " << state_;
+  LOG_TRACE << "Connector::handleWrite " << state_;
 
   if (state_ == kConnecting) {
     int sockfd = removeAndResetChannel();
@@ -172,9 +176,10 @@ void Connector::retry(int sockfd) {
     LOG(INFO) << "Connector::retry - Retry connecting to "
               << serverAddr_.toIpPort() << " in " << retryDelayMs_
               << " milliseconds. ";
-    // loop_->runAfter(retryDelayMs_ / 1000.0,
-    //                 std::bind(&Connector::startInLoop, shared_from_this()));
-    // retryDelayMs_ = std::min(retryDelayMs_ * 2, kMaxRetryDelayMs);
+    retryTimer_ =
+        loop_->runAfter(retryDelayMs_ / 1000.0,
+                        std::bind(&Connector::startInLoop, shared_from_this()));
+    retryDelayMs_ = std::min(retryDelayMs_ * 2, kMaxRetryDelayMs);
   } else {
     LOG(INFO) << "do not connect";
   }
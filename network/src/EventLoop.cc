@@ -6,12 +6,15 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 
 #include <glog/logging.h>
 
+#include "network/BufferPool.h"
 #include "network/Channel.h"
 #include "network/Poller.h"
 #include "network/SocketsOps.h"
+#include "network/TimerQueue.h"
 
 using namespace network;
 
@@ -35,28 +38,41 @@ EventLoop *EventLoop::getEventLoopOfCurrentThread() {
   return t_loopInThisThread;
 }
 
-EventLoop::EventLoop()
+EventLoop::EventLoop(PollerType pollerType)
     : looping_(false),
       quit_(false),
       eventHandling_(false),
       callingPendingFunctors_(false),
       iteration_(0),
-      poller_(new Poller(this)),
+      threadId_(getThreadId()),
+      bufferPool_(new BufferPool),
+      poller_(Poller::newDefaultPoller(this, pollerType)),
+      timerQueue_(new TimerQueue(this)),
       wakeupFd_(createEventfd()),
       wakeupChannel_(new Channel(this, wakeupFd_)),
-      currentActiveChannel_(NULL) {
+      currentActiveChannel_(NULL),
+      sleeping_(false),
+      pendingCount_(0),
+      numConnections_(0),
+      busyPollUs_(0),
+      spinTimeUs_(0),
+      sleepTimeUs_(0),
+      lastActiveUs_(0),
+      lastTrimNs_(getMonotonicNs()) {
   LOG(INFO) << "EventLoop created " << this << " in thread " << threadId_;
   if (t_loopInThisThread) {
     LOG(FATAL) << "Another EventLoop " << t_loopInThisThread
                << " exists in this thread " << threadId_;
   } else {
     t_loopInThisThread = this;
+    BufferPool::setCurrent(get_pointer(bufferPool_));
+  }
+  if (::pthread_getcpuclockid(::pthread_self(), &cpuClockId_) != 0) {
+    cpuClockId_ = CLOCK_THREAD_CPUTIME_ID;  // only valid in the loop thread
   }
   wakeupChannel_->setReadCallback(std::bind(&EventLoop::handleRead, this));
   // we are always reading the wakeupfd
   wakeupChannel_->enableReading();
-
-  threadId_ = getThreadId();
 }
 
 EventLoop::~EventLoop() {
@@ -65,7 +81,12 @@ EventLoop::~EventLoop() {
   wakeupChannel_->disableAll();
   wakeupChannel_->remove();
   ::close(wakeupFd_);
+  while (MpscNode *node = pendingFunctors_.pop()) {
+    delete static_cast<Task *>(node);
+  }
   t_loopInThisThread = NULL;
+  // Buffers freed from now on go back to malloc
+  BufferPool::setCurrent(NULL);
 }
 
 void EventLoop::loop() {
@@ -75,10 +96,24 @@ void EventLoop::loop() {
   quit_ = false;  // FIXME: what if someone calls quit() before loop() ?
   LOG(INFO) << "EventLoop " << this << " start looping";
 
+  int64_t start = getMonotonicNs();
   while (!quit_) {
     activeChannels_.clear();
-    poller_->poll(kPollTimeMs, &activeChannels_);
-    ++iteration_;
+    const int64_t busyPollUs = busyPollUs_.load(std::memory_order_relaxed);
+    if (busyPollUs > 0) {
+      pollBusy(busyPollUs);
+    } else {
+      pollBlocking();
+    }
+    addRelaxed(iteration_, 1);
+    const int64_t polled = getMonotonicNs();
+    addRelaxed(counters_.pollTimeNs, polled - start);
+    const int64_t numEvents = static_cast<int64_t>(activeChannels_.size());
+    addRelaxed(counters_.events, numEvents);
+    std::atomic<int64_t> &maxEvents = counters_.maxEventsPerPoll;
+    if (numEvents > maxEvents.load(std::memory_order_relaxed)) {
+      maxEvents.store(numEvents, std::memory_order_relaxed);
+    }
 
     // TODO sort channel by priority
     eventHandling_ = true;
@@ -88,13 +123,58 @@ void EventLoop::loop() {
     }
     currentActiveChannel_ = NULL;
     eventHandling_ = false;
+    const int64_t handled = getMonotonicNs();
+    addRelaxed(counters_.handleEventTimeNs, handled - polled);
+
     doPendingFunctors();
+    // also the start of the next poll
+    start = getMonotonicNs();
+    addRelaxed(counters_.pendingFunctorsTimeNs, start - handled);
+
+    // an idle loop still wakes up every kPollTimeMs
+    if (start - lastTrimNs_ >= BufferPool::kTrimIntervalSec * 1000000000LL) {
+      bufferPool_->trim();
+      lastTrimNs_ = start;
+    }
   }
 
   LOG(INFO) << "EventLoop " << this << " stop looping";
   looping_ = false;
 }
 
+void EventLoop::pollBlocking() {
+  // 先公布睡眠状态再检查队列，与 queueInLoop() 的 push 后检查配对，
+  // 保证不会漏掉唤醒
+  int timeoutMs = kPollTimeMs;
+  sleeping_.store(true);
+  if (!pendingFunctors_.empty()) {
+    sleeping_.store(false);
+    timeoutMs = 0;
+  }
+  poller_->poll(timeoutMs, &activeChannels_);
+  sleeping_.store(false);
+}
+
+void EventLoop::pollBusy(int64_t busyPollUs) {
+  const int64_t start = getMonotonicUs();
+  int64_t end;
+  // sleeping_ stays false while spinning, producers don't write the eventfd,
+  // their tasks are picked up by doPendingFunctors() of this iteration
+  if (start - lastActiveUs_ < busyPollUs || !pendingFunctors_.empty()) {
+    poller_->poll(0, &activeChannels_);
+    end = getMonotonicUs();
+    spinTimeUs_.fetch_add(end - start, std::memory_order_relaxed);
+  } else {
+    pollBlocking();
+    end = getMonotonicUs();
+    sleepTimeUs_.fetch_add(end - start, std::memory_order_relaxed);
+  }
+  if (!activeChannels_.empty() || !pendingFunctors_.empty()) {
+    // the window restarts from the last poll that found work
+    lastActiveUs_ = end;
+  }
+}
+
 void EventLoop::quit() {
   quit_ = true;
   // There is a chance that loop() just executes while(!quit_) and exits,
@@ -114,19 +194,61 @@ void EventLoop::runInLoop(Functor cb) {
 }
 // 插入尾部
 void EventLoop::queueInLoop(Functor cb) {
-  {
-    std::unique_lock<std::mutex> lock(mutex_);
-    pendingFunctors_.push_back(std::move(cb));
-  }
-  // 如果当前线程不是事件循环线程，或者正在处理待处理回调函数，则唤醒事件循环线程
-  if (!isInLoopThread() || callingPendingFunctors_) {
+  pendingCount_.fetch_add(1, std::memory_order_relaxed);
+  pendingFunctors_.push(new Task(std::move(cb)));
+  // 只有事件循环阻塞在 poll 中才需要唤醒，并且只由一个生产者负责写 eventfd；
+  // 在 loop 线程内 sleeping_ 总是 false
+  if (sleeping_.load() && sleeping_.exchange(false)) {
     wakeup();
   }
 }
 
 size_t EventLoop::queueSize() const {
-  std::unique_lock<std::mutex> lock(mutex_);
-  return pendingFunctors_.size();
+  return pendingCount_.load(std::memory_order_relaxed);
+}
+
+EventLoop::PollerType EventLoop::pollerType() const { return poller_->type(); }
+
+TimerId EventLoop::runAt(int64_t timeMs, TimerCallback cb) {
+  // the timer queue runs on the monotonic clock
+  return timerQueue_->addTimer(std::move(cb), timeMs - getNowMs(), 0);
+}
+
+TimerId EventLoop::runAfter(double delay, TimerCallback cb) {
+  int64_t delayMs = static_cast<int64_t>(std::ceil(delay * 1000));
+  return timerQueue_->addTimer(std::move(cb), delayMs, 0);
+}
+
+TimerId EventLoop::runEvery(double interval, TimerCallback cb) {
+  int64_t intervalMs = static_cast<int64_t>(std::ceil(interval * 1000));
+  if (intervalMs <= 0) {
+    intervalMs = 1;
+  }
+  return timerQueue_->addTimer(std::move(cb), intervalMs, intervalMs);
+}
+
+void EventLoop::cancel(TimerId timerId) { return timerQueue_->cancel(timerId); }
+
+EventLoop::Metrics EventLoop::metrics() const {
+  Metrics m;
+  m.iterations = iteration_.load(std::memory_order_relaxed);
+  m.events = counters_.events.load(std::memory_order_relaxed);
+  m.maxEventsPerPoll =
+      counters_.maxEventsPerPoll.load(std::memory_order_relaxed);
+  m.pollTimeNs = counters_.pollTimeNs.load(std::memory_order_relaxed);
+  m.handleEventTimeNs =
+      counters_.handleEventTimeNs.load(std::memory_order_relaxed);
+  m.pendingFunctorsTimeNs =
+      counters_.pendingFunctorsTimeNs.load(std::memory_order_relaxed);
+  m.functors = counters_.functors.load(std::memory_order_relaxed);
+  m.queueHighWater = counters_.queueHighWater.load(std::memory_order_relaxed);
+  struct timespec ts;
+  if (::clock_gettime(cpuClockId_, &ts) == 0) {
+    m.cpuTimeNs = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  } else {
+    m.cpuTimeNs = -1;
+  }
+  return m;
 }
 
 void EventLoop::updateChannel(Channel *channel) {
@@ -152,6 +274,28 @@ bool EventLoop::hasChannel(Channel *channel) {
   return poller_->hasChannel(channel);
 }
 
+bool EventLoop::supportsAsyncIo() const { return poller_->supportsAsyncIo(); }
+
+ssize_t EventLoop::readChannel(Channel *channel, Buffer *buf,
+                               int *savedErrno) {
+  assertInLoopThread();
+  return poller_->readChannel(channel, buf, savedErrno);
+}
+
+void EventLoop::writeChannel(Channel *channel, const OutputQueue &output) {
+  assertInLoopThread();
+  poller_->writeChannel(channel, output);
+}
+
+bool EventLoop::channelWriting(Channel *channel) const {
+  return poller_->channelWriting(channel);
+}
+
+ssize_t EventLoop::takeWrite(Channel *channel, int *savedErrno) {
+  assertInLoopThread();
+  return poller_->takeWrite(channel, savedErrno);
+}
+
 void EventLoop::abortNotInLoopThread() {
   // LOG(FATAL) << "Event loop is not in the current thread, threadID: "
   //            << threadId_ << ", current threadID = " << getThreadId();
@@ -175,17 +319,28 @@ void EventLoop::handleRead() {
 }
 //执行排队回调
 void EventLoop::doPendingFunctors() {
-  std::vector<Functor> functors;
   callingPendingFunctors_ = true;
 
-  {
-    std::unique_lock<std::mutex> lock(mutex_);
-    functors.swap(pendingFunctors_);
+  const int64_t depth =
+      static_cast<int64_t>(pendingCount_.load(std::memory_order_relaxed));
+  if (depth > counters_.queueHighWater.load(std::memory_order_relaxed)) {
+    counters_.queueHighWater.store(depth, std::memory_order_relaxed);
   }
 
-  for (const Functor &functor : functors) {
-    functor();
+  // only run what is queued so far, functors queued by functors run in the
+  // next iteration, after polling with zero timeout.
+  int64_t ran = 0;
+  MpscNode *last = pendingFunctors_.back();
+  while (MpscNode *node = pendingFunctors_.pop()) {
+    std::unique_ptr<Task> task(static_cast<Task *>(node));
+    pendingCount_.fetch_sub(1, std::memory_order_relaxed);
+    task->functor();
+    ++ran;
+    if (node == last) {
+      break;
+    }
   }
+  addRelaxed(counters_.functors, ran);
   callingPendingFunctors_ = false;
 }
 
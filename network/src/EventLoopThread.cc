@@ -4,8 +4,13 @@
 
 namespace network {
 EventLoopThread::EventLoopThread(const ThreadInitCallback &cb,
-                                 const std::string &name)
-    : loop_(NULL), exiting_(false), mutex_(), callback_(cb) {}
+                                 const std::string &name,
+                                 EventLoop::PollerType pollerType)
+    : loop_(NULL),
+      exiting_(false),
+      mutex_(),
+      callback_(cb),
+      pollerType_(pollerType) {}
 
 EventLoopThread::~EventLoopThread() {
   exiting_ = true;
@@ -38,7 +43,7 @@ EventLoop *EventLoopThread::startLoop() {
 }
 
 void EventLoopThread::threadFunc() {
-  EventLoop loop;
+  EventLoop loop(pollerType_);
 
   if (callback_) {
     callback_(&loop);
@@ -14,7 +14,10 @@ EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop,
       name_(nameArg),
       started_(false),
       numThreads_(0),
-      next_(0) {}
+      next_(0),
+      pollerType_(EventLoop::kDefaultPoller),
+      busyPollUs_(0),
+      policy_(LoopPlacementPolicy::newRoundRobin()) {}
 
 EventLoopThreadPool::~EventLoopThreadPool() {
   // Don't delete loop, it's stack variable
@@ -28,10 +31,15 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb) {
 
   for (int i = 0; i < numThreads_; ++i) {
     char buf[name_.size() + 32];
-    LOG(INFO) << "name11111: " << name_.c_str();
-    EventLoopThread *t = new EventLoopThread(cb, buf);
+    snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
+    EventLoopThread *t = new EventLoopThread(cb, buf, pollerType_);
     threads_.push_back(std::unique_ptr<EventLoopThread>(t));
     loops_.push_back(t->startLoop());
+    loops_.back()->setBusyPollUs(busyPollUs_);
+  }
+  if (numThreads_ == 0 && busyPollUs_ > 0) {
+    // the base loop does the I/O
+    baseLoop_->setBusyPollUs(busyPollUs_);
   }
   if (numThreads_ == 0 && cb) {
     //没有创建额外的工作线程,并且提供了回调函数
@@ -54,19 +62,34 @@ EventLoop *EventLoopThreadPool::getNextLoop() {
   }
   return loop;
 }
+EventLoop *EventLoopThreadPool::getLoopFor(const InetAddress &peerAddr) {
+  baseLoop_->assertInLoopThread();
+  assert(started_);
+  if (loops_.empty()) {
+    return baseLoop_;
+  }
+  return policy_->select(loops_, peerAddr);
+}
+
 // 每个客户端或连接生成一个固定的事件循环，确保相同的哈希值总是得到相同的 EventLoop
 EventLoop *EventLoopThreadPool::getLoopForHash(size_t hashCode) {
   baseLoop_->assertInLoopThread();
   EventLoop *loop = baseLoop_;
 
   if (!loops_.empty()) {
-    loop = loops_[hashCode % loops_.size()];
+    loop = getLoopForHash(loops_, hashCode);
   }
   return loop;
 }
 
+EventLoop *EventLoopThreadPool::getLoopForHash(
+    const std::vector<EventLoop *> &loops, size_t hashCode) {
+  assert(!loops.empty());
+  return loops[hashCode % loops.size()];
+}
+
 std::vector<EventLoop *> EventLoopThreadPool::getAllLoops() {
-  baseLoop_->assertInLoopThread();
+  // loops_ doesn't change after start()
   assert(started_);
   if (loops_.empty()) {
     return std::vector<EventLoop *>(1, baseLoop_);
@@ -94,6 +94,15 @@ uint32_t InetAddress::ipv4NetEndian() const {
   return addr_.sin_addr.s_addr;
 }
 
+bool InetAddress::isLoopback() const {
+  if (family() == AF_INET) {
+    return (sockets::networkToHost32(addr_.sin_addr.s_addr) >> 24) == 127;
+  }
+  const struct in6_addr &ip = addr6_.sin6_addr;
+  return IN6_IS_ADDR_LOOPBACK(&ip) ||
+         (IN6_IS_ADDR_V4MAPPED(&ip) && ip.s6_addr[12] == 127);
+}
+
 uint16_t InetAddress::port() const {
   return sockets::networkToHost16(portNetEndian());
 }
@@ -0,0 +1,25 @@
+#include "network/Logging.h"
+
+#include <stdlib.h>
+
+namespace network {
+namespace detail {
+
+namespace {
+
+int initLogLevel() {
+  if (::getenv("NETWORK_LOG_TRACE")) {
+    return kLogTrace;
+  } else if (::getenv("NETWORK_LOG_DEBUG")) {
+    return kLogDebug;
+  } else {
+    return kLogOff;
+  }
+}
+
+}  // namespace
+
+std::atomic<int> g_logLevel(initLogLevel());
+
+}  // namespace detail
+}  // namespace network
@@ -0,0 +1,156 @@
+#include "network/LoopPlacement.h"
+
+#include <netinet/in.h>
+
+#include <algorithm>
+#include <functional>
+#include <string>
+
+#include "network/EventLoop.h"
+#include "network/EventLoopThreadPool.h"
+#include "network/InetAddress.h"
+#include "network/util.h"
+
+namespace network {
+
+namespace {
+
+class RoundRobinPolicy : public LoopPlacementPolicy {
+ public:
+  RoundRobinPolicy() : next_(0) {}
+
+  EventLoop *select(const std::vector<EventLoop *> &loops,
+                    const InetAddress &) override {
+    if (next_ >= loops.size()) {
+      next_ = 0;
+    }
+    return loops[next_++];
+  }
+
+ private:
+  size_t next_;
+};
+
+class LeastConnectionsPolicy : public LoopPlacementPolicy {
+ public:
+  LeastConnectionsPolicy() : next_(0) {}
+
+  EventLoop *select(const std::vector<EventLoop *> &loops,
+                    const InetAddress &) override {
+    // start after the last pick, ties go round-robin
+    const size_t n = loops.size();
+    size_t best = next_ % n;
+    for (size_t i = 1; i < n; ++i) {
+      const size_t j = (next_ + i) % n;
+      if (loops[j]->numConnections() < loops[best]->numConnections()) {
+        best = j;
+      }
+    }
+    next_ = best + 1;
+    return loops[best];
+  }
+
+ private:
+  size_t next_;
+};
+
+class PeerHashPolicy : public LoopPlacementPolicy {
+ public:
+  EventLoop *select(const std::vector<EventLoop *> &loops,
+                    const InetAddress &peerAddr) override {
+    return EventLoopThreadPool::getLoopForHash(loops, hashPeerIp(peerAddr));
+  }
+
+ private:
+  // the port is left out, reconnects of a client land on the same loop
+  static size_t hashPeerIp(const InetAddress &peerAddr) {
+    if (peerAddr.family() == AF_INET) {
+      return std::hash<uint32_t>()(peerAddr.ipv4NetEndian());
+    }
+    const struct sockaddr_in6 *addr6 =
+        reinterpret_cast<const struct sockaddr_in6 *>(peerAddr.getSockAddr());
+    return std::hash<std::string>()(
+        std::string(reinterpret_cast<const char *>(&addr6->sin6_addr),
+                    sizeof addr6->sin6_addr));
+  }
+};
+
+}  // namespace
+
+LoopPlacementPolicy::~LoopPlacementPolicy() = default;
+
+std::unique_ptr<LoopPlacementPolicy> LoopPlacementPolicy::newRoundRobin() {
+  return std::unique_ptr<LoopPlacementPolicy>(new RoundRobinPolicy);
+}
+
+std::unique_ptr<LoopPlacementPolicy>
+LoopPlacementPolicy::newLeastConnections() {
+  return std::unique_ptr<LoopPlacementPolicy>(new LeastConnectionsPolicy);
+}
+
+std::unique_ptr<LoopPlacementPolicy>
+LoopPlacementPolicy::newLeastPendingWork() {
+  return std::unique_ptr<LoopPlacementPolicy>(new LeastPendingWorkPolicy);
+}
+
+std::unique_ptr<LoopPlacementPolicy> LoopPlacementPolicy::newPeerHash() {
+  return std::unique_ptr<LoopPlacementPolicy>(new PeerHashPolicy);
+}
+
+LeastPendingWorkPolicy::LeastPendingWorkPolicy(int64_t sampleIntervalMs)
+    : sampleIntervalNs_(std::max<int64_t>(sampleIntervalMs, 1) * 1000000),
+      lastSampleNs_(0) {}
+
+EventLoop *LeastPendingWorkPolicy::select(const std::vector<EventLoop *> &loops,
+                                          const InetAddress &) {
+  const int64_t now = getMonotonicNs();
+  if (samples_.size() != loops.size() ||
+      now - lastSampleNs_ >= sampleIntervalNs_) {
+    resample(loops, now);
+  }
+
+  size_t best = 0;
+  for (size_t i = 1; i < loops.size(); ++i) {
+    if (samples_[i].load < samples_[best].load ||
+        (samples_[i].load == samples_[best].load &&
+         loops[i]->numConnections() < loops[best]->numConnections())) {
+      best = i;
+    }
+  }
+  // until the next sample, account for what the new connection will cost
+  samples_[best].load += samples_[best].perConnection;
+  return loops[best];
+}
+
+void LeastPendingWorkPolicy::resample(const std::vector<EventLoop *> &loops,
+                                      int64_t nowNs) {
+  const bool first = samples_.size() != loops.size();
+  if (first) {
+    samples_.assign(loops.size(), Sample());
+  }
+  const double elapsedNs = static_cast<double>(
+      first ? sampleIntervalNs_ : std::max<int64_t>(nowNs - lastSampleNs_, 1));
+
+  for (size_t i = 0; i < loops.size(); ++i) {
+    const EventLoop::Metrics m = loops[i]->metrics();
+    const int64_t busyNs = m.handleEventTimeNs + m.pendingFunctorsTimeNs;
+    Sample &s = samples_[i];
+    const double busy = first ? 0.0 : (busyNs - s.busyNs) / elapsedNs;
+    // queued functors at their average cost so far
+    const double avgFunctorNs =
+        m.functors > 0
+            ? static_cast<double>(m.pendingFunctorsTimeNs) / m.functors
+            : 0.0;
+    const double backlog =
+        static_cast<double>(loops[i]->queueSize()) * avgFunctorNs / elapsedNs;
+
+    s.busyNs = busyNs;
+    s.load = busy + backlog;
+    // an idle loop still gets some weight per connection, to spread them
+    s.perConnection =
+        std::max(busy / std::max(loops[i]->numConnections(), 1), 1e-3);
+  }
+  lastSampleNs_ = nowNs;
+}
+
+}  // namespace network
@@ -0,0 +1,239 @@
+#include "network/OutputQueue.h"
+
+#include <errno.h>
+#include <limits.h>  // IOV_MAX
+#include <string.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cassert>
+
+#include "network/BufferPool.h"
+#include "network/SocketsOps.h"
+
+namespace network {
+
+const size_t OutputQueue::kSlabSize;
+const size_t OutputQueue::kAppendByRefThreshold;
+const size_t OutputQueue::kMaxBytesPerWrite;
+
+struct OutputQueue::Slab {
+  explicit Slab(size_t size)
+      : capacity(BufferPool::blockSize(size)),
+        used(0),
+        data(BufferPool::allocate(capacity)) {}
+  ~Slab() { BufferPool::deallocate(data, capacity); }
+  Slab(const Slab &) = delete;
+  Slab &operator=(const Slab &) = delete;
+
+  const size_t capacity;
+  size_t used;
+  char *data;
+};
+
+OutputQueue::OutputQueue()
+    : readableBytes_(0),
+      zeroCopyThreshold_(0),
+      nextZeroCopyId_(0),
+      pinnedBytes_(0) {
+  zeroCopyStats_.sends = 0;
+  zeroCopyStats_.completions = 0;
+  zeroCopyStats_.copied = 0;
+}
+
+OutputQueue::~OutputQueue() = default;
+
+OutputQueue::Slab *OutputQueue::writableSlab() {
+  if (!tail_ || tail_->used == tail_->capacity) {
+    tail_ = std::make_shared<Slab>(kSlabSize);
+  }
+  return tail_.get();
+}
+
+void OutputQueue::append(const void *data, size_t len) {
+  const char *p = static_cast<const char *>(data);
+  while (len > 0) {
+    Slab *slab = writableSlab();
+    const size_t n = std::min(len, slab->capacity - slab->used);
+    ::memcpy(slab->data + slab->used, p, n);
+    commit(n);
+    p += n;
+    len -= n;
+  }
+}
+
+char *OutputQueue::reserve(size_t len) {
+  if (!tail_ || tail_->capacity - tail_->used < len) {
+    tail_ = std::make_shared<Slab>(std::max(len, kSlabSize));
+  }
+  return tail_->data + tail_->used;
+}
+
+void OutputQueue::commit(size_t len) {
+  assert(tail_ && len <= tail_->capacity - tail_->used);
+  char *dest = tail_->data + tail_->used;
+  tail_->used += len;
+  readableBytes_ += len;
+  // extend the last segment if it ends right here, in the same slab
+  if (!segments_.empty() && segments_.back().owner == tail_ &&
+      segments_.back().data + segments_.back().len == dest) {
+    segments_.back().len += len;
+  } else {
+    Segment seg = {tail_, dest, len};
+    segments_.push_back(seg);
+  }
+}
+
+void OutputQueue::append(const Slice &slice) {
+  if (slice.size() < kAppendByRefThreshold) {
+    append(slice.data(), slice.size());
+    return;
+  }
+  appendRef(slice);
+}
+
+void OutputQueue::appendRef(const Slice &slice) {
+  if (slice.empty()) {
+    return;
+  }
+  Segment seg = {slice.owner(), slice.data(), slice.size()};
+  segments_.push_back(seg);
+  readableBytes_ += slice.size();
+}
+
+ssize_t OutputQueue::writeFd(int fd, int *savedErrno) {
+#ifdef IOV_MAX
+  const int kMaxIov = IOV_MAX;
+#else
+  const int kMaxIov = 1024;
+#endif
+  assert(!segments_.empty());
+  struct iovec vec[kMaxIov];
+  size_t bytes = 0;
+  const int iovcnt = gather(vec, kMaxIov, &bytes);
+  bool zeroCopy = zeroCopyThreshold_ > 0 && bytes >= zeroCopyThreshold_;
+  ssize_t n = -1;
+  if (zeroCopy) {
+    n = sockets::sendZeroCopy(fd, vec, iovcnt);
+    if (n < 0 && errno == ENOBUFS) {
+      // too many sends waiting for completion (net.core.optmem_max)
+      zeroCopy = false;
+    }
+  }
+  if (!zeroCopy) {
+    n = iovcnt == 1 ? sockets::write(fd, vec[0].iov_base, vec[0].iov_len)
+                    : sockets::writev(fd, vec, iovcnt);
+  }
+  if (n < 0) {
+    *savedErrno = errno;
+  } else {
+    if (zeroCopy && n > 0) {
+      pin(n);
+    }
+    retrieve(n);
+  }
+  return n;
+}
+
+void OutputQueue::pin(size_t len) {
+  Pinned pinned;
+  pinned.id = nextZeroCopyId_++;
+  pinned.bytes = len;
+  for (const Segment &seg : segments_) {
+    if (pinned.owners.empty() || pinned.owners.back() != seg.owner) {
+      pinned.owners.push_back(seg.owner);
+    }
+    if (len <= seg.len) {
+      break;
+    }
+    len -= seg.len;
+  }
+  pinnedBytes_ += pinned.bytes;
+  pinned_.push_back(std::move(pinned));
+  ++zeroCopyStats_.sends;
+}
+
+void OutputQueue::completeZeroCopy(uint32_t lo, uint32_t hi, bool copied) {
+  // ids wrap around, so does the arithmetic
+  const uint32_t count = hi - lo + 1;
+  zeroCopyStats_.completions += count;
+  if (copied) {
+    zeroCopyStats_.copied += count;
+  }
+  for (uint32_t i = 0; i < count && !pinned_.empty(); ++i) {
+    const uint32_t index = lo + i - pinned_.front().id;
+    if (index < pinned_.size()) {
+      Pinned &pinned = pinned_[index];
+      pinnedBytes_ -= pinned.bytes;
+      pinned.bytes = 0;
+      pinned.owners.clear();
+    }
+  }
+  // completions may come out of order, release in order
+  while (!pinned_.empty() && pinned_.front().bytes == 0) {
+    pinned_.pop_front();
+  }
+}
+
+std::vector<std::shared_ptr<const void>> OutputQueue::takePinned() {
+  std::vector<std::shared_ptr<const void>> owners;
+  for (Pinned &pinned : pinned_) {
+    owners.insert(owners.end(), pinned.owners.begin(), pinned.owners.end());
+  }
+  pinned_.clear();
+  pinnedBytes_ = 0;
+  return owners;
+}
+
+int OutputQueue::gather(struct iovec *vec, int maxIov, size_t *bytes) const {
+  int iovcnt = 0;
+  *bytes = 0;
+  for (const Segment &seg : segments_) {
+    // more than the socket buffer takes is wasted work
+    if (iovcnt == maxIov || *bytes >= kMaxBytesPerWrite) {
+      break;
+    }
+    vec[iovcnt].iov_base = const_cast<char *>(seg.data);
+    vec[iovcnt].iov_len = seg.len;
+    *bytes += seg.len;
+    ++iovcnt;
+  }
+  return iovcnt;
+}
+
+int OutputQueue::peekSegments(
+    struct iovec *vec, int maxIov,
+    std::vector<std::shared_ptr<const void>> *owners) const {
+  size_t bytes = 0;
+  const int iovcnt = gather(vec, maxIov, &bytes);
+  for (int i = 0; i < iovcnt; ++i) {
+    const std::shared_ptr<const void> &owner = segments_[i].owner;
+    if (owners->empty() || owners->back() != owner) {
+      owners->push_back(owner);
+    }
+  }
+  return iovcnt;
+}
+
+void OutputQueue::retrieve(size_t len) {
+  assert(len <= readableBytes_);
+  readableBytes_ -= len;
+  while (len > 0) {
+    Segment &seg = segments_.front();
+    if (len < seg.len) {
+      seg.data += len;
+      seg.len -= len;
+      break;
+    }
+    len -= seg.len;
+    segments_.pop_front();
+  }
+  if (segments_.empty()) {
+    // drained, an idle connection holds no output storage
+    tail_.reset();
+  }
+}
+
+void OutputQueue::retrieveAll() { retrieve(readableBytes_); }
+
+}  // namespace network
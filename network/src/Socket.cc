@@ -78,8 +78,8 @@ void Socket::bindAddress(const InetAddress &addr) {
 /// @brief 将套接字设为监听状态，以接受传入的连接请求。
 /// 
 /// 该函数使用 `listen` 系统调用将套接字 `sockfd_` 设置为监听状态，允许它接受传入的连接请求。`SOMAXCONN` 是系统定义的常量，用于指定监听队列的最大长度。如果监听失败，函数将记录一个致命错误并终止程序。
-void Socket::listen() {
-  int ret = ::listen(sockfd_, SOMAXCONN);
+void Socket::listen(int backlog) {
+  int ret = ::listen(sockfd_, backlog);
   if (ret < 0) {
     LOG(FATAL) << "sockets::listenOrDie";
   }
@@ -90,12 +90,8 @@ int Socket::accept(InetAddress *peeraddr) {
   struct sockaddr_in6 addr;
   memset(&addr, 0, sizeof(addr));
 
-  socklen_t addrlen = static_cast<socklen_t>(sizeof(addr));
-  int client_fd =
-      ::accept(sockfd_, reinterpret_cast<sockaddr *>(&addr), &addrlen);
-  if (client_fd < 0) {
-    LOG(ERROR) << "Socket::accept error";
-  }
+  // non-blocking and close-on-exec, errors are logged by sockets::accept
+  int client_fd = sockets::accept(sockfd_, &addr);
   if (client_fd >= 0) {
     peeraddr->setSockAddrInet6(addr);
   }
@@ -158,4 +154,26 @@ void Socket::setKeepAlive(bool on) {
                static_cast<socklen_t>(sizeof optval));
   // FIXME CHECK
 }
+
+/// 设置网卡队列忙轮询时间（微秒）
+bool Socket::setBusyPoll(int usec) {
+#ifdef SO_BUSY_POLL
+  int optval = usec;
+  return ::setsockopt(sockfd_, SOL_SOCKET, SO_BUSY_POLL, &optval,
+                      static_cast<socklen_t>(sizeof optval)) == 0;
+#else
+  return false;
+#endif
+}
+
+bool Socket::setZeroCopy(bool on) {
+#ifdef SO_ZEROCOPY
+  int optval = on ? 1 : 0;
+  return ::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval,
+                      static_cast<socklen_t>(sizeof optval)) == 0;
+#else
+  (void)on;
+  return false;
+#endif
+}
 }  // namespace network
\ No newline at end of file
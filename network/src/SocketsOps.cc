@@ -2,9 +2,12 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/errqueue.h>  // sock_extended_err
+#include <netinet/in.h>
 #include <stdio.h>  // snprintf
+#include <string.h>  // memset
 #include <sys/socket.h>
-#include <sys/uio.h>  // readv
+#include <sys/uio.h>  // readv, writev
 #include <unistd.h>
 
 #include <cassert>
@@ -109,7 +112,9 @@ int sockets::accept(int sockfd, struct sockaddr_in6 *addr) {
 #endif
   if (connfd < 0) {
     int savedErrno = errno;
-    LOG(ERROR) << "Socket::accept";
+    if (savedErrno != EAGAIN) {
+      LOG(ERROR) << "Socket::accept";
+    }
     switch (savedErrno) {
       case EAGAIN:
       case ECONNABORTED:
@@ -152,6 +157,61 @@ ssize_t sockets::readv(int sockfd, const struct iovec *iov, int iovcnt) {
   return ::readv(sockfd, iov, iovcnt);
 }
 
+ssize_t sockets::writev(int sockfd, const struct iovec *iov, int iovcnt) {
+  return ::writev(sockfd, iov, iovcnt);
+}
+
+ssize_t sockets::sendZeroCopy(int sockfd, const struct iovec *iov,
+                              int iovcnt) {
+#ifdef MSG_ZEROCOPY
+  struct msghdr msg;
+  memset(&msg, 0, sizeof msg);
+  msg.msg_iov = const_cast<struct iovec *>(iov);
+  msg.msg_iovlen = iovcnt;
+  return ::sendmsg(sockfd, &msg, MSG_ZEROCOPY | MSG_NOSIGNAL);
+#else
+  return ::writev(sockfd, iov, iovcnt);
+#endif
+}
+
+bool sockets::readZeroCopyCompletion(int sockfd, uint32_t *lo, uint32_t *hi,
+                                     bool *copied) {
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+  char control[128];
+  struct msghdr msg;
+  while (true) {
+    memset(&msg, 0, sizeof msg);
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+    if (::recvmsg(sockfd, &msg, MSG_ERRQUEUE) < 0) {
+      return false;  // EAGAIN, the queue is empty
+    }
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL;
+         cm = CMSG_NXTHDR(&msg, cm)) {
+      if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+            (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+        continue;
+      }
+      const struct sock_extended_err *serr =
+          reinterpret_cast<const struct sock_extended_err *>(CMSG_DATA(cm));
+      if (serr->ee_errno == 0 && serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+        *lo = serr->ee_info;
+        *hi = serr->ee_data;
+        *copied = (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0;
+        return true;
+      }
+    }
+    // not a completion, next one
+  }
+#else
+  (void)sockfd;
+  (void)lo;
+  (void)hi;
+  (void)copied;
+  return false;
+#endif
+}
+
 ssize_t sockets::write(int sockfd, const void *buf, size_t count) {
   return ::write(sockfd, buf, count);
 }
@@ -224,7 +284,6 @@ void sockets::fromIpPort(const char *ip, uint16_t port,
 int sockets::getSocketError(int sockfd) {
   int optval;
   socklen_t optlen = static_cast<socklen_t>(sizeof optval);
-  LOG(INFO) << "111111" << sockfd;
   if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0) {
     return errno;
   } else {
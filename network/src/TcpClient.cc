@@ -47,6 +47,7 @@ TcpClient::TcpClient(EventLoop *loop, const InetAddress &serverAddr,
       messageCallback_(defaultMessageCallback),
       retry_(false),
       connect_(true),
+      edgeTriggered_(false),
       nextConnId_(1) {
   connector_->setNewConnectionCallback(
       std::bind(&TcpClient::newConnection, this, _1));
@@ -118,6 +119,7 @@ void TcpClient::newConnection(int sockfd) {
   TcpConnectionPtr conn(
       new TcpConnection(loop_, connName, sockfd, localAddr, peerAddr));
 
+  conn->setEdgeTriggered(edgeTriggered_);
   conn->setConnectionCallback(connectionCallback_);
   conn->setMessageCallback(messageCallback_);
   conn->setWriteCompleteCallback(writeCompleteCallback_);
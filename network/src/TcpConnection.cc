@@ -1,7 +1,9 @@
 #include "network/TcpConnection.h"
 
 #include <errno.h>
+#include <stdint.h>
 
+#include <algorithm>
 #include <cassert>
 #include <functional>
 #include <string>
@@ -10,13 +12,14 @@
 
 #include "network/Channel.h"
 #include "network/EventLoop.h"
+#include "network/Logging.h"
 #include "network/Socket.h"
 #include "network/SocketsOps.h"
 
 using namespace network;
 namespace network {
 void defaultConnectionCallback(const TcpConnectionPtr &conn) {
-  LOG(INFO) << conn->localAddress().toIpPort() << " -> "
+  LOG_TRACE << conn->localAddress().toIpPort() << " -> "
             << conn->peerAddress().toIpPort() << " is "
             << (conn->connected() ? "UP" : "DOWN");
   // do not call conn->forceClose(), because some users want to register message
@@ -37,20 +40,40 @@ TcpConnection::TcpConnection(EventLoop *loop, const std::string &nameArg,
       socket_(new Socket(sockfd)),
       channel_(new Channel(loop, sockfd)),
       localAddr_(localAddr),
-      peerAddr_(peerAddr) {
+      peerAddr_(peerAddr),
+      highWaterMark_(0),
+      lowWaterMark_(0),
+      maxOutputBytes_(0),
+      outputDropped_(false),
+      pauseReadingAtHighWaterMark_(false),
+      aboveHighWaterMark_(false),
+      readingPaused_(false),
+      peakOutputBytes_(0),
+      highWaterMarks_(0) {
   channel_->setReadCallback(std::bind(&TcpConnection::handleRead, this));
   channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
   channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
   channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
-  LOG(INFO) << "TcpConnection::ctor[" << name_ << "] at " << this
+  // completion based reads and writes on io_uring loops
+  channel_->setAsyncIo(true);
+  LOG_DEBUG << "TcpConnection::ctor[" << name_ << "] at " << this
             << " fd=" << sockfd;
   socket_->setKeepAlive(true);
+  // counted from the creation, placement policies see it right away
+  loop_->addConnections(1);
+  const int64_t busyPollUs = loop->busyPollUs();
+  if (busyPollUs > 0 &&
+      !socket_->setBusyPoll(static_cast<int>(std::min<int64_t>(busyPollUs,
+                                                               INT32_MAX)))) {
+    LOG_FIRST_N(WARNING, 1) << "TcpConnection::ctor SO_BUSY_POLL failed";
+  }
 }
 
 TcpConnection::~TcpConnection() {
-  LOG(INFO) << "TcpConnection::dtor[" << name_ << "] at " << this
+  LOG_DEBUG << "TcpConnection::dtor[" << name_ << "] at " << this
             << " fd=" << channel_->fd() << " state=" << stateToString();
   assert(state_ == kDisconnected);
+  loop_->addConnections(-1);
 }
 
 bool TcpConnection::getTcpInfo(struct tcp_info *tcpi) const {
@@ -64,63 +87,194 @@ std::string TcpConnection::getTcpInfoString() const {
   return buf;
 }
 
-// FIXME efficiency!!!
-void TcpConnection::send(Buffer *buf) {
+void TcpConnection::send(const void *data, size_t len) {
+  if (state_ == kConnected) {
+    if (loop_->isInLoopThread()) {
+      sendInLoop(data, len);
+    } else {
+      send(std::string(static_cast<const char *>(data), len));
+    }
+  }
+}
+
+void TcpConnection::send(const std::string &message) {
+  send(message.data(), message.size());
+}
+
+void TcpConnection::send(Buffer *buf) { send(std::move(*buf)); }
+
+void TcpConnection::send(Buffer &&message) {
+  if (state_ == kConnected) {
+    if (loop_->isInLoopThread() &&
+        message.readableBytes() < OutputQueue::kAppendByRefThreshold) {
+      sendInLoop(message.peek(), message.readableBytes());
+      message.retrieveAll();
+    } else {
+      // take the data without copying it, it may be queued by reference
+      send(Slice::fromBuffer(std::move(message)));
+    }
+  }
+}
+
+void TcpConnection::send(std::string &&message) {
+  if (state_ == kConnected) {
+    if (loop_->isInLoopThread() &&
+        message.size() < OutputQueue::kAppendByRefThreshold) {
+      sendInLoop(message.data(), message.size());
+    } else {
+      send(Slice::fromString(std::move(message)));
+    }
+  }
+}
+
+void TcpConnection::send(const Slice &message) {
   if (state_ == kConnected) {
     if (loop_->isInLoopThread()) {
-      sendInLoop(buf->peek(), buf->readableBytes());
-      buf->retrieveAll();
+      sendSliceInLoop(message);
     } else {
-      std::function<void(const std::string &)> fp =
-          [this](const std::string &str) { this->sendInLoop(str); };
+      // e.g. from a worker thread, the connection may be gone from the
+      // server by the time the loop gets to it
+      TcpConnectionPtr self(shared_from_this());
+      loop_->queueInLoop([self, message] { self->sendSliceInLoop(message); });
+    }
+  }
+}
 
-      loop_->runInLoop(std::bind(fp, buf->retrieveAllAsString()));
+void TcpConnection::send(std::vector<Slice> &&messages) {
+  if (state_ == kConnected) {
+    if (loop_->isInLoopThread()) {
+      sendSlicesInLoop(messages);
+    } else {
+      TcpConnectionPtr self(shared_from_this());
+      loop_->queueInLoop([self, messages = std::move(messages)] {
+        self->sendSlicesInLoop(messages);
+      });
     }
   }
 }
 
+bool TcpConnection::writesAside(size_t len) const {
+  return len < OutputQueue::kAppendByRefThreshold && !channel_->isWriting() &&
+         outputQueue_.empty();
+}
+
+char *TcpConnection::reserveOutput(size_t len) {
+  loop_->assertInLoopThread();
+  if (writesAside(len)) {
+    outputScratch_.ensureWritableBytes(len);
+    return outputScratch_.beginWrite();
+  }
+  return outputQueue_.reserve(len);
+}
+
+void TcpConnection::commitOutput(size_t len) {
+  loop_->assertInLoopThread();
+  if (state_ == kDisconnected || outputDropped_) {
+    LOG_TRACE << "disconnected, give up writing";
+    // nothing goes out any more, let go of the room reserveOutput() took
+    outputQueue_.retrieveAll();
+    outputScratch_.releaseIfEmpty();
+    return;
+  }
+  if (writesAside(len)) {
+    // most likely written at once, a slab of the queue would be taken and
+    // dropped for it
+    sendInLoop(outputScratch_.beginWrite(), len);
+    outputScratch_.releaseIfEmpty();
+    return;
+  }
+  const bool idle = !channel_->isWriting() && outputQueue_.empty();
+  outputQueue_.commit(len);
+  if (idle) {
+    // written from where it lies, what the socket doesn't take stays
+    writeQueued();
+  } else {
+    checkOutput();
+  }
+}
+
 void TcpConnection::sendInLoop(const std::string &message) {
   sendInLoop(message.data(), message.size());
 }
 
 void TcpConnection::sendInLoop(const void *data, size_t len) {
   loop_->assertInLoopThread();
-  ssize_t nwrote = 0;          // 实际写入的字节数
-  size_t remaining = len;      // 剩余要写入的数据长度
-  bool faultError = false;
-  if (state_ == kDisconnected) {
-    LOG(INFO) << "disconnected, give up writing";
+  if (state_ == kDisconnected || outputDropped_) {
+    LOG_TRACE << "disconnected, give up writing";
     return;
   }
-  // if no thing in output queue, try writing directly
-  if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0) {
-    nwrote = sockets::write(channel_->fd(), data, len);
-    if (nwrote >= 0) {
-      remaining = len - nwrote;
-      if (remaining == 0 && writeCompleteCallback_) {
-        loop_->queueInLoop(
-            std::bind(writeCompleteCallback_, shared_from_this()));
-      }
-    } else  // nwrote < 0
-    {
-      nwrote = 0;
-      if (errno != EWOULDBLOCK) {
-        LOG(ERROR) << "TcpConnection::sendInLoop";
-        if (errno == EPIPE || errno == ECONNRESET)  // FIXME: any others?
-        {
-          faultError = true;
-        }
-      }
+  const ssize_t nwrote = writeDirect(data, len);
+  if (nwrote >= 0 && static_cast<size_t>(nwrote) < len) {
+    outputQueue_.append(static_cast<const char *>(data) + nwrote,
+                        len - nwrote);
+    watchOutput();
+  }
+}
+
+void TcpConnection::sendSliceInLoop(const Slice &message) {
+  loop_->assertInLoopThread();
+  if (state_ == kDisconnected || outputDropped_) {
+    LOG_TRACE << "disconnected, give up writing";
+    return;
+  }
+  if (outputQueue_.zeroCopyThreshold() > 0 &&
+      message.size() >= outputQueue_.zeroCopyThreshold() &&
+      !channel_->isWriting() && outputQueue_.empty()) {
+    // straight through the queue, it does the MSG_ZEROCOPY send and keeps
+    // the message until the kernel is done with it
+    outputQueue_.append(message);
+    writeQueued();
+    return;
+  }
+  const ssize_t nwrote = writeDirect(message.data(), message.size());
+  if (nwrote >= 0 && static_cast<size_t>(nwrote) < message.size()) {
+    outputQueue_.append(message.subslice(nwrote, message.size() - nwrote));
+    watchOutput();
+  }
+}
+
+void TcpConnection::sendSlicesInLoop(const std::vector<Slice> &messages) {
+  loop_->assertInLoopThread();
+  if (state_ == kDisconnected || outputDropped_) {
+    LOG_TRACE << "disconnected, give up writing";
+    return;
+  }
+  if (!channel_->isWriting() && outputQueue_.empty()) {
+    // one writev() for all of them, what it leaves stays queued by
+    // reference
+    for (const Slice &message : messages) {
+      outputQueue_.appendRef(message);
+    }
+    writeQueued();
+  } else {
+    for (const Slice &message : messages) {
+      outputQueue_.append(message);
     }
+    checkOutput();
   }
+}
 
-  if (!faultError && remaining > 0) {
-    size_t oldLen = outputBuffer_.readableBytes();
-    outputBuffer_.append(static_cast<const char *>(data) + nwrote, remaining);
-    if (!channel_->isWriting()) {
-      channel_->enableWriting();
+ssize_t TcpConnection::writeDirect(const void *data, size_t len) {
+  // if no thing in output queue, try writing directly
+  // (a completion based write in flight keeps its data queued)
+  if (channel_->isWriting() || !outputQueue_.empty()) {
+    return 0;
+  }
+  ssize_t nwrote = sockets::write(channel_->fd(), data, len);   // 实际写入的字节数
+  if (nwrote >= 0) {
+    if (static_cast<size_t>(nwrote) == len && writeCompleteCallback_) {
+      loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+    }
+    return nwrote;
+  }
+  if (errno != EWOULDBLOCK) {
+    LOG(ERROR) << "TcpConnection::sendInLoop";
+    if (errno == EPIPE || errno == ECONNRESET)  // FIXME: any others?
+    {
+      return -1;
     }
   }
+  return 0;
 }
 
 void TcpConnection::shutdown() {
@@ -177,11 +331,14 @@ void TcpConnection::forceClose() {
 void TcpConnection::forceCloseWithDelay(double seconds) {
   if (state_ == kConnected || state_ == kDisconnecting) {
     setState(kDisconnecting);
-    // loop_->runAfter(
-    //     seconds,
-    //     makeWeakCallback(shared_from_this(),
-    //                      &TcpConnection::forceClose));  // not
-    //                      forceCloseInLoop to avoid race condition
+    std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+    // not forceCloseInLoop to avoid race condition
+    loop_->runAfter(seconds, [weakConn]() {
+      TcpConnectionPtr conn(weakConn.lock());
+      if (conn) {
+        conn->forceClose();
+      }
+    });
   }
 }
 
@@ -210,13 +367,39 @@ const char *TcpConnection::stateToString() const {
 
 void TcpConnection::setTcpNoDelay(bool on) { socket_->setTcpNoDelay(on); }
 
+bool TcpConnection::setZeroCopyThreshold(size_t bytes) {
+  loop_->assertInLoopThread();
+  if (bytes > 0 && channel_->asyncIo()) {
+    LOG_FIRST_N(WARNING, 1) << "TcpConnection::setZeroCopyThreshold ["
+                            << name_ << "] - not with io_uring writes";
+    return false;
+  }
+  if (bytes > 0 && !socket_->setZeroCopy(true)) {
+    LOG(WARNING) << "TcpConnection::setZeroCopyThreshold [" << name_
+                 << "] - SO_ZEROCOPY failed";
+    return false;
+  }
+  // the socket keeps SO_ZEROCOPY, completions of earlier sends still come
+  outputQueue_.setZeroCopyThreshold(bytes);
+  return true;
+}
+
+void TcpConnection::setEdgeTriggered(bool on) {
+  assert(state_ == kConnecting);
+  channel_->setEdgeTriggered(on);
+}
+
+bool TcpConnection::edgeTriggered() const { return channel_->edgeTriggered(); }
+
 void TcpConnection::startRead() {
   loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, this));
 }
 
 void TcpConnection::startReadInLoop() {
   loop_->assertInLoopThread();
-  if (!reading_ || !channel_->isReading()) {
+  if (readingPaused_) {
+    reading_ = true;  // once the output drains
+  } else if (!reading_ || !channel_->isReading()) {
     channel_->enableReading();
     reading_ = true;
   }
@@ -253,56 +436,185 @@ void TcpConnection::connectDestroyed() {
     connectionCallback_(shared_from_this());
   }
   channel_->remove();
+  reapZeroCopy();
+  if (outputQueue_.pinnedBytes() > 0) {
+    // the kernel may still be sending from it after the close
+    std::vector<std::shared_ptr<const void>> pinned =
+        outputQueue_.takePinned();
+    loop_->runAfter(kZeroCopyLingerSec, [pinned] {});
+  }
 }
 
 void TcpConnection::handleRead() {
   loop_->assertInLoopThread();
-  int savedErrno = 0;
-  ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
-  if (n > 0) {
+  const bool edgeTriggered = channel_->edgeTriggered();
+  size_t total = 0;
+  while (true) {
+    int savedErrno = 0;
+    inputBuffer_.ensureWritableBytes(1);  // takes the storage if released
+    const size_t writable = inputBuffer_.writableBytes();
+    ssize_t n =
+        channel_->asyncIo()
+            ? loop_->readChannel(get_pointer(channel_), &inputBuffer_,
+                                 &savedErrno)
+            : inputBuffer_.readFd(channel_->fd(), &savedErrno);
+    if (n > 0) {
+      total += n;
+      messageCallback_(shared_from_this(), &inputBuffer_);
+      // level-triggered: poll again tells if there is more
+      // edge-triggered: a short read means the socket is drained, new data
+      // raises a new edge
+      if (!edgeTriggered || size_t(n) < writable ||
+          state_ == kDisconnected || !channel_->isReading()) {
+        break;
+      }
+      if (total >= kReadBudgetPerEvent) {
+        // no more edge will come for the pending data, continue after
+        // other connections got their turn
+        loop_->queueInLoop(
+            std::bind(&TcpConnection::continueRead, shared_from_this()));
+        break;
+      }
+    } else if (n == 0) {
+      handleClose();
+      break;
+    } else {
+      if (edgeTriggered && savedErrno == EAGAIN) {
+        break;
+      }
+      errno = savedErrno;
+      LOG(ERROR) << "TcpConnection::handleRead";
+      handleError();
+      break;
+    }
+  }
+  // an idle connection holds no input storage
+  inputBuffer_.releaseIfEmpty();
+}
+
+void TcpConnection::continueRead() {
+  if (state_ != kDisconnected && channel_->isReading()) {
+    handleRead();
+  }
+}
+
+void TcpConnection::deliverInput() {
+  if (state_ != kDisconnected && !readingPaused_ &&
+      inputBuffer_.readableBytes() > 0) {
     messageCallback_(shared_from_this(), &inputBuffer_);
-  } else if (n == 0) {
-    handleClose();
-  } else {
-    errno = savedErrno;
-    LOG(ERROR) << "TcpConnection::handleRead";
-    handleError();
+    inputBuffer_.releaseIfEmpty();
   }
 }
 
 void TcpConnection::handleWrite() {
   loop_->assertInLoopThread();
-  if (channel_->isWriting()) {
-    ssize_t n = sockets::write(channel_->fd(), outputBuffer_.peek(),
-                               outputBuffer_.readableBytes());
-    if (n > 0) {
-      outputBuffer_.retrieve(n);
-      if (outputBuffer_.readableBytes() == 0) {
+  if (channel_->asyncIo()) {
+    writeCompleted();
+  } else if (channel_->isWriting()) {
+    writeQueued();
+  } else {
+    LOG_TRACE << "Connection fd = " << channel_->fd()
+              << " is down, no more writing";
+  }
+}
+
+void TcpConnection::watchOutput() {
+  if (channel_->asyncIo()) {
+    writeQueued();
+    return;
+  }
+  if (!channel_->isWriting()) {
+    channel_->enableWriting();
+  }
+  checkOutput();
+}
+
+void TcpConnection::writeQueued() {
+  if (channel_->asyncIo()) {
+    writeQueuedAsync();
+    return;
+  }
+  int savedErrno = 0;
+  ssize_t n = outputQueue_.writeFd(channel_->fd(), &savedErrno);
+  if (n > 0) {
+    if (outputQueue_.empty()) {
+      if (channel_->isWriting()) {
         channel_->disableWriting();
-        if (writeCompleteCallback_) {
-          loop_->queueInLoop(
-              std::bind(writeCompleteCallback_, shared_from_this()));
-        }
-        if (state_ == kDisconnecting) {
-          shutdownInLoop();
-        }
       }
-    } else {
-      LOG(ERROR) << "TcpConnection::handleWrite";
-      // if (state_ == kDisconnecting)
-      // {
-      //   shutdownInLoop();
-      // }
+      if (writeCompleteCallback_) {
+        loop_->queueInLoop(
+            std::bind(writeCompleteCallback_, shared_from_this()));
+      }
+      if (state_ == kDisconnecting) {
+        shutdownInLoop();
+      }
+    } else if (!channel_->isWriting()) {
+      channel_->enableWriting();
     }
+    checkOutput();
+  } else if (savedErrno == EWOULDBLOCK && !channel_->isWriting()) {
+    // from a send, the socket buffer is full
+    channel_->enableWriting();
+    checkOutput();
   } else {
-    LOG(INFO) << "Connection fd = " << channel_->fd()
-              << " is down, no more writing";
+    errno = savedErrno;
+    LOG(ERROR) << "TcpConnection::handleWrite";
+    // if (state_ == kDisconnecting)
+    // {
+    //   shutdownInLoop();
+    // }
+  }
+}
+
+void TcpConnection::writeQueuedAsync() {
+  if (loop_->channelWriting(get_pointer(channel_))) {
+    // one write at a time, writeCompleted() goes on
+    checkOutput();
+    return;
+  }
+  if (outputQueue_.empty()) {
+    if (channel_->isWriting()) {
+      channel_->disableWriting();
+    }
+    if (writeCompleteCallback_) {
+      loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+    }
+    if (state_ == kDisconnecting) {
+      shutdownInLoop();
+    }
+    checkOutput();
+    return;
+  }
+  loop_->writeChannel(get_pointer(channel_), outputQueue_);
+  // marks the output pending, writeCompleted() goes on
+  if (!channel_->isWriting()) {
+    channel_->enableWriting();
+  }
+  checkOutput();
+}
+
+void TcpConnection::writeCompleted() {
+  int savedErrno = 0;
+  const ssize_t n = loop_->takeWrite(get_pointer(channel_), &savedErrno);
+  if (state_ == kDisconnected || outputDropped_) {
+    return;  // a send still in flight when we closed
+  }
+  if (n < 0) {
+    errno = savedErrno;
+    LOG(ERROR) << "TcpConnection::handleWrite";
+    return;
+  }
+  if (n > 0) {
+    outputQueue_.retrieve(n);
+  }
+  if (channel_->isWriting()) {
+    writeQueued();
   }
 }
 
 void TcpConnection::handleClose() {
   loop_->assertInLoopThread();
-  LOG(INFO) << "fd = " << channel_->fd() << " state = " << stateToString();
+  LOG_TRACE << "fd = " << channel_->fd() << " state = " << stateToString();
   assert(state_ == kConnected || state_ == kDisconnecting);
   // we don't close fd, leave it to dtor, so we can find leaks easily.
   setState(kDisconnected);
@@ -315,8 +627,98 @@ void TcpConnection::handleClose() {
 }
 
 void TcpConnection::handleError() {
+  // MSG_ZEROCOPY completions raise POLLERR too
+  const int completions = reapZeroCopy();
+  if (completions > 0) {
+    checkOutput();
+  }
   int err = sockets::getSocketError(channel_->fd());
+  if (err == 0 && completions > 0) {
+    return;
+  }
   LOG(ERROR) << "TcpConnection::handleError [" << name_
              << "] - SO_ERROR = " << err;
 }
+
+void TcpConnection::checkOutput() {
+  if (state_ == kDisconnected || outputDropped_) {
+    return;
+  }
+  const size_t bytes = outputBytes();
+  peakOutputBytes_ = std::max(peakOutputBytes_, bytes);
+  if (maxOutputBytes_ > 0 && bytes >= maxOutputBytes_) {
+    LOG(WARNING) << "TcpConnection::checkOutput [" << name_ << "] - "
+                 << bytes << " bytes of output, closing";
+    outputQueue_.retrieveAll();
+    outputScratch_.releaseIfEmpty();
+    outputDropped_ = true;
+    setState(kDisconnecting);
+    if (channel_->isWriting()) {
+      channel_->disableWriting();
+    }
+    // not right away, this is called from within a send, whose caller may
+    // not outlive the close callbacks
+    loop_->queueInLoop(
+        std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    return;
+  }
+  if (!aboveHighWaterMark_) {
+    if (highWaterMark_ > 0 && bytes >= highWaterMark_) {
+      aboveHighWaterMark_ = true;
+      ++highWaterMarks_;
+      if (highWaterMarkCallback_) {
+        loop_->queueInLoop(
+            std::bind(highWaterMarkCallback_, shared_from_this(), bytes));
+      }
+      if (pauseReadingAtHighWaterMark_) {
+        // also under stopRead(), a startRead() meanwhile must not resume
+        readingPaused_ = true;
+        if (channel_->isReading()) {
+          channel_->disableReading();
+        }
+      }
+    }
+  } else if (bytes <= lowWaterMark_) {
+    aboveHighWaterMark_ = false;
+    if (lowWaterMarkCallback_) {
+      loop_->queueInLoop(
+          std::bind(lowWaterMarkCallback_, shared_from_this(), bytes));
+    }
+    if (readingPaused_) {
+      readingPaused_ = false;
+      // unless stopRead() came meanwhile
+      if (reading_ && !channel_->isReading()) {
+        channel_->enableReading();
+      }
+      if (inputBuffer_.readableBytes() > 0) {
+        loop_->queueInLoop(
+            std::bind(&TcpConnection::deliverInput, shared_from_this()));
+      }
+    }
+  }
+}
+
+TcpConnection::MemoryStats TcpConnection::memoryStats() const {
+  MemoryStats stats;
+  stats.inputBytes = inputBuffer_.internalCapacity();
+  stats.outputBytes = outputBytes();
+  stats.peakOutputBytes = peakOutputBytes_;
+  stats.highWaterMarks = highWaterMarks_;
+  return stats;
+}
+
+int TcpConnection::reapZeroCopy() {
+  if (outputQueue_.zeroCopyThreshold() == 0 &&
+      outputQueue_.pinnedBytes() == 0) {
+    return 0;
+  }
+  int completions = 0;
+  uint32_t lo = 0, hi = 0;
+  bool copied = false;
+  while (sockets::readZeroCopyCompletion(channel_->fd(), &lo, &hi, &copied)) {
+    outputQueue_.completeZeroCopy(lo, hi, copied);
+    ++completions;
+  }
+  return completions;
+}
 }  // namespace network
\ No newline at end of file
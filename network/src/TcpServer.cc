@@ -1,27 +1,73 @@
 #include "network/TcpServer.h"
 
 #include <stdio.h>  // snprintf
+#include <sys/socket.h>  // SOMAXCONN
 
 #include <cassert>
+#include <condition_variable>
+#include <mutex>
 
 #include <glog/logging.h>
 
 #include "network/Acceptor.h"
 #include "network/EventLoop.h"
 #include "network/EventLoopThreadPool.h"
+#include "network/Logging.h"
 #include "network/SocketsOps.h"
 
 using namespace network;
 
+namespace {
+
+// runs cb in the loop thread and waits for it
+void runInLoopAndWait(EventLoop *loop, const std::function<void()> &cb) {
+  if (loop->isInLoopThread()) {
+    cb();
+    return;
+  }
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool done = false;
+  loop->runInLoop([&] {
+    cb();
+    std::unique_lock<std::mutex> lock(mutex);
+    done = true;
+    cv.notify_one();
+  });
+  std::unique_lock<std::mutex> lock(mutex);
+  cv.wait(lock, [&] { return done; });
+}
+
+}  // namespace
+
+/// 一个 I/O loop 自己的 acceptor 和连接，只在该 loop 线程中访问
+struct TcpServer::LoopAcceptor {
+  LoopAcceptor(EventLoop *ioLoop, int idx) : loop(ioLoop), index(idx) {}
+
+  EventLoop *loop;
+  const int index;
+  std::unique_ptr<Acceptor> acceptor;
+  ConnectionMap connections;
+  int nextConnId = 1;
+};
+
 TcpServer::TcpServer(EventLoop *loop, const InetAddress &listenAddr,
                      const std::string &nameArg, Option option)
     : loop_(CHECK_NOTNULL(loop)),
       ipPort_(listenAddr.toIpPort()),
       name_(nameArg),
-      acceptor_(new Acceptor(loop, listenAddr, option == kReusePort)),
+      acceptor_(new Acceptor(loop, listenAddr, option != kNoReusePort)),
       threadPool_(new EventLoopThreadPool(loop, name_)),
       connectionCallback_(defaultConnectionCallback),
       messageCallback_(defaultMessageCallback),
+      option_(option),
+      cpuSteering_(false),
+      listenBacklog_(SOMAXCONN),
+      maxAcceptsPerEvent_(Acceptor::kDefaultMaxAcceptsPerEvent),
+      acceptRate_(0),
+      acceptBurst_(0),
+      dropExcessAccepts_(false),
+      edgeTriggered_(false),
       nextConnId_(1) {
   acceptor_->setNewConnectionCallback(
       std::bind(&TcpServer::newConnection, this, _1, _2));
@@ -37,6 +83,26 @@ TcpServer::~TcpServer() {
     conn->getLoop()->runInLoop(
         std::bind(&TcpConnection::connectDestroyed, conn));
   }
+  for (auto &la : loopAcceptors_) {
+    // the acceptor channel and the connection map belong to the I/O loop
+    LoopAcceptor *p = la.get();
+    runInLoopAndWait(p->loop, [p] {
+      p->acceptor.reset();
+      for (auto &item : p->connections) {
+        item.second->connectDestroyed();
+      }
+      p->connections.clear();
+    });
+  }
+}
+
+void TcpServer::setBusyPollUs(int64_t windowUs) {
+  threadPool_->setBusyPollUs(windowUs);
+}
+
+void TcpServer::setPlacementPolicy(
+    std::unique_ptr<LoopPlacementPolicy> policy) {
+  threadPool_->setPlacementPolicy(std::move(policy));
 }
 
 void TcpServer::setThreadNum(int numThreads) {
@@ -54,32 +120,111 @@ void TcpServer::start() {
 
   assert(!acceptor_->listening());
 
+  if (option_ == kReusePortPerLoop && threadPool_->getAllLoops()[0] != loop_) {
+    // the base socket stays bound, holding the port, but doesn't listen
+    startLoopAcceptors();
+    return;
+  }
+  configureAcceptor(get_pointer(acceptor_), 1);
   loop_->runInLoop(std::bind(&Acceptor::listen, get_pointer(acceptor_)));
 }
 
+void TcpServer::configureAcceptor(Acceptor *acceptor, int numAcceptors) {
+  acceptor->setBacklog(listenBacklog_);
+  acceptor->setMaxAcceptsPerEvent(maxAcceptsPerEvent_);
+  if (acceptRate_ > 0) {
+    acceptor->setRateLimit(acceptRate_ / numAcceptors,
+                           acceptBurst_ / numAcceptors, dropExcessAccepts_);
+  }
+}
+
+AcceptStats TcpServer::acceptStats() const {
+  AcceptStats total = acceptor_->stats();
+  for (const auto &la : loopAcceptors_) {
+    const AcceptStats s = la->acceptor->stats();
+    total.accepted += s.accepted;
+    total.deferred += s.deferred;
+    total.dropped += s.dropped;
+  }
+  return total;
+}
+
+void TcpServer::startLoopAcceptors() {
+  const InetAddress listenAddr = acceptor_->localAddress();
+  std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+  for (size_t i = 0; i < loops.size(); ++i) {
+    LoopAcceptor *la = new LoopAcceptor(loops[i], static_cast<int>(i));
+    loopAcceptors_.emplace_back(la);
+    la->acceptor.reset(new Acceptor(la->loop, listenAddr, true));
+    la->acceptor->setNewConnectionCallback(
+        std::bind(&TcpServer::newConnectionInLoop, this, la, _1, _2));
+    configureAcceptor(get_pointer(la->acceptor),
+                      static_cast<int>(loops.size()));
+    // one after another, the kernel indexes the group in listen() order
+    runInLoopAndWait(la->loop,
+                     std::bind(&Acceptor::listen, get_pointer(la->acceptor)));
+  }
+  if (cpuSteering_ &&
+      !loopAcceptors_[0]->acceptor->attachCpuSteering(
+          static_cast<int>(loopAcceptors_.size()))) {
+    LOG(ERROR) << "TcpServer::start [" << name_
+               << "] - SO_ATTACH_REUSEPORT_CBPF failed";
+  }
+}
+
 
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr) {
   loop_->assertInLoopThread();
-  EventLoop *ioLoop = threadPool_->getNextLoop();
+  EventLoop *ioLoop = threadPool_->getLoopFor(peerAddr);
   char buf[64];
   snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
   ++nextConnId_;
   std::string connName = name_ + buf;
 
-  LOG(INFO) << "TcpServer::newConnection [" << name_ << "] - new connection ["
+  LOG_DEBUG << "TcpServer::newConnection [" << name_ << "] - new connection ["
             << connName << "] from " << peerAddr.toIpPort();
+  TcpConnectionPtr conn = createConnection(ioLoop, connName, sockfd, peerAddr);
+  connections_[connName] = conn;
+  conn->setCloseCallback(
+      std::bind(&TcpServer::removeConnection, this, _1));  // FIXME: unsafe
+  ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+}
+
+void TcpServer::newConnectionInLoop(LoopAcceptor *la, int sockfd,
+                                    const InetAddress &peerAddr) {
+  la->loop->assertInLoopThread();
+  char buf[64];
+  snprintf(buf, sizeof buf, "-%s#%d.%d", ipPort_.c_str(), la->index,
+           la->nextConnId);
+  ++la->nextConnId;
+  std::string connName = name_ + buf;
+
+  LOG_DEBUG << "TcpServer::newConnectionInLoop [" << name_
+            << "] - new connection [" << connName << "] from "
+            << peerAddr.toIpPort();
+  TcpConnectionPtr conn =
+      createConnection(la->loop, connName, sockfd, peerAddr);
+  la->connections[connName] = conn;
+  // closed in the same loop, no trip through the base loop
+  conn->setCloseCallback(
+      std::bind(&TcpServer::removeLoopConnection, this, la, _1));
+  conn->connectEstablished();
+}
+
+TcpConnectionPtr TcpServer::createConnection(EventLoop *ioLoop,
+                                             const std::string &connName,
+                                             int sockfd,
+                                             const InetAddress &peerAddr) {
   InetAddress localAddr(sockets::getLocalAddr(sockfd));
   // FIXME poll with zero timeout to double confirm the new connection
   // FIXME use make_shared if necessary
   TcpConnectionPtr conn(
       new TcpConnection(ioLoop, connName, sockfd, localAddr, peerAddr));
-  connections_[connName] = conn;
+  conn->setEdgeTriggered(edgeTriggered_);
   conn->setConnectionCallback(connectionCallback_);
   conn->setMessageCallback(messageCallback_);
   conn->setWriteCompleteCallback(writeCompleteCallback_);
-  conn->setCloseCallback(
-      std::bind(&TcpServer::removeConnection, this, _1));  // FIXME: unsafe
-  ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+  return conn;
 }
 
 
@@ -90,7 +235,7 @@ void TcpServer::removeConnection(const TcpConnectionPtr &conn) {
 
 void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn) {
   loop_->assertInLoopThread();
-  LOG(INFO) << "TcpServer::removeConnectionInLoop [" << name_
+  LOG_DEBUG << "TcpServer::removeConnectionInLoop [" << name_
             << "] - connection " << conn->name();
   size_t n = connections_.erase(conn->name());
   (void)n;
@@ -98,3 +243,14 @@ void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn) {
   EventLoop *ioLoop = conn->getLoop();
   ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
 }
+
+void TcpServer::removeLoopConnection(LoopAcceptor *la,
+                                     const TcpConnectionPtr &conn) {
+  la->loop->assertInLoopThread();
+  LOG_DEBUG << "TcpServer::removeLoopConnection [" << name_
+            << "] - connection " << conn->name();
+  size_t n = la->connections.erase(conn->name());
+  (void)n;
+  assert(n == 1);
+  la->loop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+}
@@ -0,0 +1,193 @@
+#include "network/TimerQueue.h"
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cassert>
+
+#include <glog/logging.h>
+
+#include "network/EventLoop.h"
+#include "network/util.h"
+
+namespace network {
+
+std::atomic<int64_t> Timer::s_numCreated_;
+
+namespace detail {
+
+int createTimerfd() {
+  int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timerfd < 0) {
+    LOG(FATAL) << "Failed in timerfd_create";
+  }
+  return timerfd;
+}
+
+void readTimerfd(int timerfd) {
+  uint64_t howmany;
+  ssize_t n = ::read(timerfd, &howmany, sizeof howmany);
+  if (n != sizeof howmany) {
+    LOG(ERROR) << "TimerQueue::handleRead() reads " << n
+               << " bytes instead of 8";
+  }
+}
+
+// 以 CLOCK_MONOTONIC 的绝对时间设置 timerfd
+void armTimerfd(int timerfd, int64_t whenMs) {
+  struct itimerspec newValue;
+  ::memset(&newValue, 0, sizeof newValue);
+  newValue.it_value.tv_sec = static_cast<time_t>(whenMs / 1000);
+  newValue.it_value.tv_nsec = static_cast<long>(whenMs % 1000 * 1000000);
+  if (::timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &newValue, NULL) < 0) {
+    LOG(ERROR) << "timerfd_settime()";
+  }
+}
+
+}  // namespace detail
+
+TimerQueue::TimerQueue(EventLoop *loop)
+    : loop_(loop),
+      timerfd_(detail::createTimerfd()),
+      timerfdChannel_(loop, timerfd_),
+      wheel_(getMonotonicMs()),
+      armedTick_(TimingWheel::kNever) {
+  timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
+  // we are always reading the timerfd, we disarm it with timerfd_settime.
+  timerfdChannel_.enableReading();
+}
+
+TimerQueue::~TimerQueue() {
+  timerfdChannel_.disableAll();
+  timerfdChannel_.remove();
+  ::close(timerfd_);
+  // timers_ are deleted by unique_ptr
+}
+
+TimerId TimerQueue::addTimer(TimerCallback cb, int64_t delayMs,
+                             int64_t intervalMs) {
+  const int64_t when = getMonotonicMs() + (delayMs > 0 ? delayMs : 0);
+  if (loop_->isInLoopThread()) {
+    Timer *timer = allocTimer();
+    timer->reset(std::move(cb), when, intervalMs);
+    addTimerInLoop(timer);
+    return TimerId(timer, timer->sequence());
+  }
+
+  // the free list belongs to the loop thread
+  Timer *timer = new Timer;
+  timer->reset(std::move(cb), when, intervalMs);
+  timer->set_state(Timer::kPending);
+  TimerId timerId(timer, timer->sequence());
+  loop_->runInLoop(std::bind(&TimerQueue::adoptTimerInLoop, this, timer));
+  return timerId;
+}
+
+void TimerQueue::cancel(TimerId timerId) {
+  loop_->runInLoop(std::bind(&TimerQueue::cancelInLoop, this, timerId));
+}
+
+void TimerQueue::adoptTimerInLoop(Timer *timer) {
+  loop_->assertInLoopThread();
+  timers_.emplace_back(timer);
+  if (timer->canceled()) {
+    releaseTimer(timer);
+  } else {
+    addTimerInLoop(timer);
+  }
+}
+
+void TimerQueue::addTimerInLoop(Timer *timer) {
+  loop_->assertInLoopThread();
+  if (wheel_.empty()) {
+    // an idle wheel may lag behind, catch up before linking
+    wheel_.advance(getMonotonicMs(), &expired_);
+  }
+  timer->set_state(Timer::kLinked);
+  wheel_.add(timer);
+  resetTimerfd();
+}
+
+void TimerQueue::cancelInLoop(TimerId timerId) {
+  loop_->assertInLoopThread();
+  Timer *timer = timerId.timer_;
+  if (timer == NULL || timer->sequence() != timerId.sequence_) {
+    // already expired or canceled, the Timer has been recycled
+    return;
+  }
+  switch (timer->state()) {
+    case Timer::kPending:
+    case Timer::kRunning:
+      // released by adoptTimerInLoop() or runExpired()
+      timer->cancel();
+      break;
+    case Timer::kLinked:
+      wheel_.remove(timer);
+      releaseTimer(timer);
+      break;
+    case Timer::kExpired:
+      timer->unlink();
+      releaseTimer(timer);
+      break;
+    case Timer::kIdle:
+      break;
+  }
+}
+
+void TimerQueue::handleRead() {
+  loop_->assertInLoopThread();
+  detail::readTimerfd(timerfd_);
+  armedTick_ = TimingWheel::kNever;
+
+  const int64_t now = getMonotonicMs();
+  wheel_.advance(now, &expired_);
+  runExpired(now);
+  resetTimerfd();
+}
+
+void TimerQueue::runExpired(int64_t now) {
+  for (TimerNode *node = expired_.next; node != &expired_; node = node->next) {
+    static_cast<Timer *>(node)->set_state(Timer::kExpired);
+  }
+
+  // a callback may cancel other expired timers, always take the front one
+  while (!expired_.empty()) {
+    Timer *timer = static_cast<Timer *>(expired_.next);
+    timer->unlink();
+    timer->set_state(Timer::kRunning);
+    timer->run();
+    if (timer->repeat() && !timer->canceled()) {
+      timer->restart(now);
+      timer->set_state(Timer::kLinked);
+      wheel_.add(timer);
+    } else {
+      releaseTimer(timer);
+    }
+  }
+}
+
+void TimerQueue::resetTimerfd() {
+  const int64_t next = wheel_.nextTick();
+  // a later wake-up is left armed, handleRead() copes with a spurious one
+  if (next < armedTick_) {
+    armedTick_ = next;
+    detail::armTimerfd(timerfd_, next);
+  }
+}
+
+Timer *TimerQueue::allocTimer() {
+  if (freeTimers_.empty()) {
+    timers_.emplace_back(new Timer);
+    return timers_.back().get();
+  }
+  Timer *timer = freeTimers_.back();
+  freeTimers_.pop_back();
+  return timer;
+}
+
+void TimerQueue::releaseTimer(Timer *timer) {
+  timer->clear();
+  freeTimers_.push_back(timer);
+}
+
+}  // namespace network
@@ -0,0 +1,166 @@
+#include "network/TimingWheel.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace network {
+
+const int64_t TimingWheel::kNever;
+
+namespace {
+
+// 在位图中查找 >= start 的第一个置位，没有则返回 -1
+int findNextSet(const uint64_t *words, int nbits, int start) {
+  int w = start >> 6;
+  uint64_t bits = words[w] & (~UINT64_C(0) << (start & 63));
+  while (true) {
+    if (bits) {
+      return (w << 6) + __builtin_ctzll(bits);
+    }
+    if (++w >= (nbits >> 6)) {
+      return -1;
+    }
+    bits = words[w];
+  }
+}
+
+}  // namespace
+
+TimingWheel::TimingWheel(int64_t nowTick) : currentTick_(nowTick), size_(0) {
+  ::memset(occupied_, 0, sizeof occupied_);
+}
+
+TimingWheel::~TimingWheel() {}
+
+void TimingWheel::add(Timer *timer) {
+  int64_t expires = timer->expiration();
+  int64_t idx = expires - currentTick_;
+  int bucket;
+  if (idx < kRootSize) {
+    if (idx < 0) {
+      // already expired, fire on the next tick
+      expires = currentTick_;
+    }
+    bucket = static_cast<int>(expires & (kRootSize - 1));
+  } else {
+    const int64_t kMaxIdx =
+        (INT64_C(1) << (kRootBits + (kNumLevels - 1) * kLevelBits)) - 1;
+    if (idx > kMaxIdx) {
+      // too far away, re-linked when cascading
+      idx = kMaxIdx;
+      expires = currentTick_ + kMaxIdx;
+    }
+    int level = 1;
+    int shift = kRootBits;
+    while (idx >= (INT64_C(1) << (shift + kLevelBits))) {
+      ++level;
+      shift += kLevelBits;
+    }
+    bucket = kRootSize + (level - 1) * kLevelSize +
+             static_cast<int>((expires >> shift) & (kLevelSize - 1));
+  }
+  link(bucket, timer);
+  ++size_;
+}
+
+void TimingWheel::remove(Timer *timer) {
+  const int bucket = timer->bucket();
+  assert(0 <= bucket && bucket < kNumBuckets);
+  timer->unlink();
+  timer->set_bucket(-1);
+  if (buckets_[bucket].empty()) {
+    occupied_[bucket >> 6] &= ~(UINT64_C(1) << (bucket & 63));
+  }
+  assert(size_ > 0);
+  --size_;
+}
+
+void TimingWheel::link(int bucket, Timer *timer) {
+  buckets_[bucket].pushBack(timer);
+  timer->set_bucket(bucket);
+  occupied_[bucket >> 6] |= UINT64_C(1) << (bucket & 63);
+}
+
+// 把上层桶中的定时器按当前 tick 重新分配到下层
+void TimingWheel::cascade(int level, int64_t tick) {
+  const int shift = kRootBits + (level - 1) * kLevelBits;
+  const int bucket = kRootSize + (level - 1) * kLevelSize +
+                     static_cast<int>((tick >> shift) & (kLevelSize - 1));
+  TimerNode list;
+  list.splice(&buckets_[bucket]);
+  occupied_[bucket >> 6] &= ~(UINT64_C(1) << (bucket & 63));
+  while (!list.empty()) {
+    Timer *timer = static_cast<Timer *>(list.next);
+    timer->unlink();
+    --size_;
+    add(timer);
+  }
+}
+
+void TimingWheel::advance(int64_t nowTick, TimerNode *expired) {
+  while (currentTick_ <= nowTick) {
+    const int64_t next = nextTick();
+    if (next > nowTick) {
+      // nothing linked is due in between, skip the empty ticks
+      currentTick_ = nowTick + 1;
+      break;
+    }
+    currentTick_ = next;
+
+    for (int level = 1; level < kNumLevels; ++level) {
+      const int shift = kRootBits + (level - 1) * kLevelBits;
+      if (currentTick_ & ((INT64_C(1) << shift) - 1)) {
+        break;
+      }
+      cascade(level, currentTick_);
+    }
+
+    const int root = static_cast<int>(currentTick_ & (kRootSize - 1));
+    TimerNode *bucket = &buckets_[root];
+    for (TimerNode *node = bucket->next; node != bucket; node = node->next) {
+      static_cast<Timer *>(node)->set_bucket(-1);
+      --size_;
+    }
+    expired->splice(bucket);
+    occupied_[root >> 6] &= ~(UINT64_C(1) << (root & 63));
+    ++currentTick_;
+  }
+}
+
+int64_t TimingWheel::nextTickOfLevel(int level) const {
+  const int shift = level == 0 ? 0 : kRootBits + (level - 1) * kLevelBits;
+  const int slots = level == 0 ? kRootSize : kLevelSize;
+  const uint64_t *words =
+      level == 0 ? occupied_ : occupied_ + kRootSize / 64 + level - 1;
+
+  // a bucket of this level is handled on a multiple of its span,
+  // find the first one at or after the current tick.
+  const int64_t start = (currentTick_ + (INT64_C(1) << shift) - 1) >> shift;
+  const int startIdx = static_cast<int>(start & (slots - 1));
+  int64_t unit = 0;
+  int slot = findNextSet(words, slots, startIdx);
+  if (slot >= 0) {
+    unit = start + (slot - startIdx);
+  } else {
+    slot = findNextSet(words, slots, 0);
+    if (slot < 0) {
+      return kNever;
+    }
+    unit = start + (slots - startIdx) + slot;
+  }
+  return unit << shift;
+}
+
+int64_t TimingWheel::nextTick() const {
+  int64_t next = kNever;
+  if (size_ > 0) {
+    for (int level = 0; level < kNumLevels; ++level) {
+      next = std::min(next, nextTickOfLevel(level));
+    }
+  }
+  return next;
+}
+
+}  // namespace network
@@ -0,0 +1,635 @@
+#include "network/UringPoller.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+
+#include <glog/logging.h>
+
+#include "network/Buffer.h"
+#include "network/Channel.h"
+#include "network/OutputQueue.h"
+
+using namespace network;
+
+namespace {
+const int kNew = -1;
+const int kAdded = 1;
+
+const unsigned kRequiredFeatures =
+    IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_POLL_32BITS;
+
+int ioUringSetup(unsigned entries, struct io_uring_params *params) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete,
+                 unsigned flags, void *arg, size_t argSize) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit,
+                                    minComplete, flags, arg, argSize));
+}
+
+int ioUringRegister(int fd, unsigned opcode, void *arg, unsigned nrArgs) {
+  return static_cast<int>(
+      ::syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+
+// kind of request, in user_data
+enum Op {
+  kPollOp = 0,
+  kRecvOp = 1,
+  kWriteOp = 2,
+};
+
+const uint32_t kTagMask = (1u << 30) - 1;
+
+// user_data of a request: fd in the high half, the op and a tag in the low
+// one. The tag is the generation of polls and receives, the request of
+// writes. 0 is never a valid poll generation, it marks
+// completions we ignore.
+inline uint64_t makeUserData(int fd, Op op, uint32_t tag) {
+  return (static_cast<uint64_t>(fd) << 32) |
+         (static_cast<uint32_t>(op) << 30) | (tag & kTagMask);
+}
+
+inline void nextGeneration(uint32_t *generation) {
+  if (++*generation > kTagMask) {
+    *generation = 1;
+  }
+}
+
+inline unsigned loadAcquire(const unsigned *p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+inline void storeRelease(unsigned *p, unsigned v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+}  // namespace
+
+namespace network {
+
+struct UringPoller::WriteRequest {
+  struct msghdr msg;
+  struct iovec iov[kMaxWriteSegments];
+  // keep the data of the segments alive until the send completes
+  std::vector<std::shared_ptr<const void>> owners;
+};
+
+UringPoller::UringPoller(EventLoop *loop)
+    : Poller(loop, EventLoop::kIoUringPoller),
+      ringFd_(-1),
+      sqRing_(MAP_FAILED),
+      sqRingSize_(0),
+      cqRing_(MAP_FAILED),
+      cqRingSize_(0),
+      sqes_(NULL),
+      sqesSize_(0),
+      sqeTail_(0),
+      toSubmit_(0),
+      asyncIo_(false),
+      recvRing_(NULL),
+      recvRingSize_(0),
+      recvRingTail_(0),
+      recvBuffers_(NULL),
+      writesInFlight_(0) {
+  struct io_uring_params params;
+  ::memset(&params, 0, sizeof params);
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = kCqEntries;
+  // the ring fd is close-on-exec
+  ringFd_ = ioUringSetup(kSqEntries, &params);
+  if (ringFd_ < 0) {
+    LOG(FATAL) << "UringPoller::UringPoller io_uring_setup errno=" << errno;
+  }
+
+  sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (singleMmap) {
+    sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+  }
+  sqRing_ = ::mmap(NULL, sqRingSize_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+  if (sqRing_ == MAP_FAILED) {
+    LOG(FATAL) << "UringPoller::UringPoller mmap sq ring";
+  }
+  if (singleMmap) {
+    cqRing_ = sqRing_;
+  } else {
+    cqRing_ = ::mmap(NULL, cqRingSize_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+    if (cqRing_ == MAP_FAILED) {
+      LOG(FATAL) << "UringPoller::UringPoller mmap cq ring";
+    }
+  }
+  sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  void *sqes = ::mmap(NULL, sqesSize_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    LOG(FATAL) << "UringPoller::UringPoller mmap sqes";
+  }
+  sqes_ = static_cast<struct io_uring_sqe *>(sqes);
+
+  char *sq = static_cast<char *>(sqRing_);
+  sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sqFlags_ = reinterpret_cast<unsigned *>(sq + params.sq_off.flags);
+  sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  sqMask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sqEntries_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_entries);
+  sqeTail_ = *sqTail_;
+
+  char *cq = static_cast<char *>(cqRing_);
+  cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cqMask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+  setupAsyncIo();
+}
+
+void UringPoller::setupAsyncIo() {
+  // receives pick a provided buffer when data arrives
+  recvRingSize_ = kRecvBuffers * sizeof(struct io_uring_buf);
+  void *ring = ::mmap(NULL, recvRingSize_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring == MAP_FAILED) {
+    LOG(WARNING) << "UringPoller - mmap buffer ring failed, channels poll";
+    return;
+  }
+  struct io_uring_buf_reg reg;
+  ::memset(&reg, 0, sizeof reg);
+  reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+  reg.ring_entries = kRecvBuffers;
+  reg.bgid = kRecvGroup;
+  if (ioUringRegister(ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    LOG(WARNING) << "UringPoller - no provided buffer ring, errno=" << errno
+                 << ", channels poll";
+    ::munmap(ring, recvRingSize_);
+    return;
+  }
+  recvRing_ = static_cast<struct io_uring_buf_ring *>(ring);
+  void *buffers = ::mmap(NULL, kRecvBuffers * kRecvBufferSize,
+                         PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                         -1, 0);
+  if (buffers == MAP_FAILED) {
+    LOG(FATAL) << "UringPoller - mmap receive buffers";
+  }
+  recvBuffers_ = static_cast<char *>(buffers);
+  for (unsigned bid = 0; bid < kRecvBuffers; ++bid) {
+    recycleRecvBuffer(static_cast<int>(bid));
+  }
+  asyncIo_ = true;
+}
+
+UringPoller::~UringPoller() {
+  // the kernel may still read the data of a send after the ring is closed,
+  // its owners are only let go once it completed
+  for (size_t fd = 0; fd < entries_.size(); ++fd) {
+    if (entries_[fd].writeRequest >= 0) {
+      cancel(makeUserData(static_cast<int>(fd), kWriteOp,
+                          entries_[fd].writeRequest));
+    }
+  }
+  for (int i = 0; writesInFlight_ > 0 && i < 100; ++i) {
+    enter(toSubmit_, true, 10);
+    unsigned head = *cqHead_;
+    const unsigned tail = loadAcquire(cqTail_);
+    for (; head != tail; ++head) {
+      const uint64_t userData = cqes_[head & cqMask_].user_data;
+      if (userData != 0 && ((userData >> 30) & 3) == kWriteOp) {
+        releaseWrite(static_cast<int>(userData & kTagMask));
+      }
+    }
+    storeRelease(cqHead_, head);
+  }
+  if (writesInFlight_ > 0) {
+    LOG(ERROR) << "UringPoller::~UringPoller " << writesInFlight_
+               << " sends didn't complete";
+  }
+  if (toSubmit_ > 0) {
+    // pending POLL_REMOVEs release the files they hold sooner
+    enter(toSubmit_, false, 0);
+  }
+  ::munmap(sqes_, sqesSize_);
+  if (cqRing_ != sqRing_) {
+    ::munmap(cqRing_, cqRingSize_);
+  }
+  ::munmap(sqRing_, sqRingSize_);
+  ::close(ringFd_);
+  if (recvRing_ != NULL) {
+    ::munmap(recvRing_, recvRingSize_);
+    ::munmap(recvBuffers_, kRecvBuffers * kRecvBufferSize);
+  }
+}
+
+bool UringPoller::isSupported() {
+  struct io_uring_params params;
+  ::memset(&params, 0, sizeof params);
+  // may also fail with EPERM, e.g. disabled by sysctl or seccomp
+  int fd = ioUringSetup(2, &params);
+  if (fd < 0) {
+    return false;
+  }
+  ::close(fd);
+  return (params.features & kRequiredFeatures) == kRequiredFeatures;
+}
+
+void UringPoller::poll(int timeoutMs, ChannelList *activeChannels) {
+  // re-arm the one-shot requests completed last time, still interested
+  for (int fd : rearm_) {
+    Entry &e = entries_[fd];
+    if (e.channel == NULL) {
+      continue;
+    }
+    if (e.channel->asyncIo()) {
+      armAsync(fd, e);
+    } else if (!e.armed && !e.channel->isNoneEvent()) {
+      arm(fd, e, e.channel->events());
+    }
+  }
+  rearm_.clear();
+
+  const bool ready = !ready_.empty() || loadAcquire(cqTail_) != *cqHead_;
+  const bool wait = !ready && timeoutMs != 0;
+  const bool overflow = __atomic_load_n(sqFlags_, __ATOMIC_RELAXED) &
+                        IORING_SQ_CQ_OVERFLOW;
+  // nothing to submit and not blocking: just peek the completion ring
+  if (toSubmit_ > 0 || wait || overflow) {
+    if (enter(toSubmit_, wait, timeoutMs) < 0) {
+      int savedErrno = errno;
+      if (savedErrno != ETIME && savedErrno != EINTR) {
+        LOG(ERROR) << "UringPoller::poll() errno=" << savedErrno;
+      }
+    }
+  }
+  fillActiveChannels(activeChannels);
+}
+
+int UringPoller::enter(unsigned toSubmit, bool wait, int timeoutMs) {
+  storeRelease(sqTail_, sqeTail_);
+
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  ::memset(&arg, 0, sizeof arg);
+  if (wait && timeoutMs > 0) {
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+  }
+  // GETEVENTS also flushes the completions overflowed from the CQ ring
+  int ret = ioUringEnter(ringFd_, toSubmit, wait ? 1 : 0,
+                         IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+                         sizeof arg);
+  toSubmit_ = sqeTail_ - loadAcquire(sqHead_);
+  return ret;
+}
+
+void UringPoller::fillActiveChannels(ChannelList *activeChannels) {
+  // receives completed while the channel wasn't reading
+  for (int fd : ready_) {
+    Entry &e = entries_[fd];
+    if (e.channel != NULL && e.recvDone && e.channel->isReading()) {
+      complete(fd, e, POLLIN);
+    }
+  }
+  ready_.clear();
+
+  unsigned head = *cqHead_;
+  const unsigned tail = loadAcquire(cqTail_);
+  for (; head != tail; ++head) {
+    const struct io_uring_cqe *cqe = &cqes_[head & cqMask_];
+    const uint64_t userData = cqe->user_data;
+    if (userData == 0) {
+      continue;  // completion of a POLL_REMOVE or ASYNC_CANCEL
+    }
+    const size_t fd = static_cast<size_t>(userData >> 32);
+    const Op op = static_cast<Op>((userData >> 30) & 3);
+    const uint32_t tag = static_cast<uint32_t>(userData) & kTagMask;
+    Entry *e = fd < entries_.size() ? &entries_[fd] : NULL;
+    if (op == kRecvOp) {
+      const int bid = (cqe->flags & IORING_CQE_F_BUFFER)
+                          ? static_cast<int>(cqe->flags >>
+                                             IORING_CQE_BUFFER_SHIFT)
+                          : -1;
+      if (e == NULL || e->channel == NULL || !e->recvArmed ||
+          e->recvGeneration != tag) {
+        if (bid >= 0) {
+          recycleRecvBuffer(bid);  // canceled or removed in the meantime
+        }
+        continue;
+      }
+      e->recvArmed = false;
+      if (cqe->res == -ENOBUFS) {
+        // every provided buffer holds data, poll and read(2) this time
+        e->recvFallback = true;
+        rearm_.push_back(static_cast<int>(fd));
+      } else if (cqe->res == -EAGAIN) {
+        armRecv(static_cast<int>(fd), *e, true);
+      } else {
+        e->recvDone = true;
+        e->recvResult = cqe->res;
+        e->recvBuffer = bid;
+        if (e->channel->isReading()) {
+          complete(static_cast<int>(fd), *e, POLLIN);
+        }
+      }
+    } else if (op == kWriteOp) {
+      releaseWrite(static_cast<int>(tag));
+      if (e == NULL || e->channel == NULL ||
+          e->writeRequest != static_cast<int>(tag)) {
+        continue;  // canceled
+      }
+      e->writeRequest = -1;
+      e->writeDone = true;
+      e->writeResult = cqe->res;
+      complete(static_cast<int>(fd), *e, POLLOUT);
+    } else {
+      if (e == NULL || e->generation != tag || !e->armed ||
+          e->channel == NULL) {
+        continue;  // canceled or removed in the meantime
+      }
+      e->armed = false;
+      complete(static_cast<int>(fd), *e, cqe->res >= 0 ? cqe->res : POLLERR);
+    }
+  }
+  storeRelease(cqHead_, head);
+
+  for (int fd : completed_) {
+    Entry &e = entries_[fd];
+    e.channel->set_revents(e.revents);
+    e.revents = 0;
+    activeChannels->push_back(e.channel);
+    rearm_.push_back(fd);
+  }
+  completed_.clear();
+}
+
+void UringPoller::complete(int fd, Entry &e, int revents) {
+  if (e.revents == 0) {
+    completed_.push_back(fd);
+  }
+  e.revents |= revents;
+}
+
+void UringPoller::updateChannel(Channel *channel) {
+  assertInLoopThread();
+  const int fd = channel->fd();
+  if (channel->index() == kNew) {
+    assert(channels_.find(fd) == NULL);
+    channels_.insert(fd, channel);
+    channel->set_index(kAdded);
+  } else {
+    assert(channels_.find(fd) == channel);
+  }
+
+  Entry &e = entry(fd);
+  e.channel = channel;
+  if (channel->asyncIo()) {
+    armAsync(fd, e);
+    return;
+  }
+  if (e.armed) {
+    if (e.armedEvents == channel->events()) {
+      return;
+    }
+    disarm(e, fd);
+  }
+  if (!channel->isNoneEvent()) {
+    arm(fd, e, channel->events());
+  }
+}
+
+void UringPoller::removeChannel(Channel *channel) {
+  assertInLoopThread();
+  const int fd = channel->fd();
+  assert(channels_.find(fd) == channel);
+  assert(channel->isNoneEvent());
+  assert(channel->index() == kAdded);
+  channels_.erase(fd);
+
+  Entry &e = entry(fd);
+  if (e.armed) {
+    disarm(e, fd);
+  }
+  // the requests hold the file, the socket isn't closed until they end
+  if (e.recvArmed) {
+    cancel(makeUserData(fd, kRecvOp, e.recvGeneration));
+    e.recvArmed = false;
+    nextGeneration(&e.recvGeneration);
+  }
+  if (e.recvBuffer >= 0) {
+    recycleRecvBuffer(e.recvBuffer);
+    e.recvBuffer = -1;
+  }
+  if (e.writeRequest >= 0) {
+    // the request lets its data go once the canceled send completes
+    cancel(makeUserData(fd, kWriteOp, e.writeRequest));
+    e.writeRequest = -1;
+  }
+  e.recvDone = false;
+  e.recvFallback = false;
+  e.writeDone = false;
+  e.channel = NULL;
+  channel->set_index(kNew);
+}
+
+ssize_t UringPoller::readChannel(Channel *channel, Buffer *buf,
+                                 int *savedErrno) {
+  assertInLoopThread();
+  const int fd = channel->fd();
+  Entry &e = entry(fd);
+  if (!e.recvDone) {
+    // woken by a poll
+    e.recvFallback = false;
+    return buf->readFd(fd, savedErrno);
+  }
+  e.recvDone = false;
+  const int n = e.recvResult;
+  if (n > 0) {
+    buf->append(recvBuffer(e.recvBuffer), n);
+  } else if (n < 0) {
+    *savedErrno = -n;
+  }
+  if (e.recvBuffer >= 0) {
+    recycleRecvBuffer(e.recvBuffer);
+    e.recvBuffer = -1;
+  }
+  return n < 0 ? -1 : n;
+}
+
+void UringPoller::writeChannel(Channel *channel, const OutputQueue &output) {
+  assertInLoopThread();
+  const int fd = channel->fd();
+  Entry &e = entry(fd);
+  assert(e.writeRequest < 0 && !e.writeDone);
+  int index;
+  if (freeWrites_.empty()) {
+    index = static_cast<int>(writes_.size());
+    writes_.emplace_back(new WriteRequest);
+  } else {
+    index = freeWrites_.back();
+    freeWrites_.pop_back();
+  }
+  ++writesInFlight_;
+  WriteRequest *write = writes_[index].get();
+  ::memset(&write->msg, 0, sizeof write->msg);
+  write->msg.msg_iov = write->iov;
+  write->msg.msg_iovlen =
+      output.peekSegments(write->iov, kMaxWriteSegments, &write->owners);
+
+  struct io_uring_sqe *sqe = getSqe();
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(&write->msg);
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = makeUserData(fd, kWriteOp, static_cast<uint32_t>(index));
+  e.writeRequest = index;
+}
+
+bool UringPoller::channelWriting(Channel *channel) const {
+  const size_t fd = static_cast<size_t>(channel->fd());
+  return fd < entries_.size() &&
+         (entries_[fd].writeRequest >= 0 || entries_[fd].writeDone);
+}
+
+ssize_t UringPoller::takeWrite(Channel *channel, int *savedErrno) {
+  assertInLoopThread();
+  Entry &e = entry(channel->fd());
+  if (!e.writeDone) {
+    return 0;
+  }
+  e.writeDone = false;
+  if (e.writeResult == -EAGAIN) {
+    return 0;
+  }
+  if (e.writeResult < 0) {
+    *savedErrno = -e.writeResult;
+    return -1;
+  }
+  return e.writeResult;
+}
+
+UringPoller::Entry &UringPoller::entry(int fd) {
+  assert(fd >= 0);
+  if (static_cast<size_t>(fd) >= entries_.size()) {
+    entries_.resize(fd + 1);
+  }
+  return entries_[fd];
+}
+
+void UringPoller::arm(int fd, Entry &e, int events) {
+  struct io_uring_sqe *sqe = getSqe();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = static_cast<uint32_t>(events);
+  sqe->user_data = makeUserData(fd, kPollOp, e.generation);
+  e.armedEvents = events;
+  e.armed = true;
+}
+
+void UringPoller::disarm(Entry &e, int fd) {
+  struct io_uring_sqe *sqe = getSqe();
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->addr = makeUserData(fd, kPollOp, e.generation);
+  sqe->user_data = 0;
+  e.armed = false;
+  // a completion of the removed request may still come, make it stale
+  nextGeneration(&e.generation);
+}
+
+void UringPoller::armAsync(int fd, Entry &e) {
+  Channel *channel = e.channel;
+  if (channel->isReading()) {
+    if (e.recvDone) {
+      ready_.push_back(fd);  // came while not reading
+    } else if (!e.recvArmed && !e.recvFallback) {
+      armRecv(fd, e, false);
+    }
+  }
+  // polls only for reading without provided buffer, or writing with writev
+  int events = 0;
+  if (channel->isReading() && e.recvFallback) {
+    events |= POLLIN;
+  }
+  if (channel->isWriting() && e.writeRequest < 0 && !e.writeDone) {
+    events |= POLLOUT;
+  }
+  if (e.armed && e.armedEvents != events) {
+    disarm(e, fd);
+  }
+  if (!e.armed && events != 0) {
+    arm(fd, e, events);
+  }
+}
+
+void UringPoller::armRecv(int fd, Entry &e, bool pollFirst) {
+  struct io_uring_sqe *sqe = getSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->len = static_cast<uint32_t>(kRecvBufferSize);
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = kRecvGroup;
+  if (pollFirst) {
+    sqe->ioprio = IORING_RECVSEND_POLL_FIRST;
+  }
+  sqe->user_data = makeUserData(fd, kRecvOp, e.recvGeneration);
+  e.recvArmed = true;
+}
+
+void UringPoller::cancel(uint64_t userData) {
+  struct io_uring_sqe *sqe = getSqe();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = userData;
+  sqe->user_data = 0;
+}
+
+char *UringPoller::recvBuffer(int bid) const {
+  return recvBuffers_ + static_cast<size_t>(bid) * kRecvBufferSize;
+}
+
+void UringPoller::releaseWrite(int index) {
+  writes_[index]->owners.clear();
+  freeWrites_.push_back(index);
+  --writesInFlight_;
+}
+
+void UringPoller::recycleRecvBuffer(int bid) {
+  struct io_uring_buf *buf =
+      &recvRing_->bufs[recvRingTail_ & (kRecvBuffers - 1)];
+  buf->addr = reinterpret_cast<uint64_t>(recvBuffer(bid));
+  buf->len = static_cast<uint32_t>(kRecvBufferSize);
+  buf->bid = static_cast<uint16_t>(bid);
+  ++recvRingTail_;
+  __atomic_store_n(&recvRing_->tail, recvRingTail_, __ATOMIC_RELEASE);
+}
+
+struct io_uring_sqe *UringPoller::getSqe() {
+  if (sqeTail_ - loadAcquire(sqHead_) >= sqEntries_) {
+    // SQ ring is full, hand what we have to the kernel
+    enter(toSubmit_, false, 0);
+  }
+  const unsigned index = sqeTail_ & sqMask_;
+  struct io_uring_sqe *sqe = &sqes_[index];
+  ::memset(sqe, 0, sizeof *sqe);
+  sqArray_[index] = index;
+  ++sqeTail_;
+  ++toSubmit_;
+  return sqe;
+}
+
+}  // namespace network
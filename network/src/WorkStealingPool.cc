@@ -0,0 +1,138 @@
+#include "network/WorkStealingPool.h"
+
+#include <cassert>
+
+namespace network {
+
+namespace {
+
+// the pool and the index of the current worker, if any
+thread_local const WorkStealingPool *t_pool = NULL;
+thread_local int t_workerIndex = -1;
+
+}  // namespace
+
+WorkStealingPool::WorkStealingPool(const std::string &nameArg)
+    : name_(nameArg),
+      numThreads_(1),
+      started_(false),
+      running_(false),
+      next_(0),
+      pending_(0),
+      idle_(0) {}
+
+WorkStealingPool::~WorkStealingPool() { stop(); }
+
+void WorkStealingPool::start() {
+  if (started_) {
+    return;
+  }
+  assert(numThreads_ > 0);
+  started_ = true;
+  running_ = true;
+  for (int i = 0; i < numThreads_; ++i) {
+    queues_.emplace_back(new WorkQueue);
+  }
+  for (int i = 0; i < numThreads_; ++i) {
+    threads_.emplace_back(&WorkStealingPool::threadFunc, this, i);
+  }
+}
+
+void WorkStealingPool::stop() {
+  if (!running_.exchange(false)) {
+    return;
+  }
+  assert(t_pool != this);
+  // later submits run in their caller, the workers only drain what is
+  // queued, a steady stream of submits can't keep them from leaving
+  for (const std::unique_ptr<WorkQueue> &q : queues_) {
+    std::unique_lock<std::mutex> lock(q->mutex);
+    q->closed = true;
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.notify_all();
+  }
+  for (std::thread &t : threads_) {
+    t.join();
+  }
+  threads_.clear();
+  // a worker may have left between a push and the count of it in pending_
+  for (const std::unique_ptr<WorkQueue> &q : queues_) {
+    std::deque<Task> tasks;
+    {
+      std::unique_lock<std::mutex> lock(q->mutex);
+      tasks.swap(q->tasks);
+    }
+    pending_.fetch_sub(static_cast<int64_t>(tasks.size()));
+    for (Task &task : tasks) {
+      task();
+    }
+  }
+}
+
+void WorkStealingPool::submit(Task task) {
+  assert(started_);
+  const size_t n = queues_.size();
+  const size_t index = t_pool == this
+                           ? static_cast<size_t>(t_workerIndex)
+                           : next_.fetch_add(1, std::memory_order_relaxed) % n;
+  bool queued = false;
+  {
+    std::unique_lock<std::mutex> lock(queues_[index]->mutex);
+    if (!queues_[index]->closed) {
+      queues_[index]->tasks.push_back(std::move(task));
+      queued = true;
+    }
+  }
+  if (!queued) {
+    task();  // stopped
+    return;
+  }
+  // pairs with the check of pending_ under mutex_ in threadFunc(), a worker
+  // either sees the task or is counted in idle_ and gets notified
+  pending_.fetch_add(1);
+  if (idle_.load() > 0) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.notify_one();
+  }
+}
+
+bool WorkStealingPool::takeTask(int index, Task *task) {
+  const size_t n = queues_.size();
+  for (size_t i = 0; i < n; ++i) {
+    WorkQueue &q = *queues_[(index + i) % n];
+    std::unique_lock<std::mutex> lock(q.mutex);
+    if (!q.tasks.empty()) {
+      // the oldest first, also when stealing, it has waited the longest
+      *task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+      pending_.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingPool::threadFunc(int index) {
+  t_pool = this;
+  t_workerIndex = index;
+  for (;;) {
+    Task task;
+    if (takeTask(index, &task)) {
+      task();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!running_ && pending_.load() == 0) {
+      break;
+    }
+    idle_.fetch_add(1);
+    cv_.wait(lock, [this] { return pending_.load() > 0 || !running_; });
+    idle_.fetch_sub(1);
+  }
+  t_pool = NULL;
+  t_workerIndex = -1;
+}
+
+}  // namespace network
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/types.h>
 #include <unistd.h>
 namespace network {
@@ -39,6 +40,31 @@ int64_t getNowMs() {
   return val.tv_sec * 1000 + val.tv_usec / 1000;  /// gettimeofday() 获取的时间精度到微秒，但是这里返回的是毫秒
 }
 
+/// @brief 使用 clock_gettime(CLOCK_MONOTONIC) 获取单调时间
+/// @return 返回单调时钟的毫秒数，只适合计算时间间隔
+int64_t getMonotonicMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+/// @brief 单调时钟的微秒数，用于测量短时间间隔
+int64_t getMonotonicUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+/// @brief 单调时钟的纳秒数，用于测量很短的时间间隔
+int64_t getMonotonicNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
 /// @brief 将网络字节序的字节数组转换为主机字节序的 32 位整数
 /// @param buf 指向存储在网络字节序中的 4 字节数据的缓冲区指针
 /// @return 返回主机字节序的 32 位整数
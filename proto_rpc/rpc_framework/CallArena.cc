@@ -0,0 +1,118 @@
+#include "CallArena.h"
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+#include <vector>
+
+namespace network {
+
+namespace {
+
+const size_t kMaxCachedBlocks = 64;  // 1MB per thread
+
+}  // namespace
+
+const size_t CallArena::kBlockSize;
+
+// Blocks of one thread. Those destroyed by other threads, e.g. by the
+// executor that ran the call, are pushed on returned, which the owner takes
+// at once when its own run out.
+struct CallArena::BlockCache {
+  BlockCache() : returned(NULL), refs(1) {}
+
+  // in the owner thread
+  void cache(char *block) {
+    if (blocks.size() < kMaxCachedBlocks) {
+      blocks.push_back(block);
+    } else {
+      free(block);
+    }
+  }
+
+  // in the owner thread
+  void takeReturned() {
+    char *block = returned.exchange(NULL, std::memory_order_acquire);
+    while (block != NULL) {
+      char *next = *reinterpret_cast<char **>(block);
+      cache(block);
+      block = next;
+    }
+  }
+
+  // in any thread, linked through the first bytes of the block
+  void giveBack(char *block) {
+    char *head = returned.load(std::memory_order_relaxed);
+    do {
+      *reinterpret_cast<char **>(block) = head;
+    } while (!returned.compare_exchange_weak(head, block,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed));
+  }
+
+  // the owner thread and every block out hold a reference
+  void release() {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      takeReturned();
+      for (char *block : blocks) {
+        free(block);
+      }
+      delete this;
+    }
+  }
+
+  std::vector<char *> blocks;
+  std::atomic<char *> returned;
+  std::atomic<int> refs;
+};
+
+CallArena::BlockCache *CallArena::threadCache() {
+  // outlived by the blocks still out when the thread ends
+  struct Holder {
+    Holder() : cache(new BlockCache) {}
+    ~Holder() { cache->release(); }
+    BlockCache *cache;
+  };
+  static thread_local Holder holder;
+  return holder.cache;
+}
+
+
+CallArena::Block::Block() : owner(threadCache()) {
+  BlockCache *cache = owner;
+  if (cache->blocks.empty()) {
+    cache->takeReturned();
+  }
+  if (cache->blocks.empty()) {
+    data = static_cast<char *>(malloc(kBlockSize));
+    if (data == NULL) {
+      throw std::bad_alloc();
+    }
+  } else {
+    data = cache->blocks.back();
+    cache->blocks.pop_back();
+  }
+  cache->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+CallArena::Block::~Block() {
+  BlockCache *cache = owner;
+  if (cache == threadCache()) {
+    cache->cache(data);
+  } else {
+    cache->giveBack(data);
+  }
+  cache->release();
+}
+
+CallArena::CallArena() : arena_(options(block_.data)) {}
+
+::google::protobuf::ArenaOptions CallArena::options(char *block) {
+  ::google::protobuf::ArenaOptions options;
+  options.initial_block = block;
+  options.initial_block_size = kBlockSize;
+  return options;
+}
+
+}  // namespace network
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+
+#include <google/protobuf/arena.h>
+
+namespace network {
+
+///
+/// The google::protobuf::Arena of one call, for its envelope, request and
+/// response, and for scratch objects of the handler, which finds it with
+/// request->GetArena(). Everything goes at once when the last owner of the
+/// CallArena does, after done->Run() on the server.
+///
+/// The first block comes from a cache of the thread creating the CallArena
+/// and goes back to it from whichever thread destroys it, so a call whose
+/// messages fit in it mallocs nothing but the CallArena itself, also when
+/// an executor runs it.
+/// 每次调用一个 Arena
+class CallArena {
+ public:
+  static const size_t kBlockSize = 16 * 1024;
+
+  CallArena();
+  ~CallArena() = default;
+  CallArena(const CallArena &) = delete;
+  CallArena &operator=(const CallArena &) = delete;
+
+  ::google::protobuf::Arena *arena() { return &arena_; }
+
+ private:
+  struct BlockCache;
+  // a block of the creating thread's cache, back to it when destroyed
+  struct Block {
+    Block();
+    ~Block();
+    char *data;
+    BlockCache *owner;
+  };
+  static BlockCache *threadCache();
+  static ::google::protobuf::ArenaOptions options(char *block);
+
+  Block block_;  // outlives arena_
+  ::google::protobuf::Arena arena_;
+};
+
+typedef std::shared_ptr<CallArena> CallArenaPtr;
+
+}  // namespace network
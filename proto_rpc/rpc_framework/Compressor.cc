@@ -0,0 +1,102 @@
+#include "Compressor.h"
+
+#include <string.h>
+#include <zlib.h>
+
+namespace network {
+
+namespace {
+
+// a deflate state takes some 256KB, each thread keeps one and resets it for
+// every message, the same for inflate
+struct Deflater {
+  Deflater() : level(Z_DEFAULT_COMPRESSION) {
+    memset(&stream, 0, sizeof stream);
+    ok = deflateInit(&stream, level) == Z_OK;
+  }
+  ~Deflater() {
+    if (ok) {
+      deflateEnd(&stream);
+    }
+  }
+
+  z_stream stream;
+  int level;
+  bool ok;
+};
+
+struct Inflater {
+  Inflater() {
+    memset(&stream, 0, sizeof stream);
+    ok = inflateInit(&stream) == Z_OK;
+  }
+  ~Inflater() {
+    if (ok) {
+      inflateEnd(&stream);
+    }
+  }
+
+  z_stream stream;
+  bool ok;
+};
+
+thread_local Deflater t_deflater;
+thread_local Inflater t_inflater;
+
+}  // namespace
+
+bool ZlibCompressor::compress(const char *data, size_t len,
+                              std::string *out) const {
+  Deflater &d = t_deflater;
+  if (!d.ok || deflateReset(&d.stream) != Z_OK) {
+    return false;
+  }
+  if (d.level != level_) {
+    if (deflateParams(&d.stream, level_, Z_DEFAULT_STRATEGY) != Z_OK) {
+      return false;
+    }
+    d.level = level_;
+  }
+  if (!dictionary_.empty() &&
+      deflateSetDictionary(
+          &d.stream, reinterpret_cast<const Bytef *>(dictionary_.data()),
+          static_cast<uInt>(dictionary_.size())) != Z_OK) {
+    return false;
+  }
+  const size_t offset = out->size();
+  const uLong bound = deflateBound(&d.stream, static_cast<uLong>(len));
+  out->resize(offset + bound);
+  d.stream.next_in =
+      reinterpret_cast<Bytef *>(const_cast<char *>(data));
+  d.stream.avail_in = static_cast<uInt>(len);
+  d.stream.next_out = reinterpret_cast<Bytef *>(&(*out)[offset]);
+  d.stream.avail_out = static_cast<uInt>(bound);
+  const int rc = deflate(&d.stream, Z_FINISH);
+  out->resize(offset + d.stream.total_out);
+  return rc == Z_STREAM_END;
+}
+
+bool ZlibCompressor::decompress(const char *data, size_t len, char *out,
+                                size_t outLen) const {
+  Inflater &i = t_inflater;
+  if (!i.ok || inflateReset(&i.stream) != Z_OK) {
+    return false;
+  }
+  i.stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+  i.stream.avail_in = static_cast<uInt>(len);
+  i.stream.next_out = reinterpret_cast<Bytef *>(out);
+  i.stream.avail_out = static_cast<uInt>(outLen);
+  int rc = inflate(&i.stream, Z_FINISH);
+  if (rc == Z_NEED_DICT && !dictionary_.empty()) {
+    if (inflateSetDictionary(
+            &i.stream, reinterpret_cast<const Bytef *>(dictionary_.data()),
+            static_cast<uInt>(dictionary_.size())) != Z_OK) {
+      return false;
+    }
+    rc = inflate(&i.stream, Z_FINISH);
+  }
+  // a stream longer than announced stops at Z_BUF_ERROR
+  return rc == Z_STREAM_END && i.stream.total_out == outLen;
+}
+
+}  // namespace network
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+namespace google {
+namespace protobuf {
+class MethodDescriptor;
+}  // namespace protobuf
+}  // namespace google
+
+namespace network {
+
+///
+/// Payload compression of v2 frames. Both ends of a call must use the same
+/// compressor, and dictionary, for a method.
+///
+/// Implementations are called from the I/O loops and the workers at once.
+/// 负载压缩接口
+class Compressor {
+ public:
+  virtual ~Compressor() {}
+
+  /// Appends @c len bytes from @c data compressed to @c out.
+  virtual bool compress(const char *data, size_t len,
+                        std::string *out) const = 0;
+  /// Decompresses @c len bytes from @c data to exactly @c outLen bytes.
+  virtual bool decompress(const char *data, size_t len, char *out,
+                          size_t outLen) const = 0;
+  /// The most bytes one compressed byte can decompress to, a claim of more
+  /// is forged and rejected before anything is allocated.
+  virtual size_t maxRatio() const = 0;
+};
+
+///
+/// zlib deflate. A preset dictionary, e.g. built from typical payloads of the
+/// method, makes small repetitive messages compress. zlib loads it for every
+/// message, keep it to a few KB.
+class ZlibCompressor : public Compressor {
+ public:
+  /// @c level from 1 (fast) to 9 (small), -1 for zlib's default, 6.
+  explicit ZlibCompressor(int level = -1,
+                          const std::string &dictionary = std::string())
+      : level_(level), dictionary_(dictionary) {}
+
+  bool compress(const char *data, size_t len,
+                std::string *out) const override;
+  bool decompress(const char *data, size_t len, char *out,
+                  size_t outLen) const override;
+  /// 258 bytes from a match in 2 bits at best
+  size_t maxRatio() const override { return 1032; }
+
+ private:
+  const int level_;
+  const std::string dictionary_;
+};
+
+/// How the payloads of a method are compressed.
+struct MethodCompression {
+  std::shared_ptr<const Compressor> compressor;
+  size_t threshold;  // smaller payloads go as they are
+};
+
+typedef std::map<const ::google::protobuf::MethodDescriptor *,
+                 MethodCompression>
+    CompressionMap;
+
+}  // namespace network
@@ -0,0 +1,216 @@
+#include "Crc32c.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define NETWORK_CRC32C_SSE42 1
+#endif
+
+namespace network {
+namespace crc32c {
+
+namespace {
+
+const uint32_t kPoly = 0x82f63b78;  // reflected Castagnoli polynomial
+
+// the hardware path runs three streams of these sizes side by side, the
+// crc32 instruction has a latency of three cycles and a throughput of one
+const size_t kLongBlock = 8192;
+const size_t kShortBlock = 256;
+
+// GF(2) 32x32 matrix times vector
+uint32_t gf2Times(const uint32_t *mat, uint32_t vec) {
+  uint32_t sum = 0;
+  for (; vec != 0; vec >>= 1, ++mat) {
+    if (vec & 1) {
+      sum ^= *mat;
+    }
+  }
+  return sum;
+}
+
+void gf2Square(uint32_t *square, const uint32_t *mat) {
+  for (int n = 0; n < 32; ++n) {
+    square[n] = gf2Times(mat, mat[n]);
+  }
+}
+
+// the operator that appends @c len zero bytes to a CRC, len a power of two
+void zerosOperator(uint32_t *even, size_t len) {
+  uint32_t odd[32];
+  odd[0] = kPoly;  // one zero bit
+  uint32_t row = 1;
+  for (int n = 1; n < 32; ++n) {
+    odd[n] = row;
+    row <<= 1;
+  }
+  gf2Square(even, odd);  // two zero bits
+  gf2Square(odd, even);  // four
+  // squares to one zero byte, two, four...
+  while (true) {
+    gf2Square(even, odd);
+    len >>= 1;
+    if (len == 0) {
+      return;
+    }
+    gf2Square(odd, even);
+    len >>= 1;
+    if (len == 0) {
+      break;
+    }
+  }
+  memcpy(even, odd, sizeof odd);
+}
+
+struct Tables {
+  Tables() {
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t crc = n;
+      for (int k = 0; k < 8; ++k) {
+        crc = crc & 1 ? (crc >> 1) ^ kPoly : crc >> 1;
+      }
+      bytes[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t crc = bytes[0][n];
+      for (int k = 1; k < 8; ++k) {
+        crc = bytes[0][crc & 0xff] ^ (crc >> 8);
+        bytes[k][n] = crc;
+      }
+    }
+    buildShift(longShift, kLongBlock);
+    buildShift(shortShift, kShortBlock);
+  }
+
+  // byte-wise tables applying the zeros operator for @c len bytes
+  static void buildShift(uint32_t shift[4][256], size_t len) {
+    uint32_t op[32];
+    zerosOperator(op, len);
+    for (uint32_t n = 0; n < 256; ++n) {
+      shift[0][n] = gf2Times(op, n);
+      shift[1][n] = gf2Times(op, n << 8);
+      shift[2][n] = gf2Times(op, n << 16);
+      shift[3][n] = gf2Times(op, n << 24);
+    }
+  }
+
+  uint32_t bytes[8][256];       // slicing-by-8
+  uint32_t longShift[4][256];   // appends kLongBlock zeros
+  uint32_t shortShift[4][256];  // appends kShortBlock zeros
+};
+
+const Tables &tables() {
+  static const Tables t;
+  return t;
+}
+
+uint64_t load64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof v);
+  return v;
+}
+
+uint32_t extendSoftware(uint32_t crc, const unsigned char *p, size_t len) {
+  const Tables &t = tables();
+  crc = ~crc;
+  for (; len > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0; --len) {
+    crc = t.bytes[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  }
+  for (; len >= 8; len -= 8, p += 8) {
+    // little endian, like the hardware path
+    const uint64_t v = load64(p) ^ crc;
+    crc = t.bytes[7][v & 0xff] ^ t.bytes[6][(v >> 8) & 0xff] ^
+          t.bytes[5][(v >> 16) & 0xff] ^ t.bytes[4][(v >> 24) & 0xff] ^
+          t.bytes[3][(v >> 32) & 0xff] ^ t.bytes[2][(v >> 40) & 0xff] ^
+          t.bytes[1][(v >> 48) & 0xff] ^ t.bytes[0][v >> 56];
+  }
+  for (; len > 0; --len) {
+    crc = t.bytes[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+#ifdef NETWORK_CRC32C_SSE42
+
+uint32_t shift(const uint32_t table[4][256], uint32_t crc) {
+  return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^
+         table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+}
+
+__attribute__((target("sse4.2"))) uint32_t extendHardware(
+    uint32_t crc, const unsigned char *p, size_t len) {
+  const Tables &t = tables();
+  uint64_t crc0 = ~crc;
+  for (; len > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0; --len) {
+    crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *p++);
+  }
+  // three independent streams, combined by shifting the first two over the
+  // length of the following ones
+  while (len >= 3 * kLongBlock) {
+    uint64_t crc1 = 0, crc2 = 0;
+    const unsigned char *end = p + kLongBlock;
+    do {
+      crc0 = _mm_crc32_u64(crc0, load64(p));
+      crc1 = _mm_crc32_u64(crc1, load64(p + kLongBlock));
+      crc2 = _mm_crc32_u64(crc2, load64(p + 2 * kLongBlock));
+      p += 8;
+    } while (p < end);
+    crc0 = shift(t.longShift, static_cast<uint32_t>(crc0)) ^ crc1;
+    crc0 = shift(t.longShift, static_cast<uint32_t>(crc0)) ^ crc2;
+    p += 2 * kLongBlock;
+    len -= 3 * kLongBlock;
+  }
+  while (len >= 3 * kShortBlock) {
+    uint64_t crc1 = 0, crc2 = 0;
+    const unsigned char *end = p + kShortBlock;
+    do {
+      crc0 = _mm_crc32_u64(crc0, load64(p));
+      crc1 = _mm_crc32_u64(crc1, load64(p + kShortBlock));
+      crc2 = _mm_crc32_u64(crc2, load64(p + 2 * kShortBlock));
+      p += 8;
+    } while (p < end);
+    crc0 = shift(t.shortShift, static_cast<uint32_t>(crc0)) ^ crc1;
+    crc0 = shift(t.shortShift, static_cast<uint32_t>(crc0)) ^ crc2;
+    p += 2 * kShortBlock;
+    len -= 3 * kShortBlock;
+  }
+  for (; len >= 8; len -= 8, p += 8) {
+    crc0 = _mm_crc32_u64(crc0, load64(p));
+  }
+  for (; len > 0; --len) {
+    crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *p++);
+  }
+  return ~static_cast<uint32_t>(crc0);
+}
+
+bool detectHardware() {
+  __builtin_cpu_init();  // may run before the libgcc constructor
+  return __builtin_cpu_supports("sse4.2");
+}
+
+#else
+
+uint32_t extendHardware(uint32_t crc, const unsigned char *p, size_t len) {
+  return extendSoftware(crc, p, len);
+}
+
+bool detectHardware() { return false; }
+
+#endif
+
+}  // namespace
+
+uint32_t extend(uint32_t crc, const void *data, size_t len) {
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  return hardwareAccelerated() ? extendHardware(crc, p, len)
+                               : extendSoftware(crc, p, len);
+}
+
+bool hardwareAccelerated() {
+  static const bool hardware = detectHardware();
+  return hardware;
+}
+
+}  // namespace crc32c
+}  // namespace network
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace network {
+namespace crc32c {
+
+/// CRC-32C (Castagnoli) of @c len bytes appended to data whose CRC is
+/// @c crc, 0 for none. Uses the SSE4.2 crc32 instruction when the CPU has
+/// it, slicing-by-8 tables otherwise.
+uint32_t extend(uint32_t crc, const void *data, size_t len);
+
+/// CRC-32C of @c len bytes, value("123456789", 9) is 0xe3069283.
+inline uint32_t value(const void *data, size_t len) {
+  return extend(0, data, len);
+}
+
+/// Whether extend() runs on the crc32 instruction.
+bool hardwareAccelerated();
+
+}  // namespace crc32c
+}  // namespace network
@@ -0,0 +1,102 @@
+#include "DispatchTable.h"
+
+#include <string.h>
+
+#include <cassert>
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/service.h>
+
+namespace network {
+
+namespace {
+
+const uint64_t kFnvOffset = 14695981039346656037ULL;
+const uint64_t kFnvPrime = 1099511628211ULL;
+
+// FNV-1a, continued from @c hash
+uint64_t fnv1a(uint64_t hash, const char *data, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * kFnvPrime;
+  }
+  return hash;
+}
+
+// the hash of "service.method", the full name of the method
+uint64_t hashOf(const char *service, size_t serviceLen, const char *method,
+                size_t methodLen) {
+  uint64_t hash = fnv1a(kFnvOffset, service, serviceLen);
+  hash = fnv1a(hash, ".", 1);
+  return fnv1a(hash, method, methodLen);
+}
+
+}  // namespace
+
+void DispatchTable::build(
+    const std::map<std::string, ::google::protobuf::Service *> &services,
+    const ExecutorMap &executors) {
+  entries_.clear();
+  for (const auto &item : services) {
+    ::google::protobuf::Service *service = item.second;
+    const ::google::protobuf::ServiceDescriptor *desc =
+        service->GetDescriptor();
+    for (int i = 0; i < desc->method_count(); ++i) {
+      const ::google::protobuf::MethodDescriptor *method = desc->method(i);
+      ExecutorMap::const_iterator e = executors.find(method);
+      MethodEntry entry = {service,
+                           method,
+                           &service->GetRequestPrototype(method),
+                           &service->GetResponsePrototype(method),
+                           e != executors.end() ? e->second : NULL,
+                           NULL};
+      entries_.push_back(entry);
+    }
+  }
+  stats_.reset(new MethodStats[entries_.size()]);
+
+  // at most half full
+  size_t capacity = 16;
+  while (capacity < 2 * entries_.size()) {
+    capacity *= 2;
+  }
+  slots_.assign(capacity, Slot{0, NULL});
+  mask_ = capacity - 1;
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    MethodEntry &entry = entries_[i];
+    entry.stats = &stats_[i];
+    const std::string &service = entry.method->service()->full_name();
+    const std::string &method = entry.method->name();
+    const uint64_t hash =
+        hashOf(service.data(), service.size(), method.data(), method.size());
+    size_t s = hash & mask_;
+    while (slots_[s].entry) {
+      s = (s + 1) & mask_;
+    }
+    slots_[s].hash = hash;
+    slots_[s].entry = &entry;
+  }
+}
+
+const MethodEntry *DispatchTable::find(const char *service, size_t serviceLen,
+                                       const char *method,
+                                       size_t methodLen) const {
+  if (slots_.empty()) {
+    return NULL;
+  }
+  const uint64_t hash = hashOf(service, serviceLen, method, methodLen);
+  for (size_t s = hash & mask_; slots_[s].entry; s = (s + 1) & mask_) {
+    if (slots_[s].hash != hash) {
+      continue;
+    }
+    const std::string &name = slots_[s].entry->method->full_name();
+    if (name.size() == serviceLen + 1 + methodLen &&
+        ::memcmp(name.data(), service, serviceLen) == 0 &&
+        name[serviceLen] == '.' &&
+        ::memcmp(name.data() + serviceLen + 1, method, methodLen) == 0) {
+      return slots_[s].entry;
+    }
+  }
+  return NULL;
+}
+
+}  // namespace network
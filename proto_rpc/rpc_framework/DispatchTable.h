@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace google {
+namespace protobuf {
+class Message;
+class MethodDescriptor;
+class Service;
+}  // namespace protobuf
+}  // namespace google
+
+namespace network {
+
+class WorkStealingPool;
+
+/// Counters of a served method, updated by the I/O loops and the workers.
+struct alignas(64) MethodStats {
+  MethodStats() : calls(0), invalidRequests(0) {}
+
+  std::atomic<int64_t> calls;
+  std::atomic<int64_t> invalidRequests;
+};
+
+/// What a request needs to be served, resolved once.
+struct MethodEntry {
+  ::google::protobuf::Service *service;
+  const ::google::protobuf::MethodDescriptor *method;
+  const ::google::protobuf::Message *requestPrototype;
+  const ::google::protobuf::Message *responsePrototype;
+  WorkStealingPool *executor;  // NULL to run in the I/O loop
+  MethodStats *stats;          // NULL if not counted
+};
+
+///
+/// The methods of the registered services in an open addressing hash table
+/// keyed by full name, "package.Service.Method". A lookup hashes and compares
+/// the service and method names where they are, it does not allocate.
+///
+/// Entries are in the order of the services' names, then of the methods in
+/// the service. Immutable once built, read by all the I/O loops.
+/// 方法分发表
+class DispatchTable {
+ public:
+  typedef std::map<const ::google::protobuf::MethodDescriptor *,
+                   WorkStealingPool *>
+      ExecutorMap;
+
+  DispatchTable() : mask_(0) {}
+  DispatchTable(const DispatchTable &) = delete;
+  DispatchTable &operator=(const DispatchTable &) = delete;
+
+  /// Every method of @c services, on their executor in @c executors.
+  void build(
+      const std::map<std::string, ::google::protobuf::Service *> &services,
+      const ExecutorMap &executors);
+
+  /// NULL if there is no such method.
+  const MethodEntry *find(const char *service, size_t serviceLen,
+                          const char *method, size_t methodLen) const;
+  const MethodEntry *find(const std::string &service,
+                          const std::string &method) const {
+    return find(service.data(), service.size(), method.data(), method.size());
+  }
+  /// The method of id @c id, its index in entries() plus one, NULL if there
+  /// is no such method. Ids are what MethodTableService hands out.
+  const MethodEntry *findById(uint32_t id) const {
+    return id > 0 && id <= entries_.size() ? &entries_[id - 1] : NULL;
+  }
+
+  const std::vector<MethodEntry> &entries() const { return entries_; }
+  bool empty() const { return entries_.empty(); }
+
+ private:
+  struct Slot {
+    uint64_t hash;
+    const MethodEntry *entry;  // NULL if free
+  };
+
+  std::vector<MethodEntry> entries_;
+  std::unique_ptr<MethodStats[]> stats_;
+  std::vector<Slot> slots_;
+  size_t mask_;
+};
+
+}  // namespace network
@@ -1,55 +1,163 @@
 #include "RpcChannel.h"
 
+#include <string.h>
+
 #include <cassert>
 
 #include <glog/logging.h>
 #include <google/protobuf/descriptor.h>
 
+#include "network/Logging.h"
+#include "network/WorkStealingPool.h"
 #include "rpc.pb.h"
 using namespace network;
+
+class RpcChannel::DoneClosure : public ::google::protobuf::Closure {
+ public:
+  DoneClosure(RpcChannel *channel, const RpcChannelPtr &pin,
+              ::google::protobuf::Message *response, int64_t id,
+              const ::google::protobuf::MethodDescriptor *method,
+              const std::shared_ptr<const void> &arenaOwner)
+      : channel_(channel),
+        pin_(pin),
+        response_(response),
+        id_(id),
+        method_(method),
+        arenaOwner_(arenaOwner) {}
+
+  void Run() override {
+    if (arenaOwner_) {
+      // this is on the arena too, and gone with the last owner
+      std::shared_ptr<const void> owner(std::move(arenaOwner_));
+      channel_->doneCallback(response_, id_, method_);
+    } else {
+      channel_->doneCallback(response_, id_, method_);
+      delete this;
+    }
+  }
+
+ private:
+  RpcChannel *channel_;
+  RpcChannelPtr pin_;  // NULL for calls served in the I/O loop
+  ::google::protobuf::Message *response_;
+  int64_t id_;
+  const ::google::protobuf::MethodDescriptor *method_;
+  std::shared_ptr<const void> arenaOwner_;  // NULL if on the heap
+};
+
 RpcChannel::RpcChannel()
     : codec_(std::bind(&RpcChannel::onRpcMessage, this, std::placeholders::_1,
                        std::placeholders::_2)),
-      services_(NULL) {
-  LOG(INFO) << "RpcChannel::ctor - " << this;
+      services_(NULL),
+      executors_(NULL),
+      dispatch_(NULL),
+      arenaPerCall_(false),
+      useMethodIds_(false),
+      methodTableAsked_(false) {
+  codec_.setFrameCallback(std::bind(&RpcChannel::onRpcFrame, this,
+                                    std::placeholders::_1,
+                                    std::placeholders::_2));
+  LOG_DEBUG << "RpcChannel::ctor - " << this;
 }
 
 RpcChannel::RpcChannel(const TcpConnectionPtr &conn)
     : codec_(std::bind(&RpcChannel::onRpcMessage, this, std::placeholders::_1,
                        std::placeholders::_2)),
       conn_(conn),
-      services_(NULL) {
-  LOG(INFO) << "RpcChannel::ctor - " << this;
+      services_(NULL),
+      executors_(NULL),
+      dispatch_(NULL),
+      arenaPerCall_(false),
+      useMethodIds_(false),
+      methodTableAsked_(false) {
+  codec_.setFrameCallback(std::bind(&RpcChannel::onRpcFrame, this,
+                                    std::placeholders::_1,
+                                    std::placeholders::_2));
+  LOG_DEBUG << "RpcChannel::ctor - " << this;
 }
 
 RpcChannel::~RpcChannel() {
-  LOG(INFO) << "RpcChannel::dtor - " << this;
+  LOG_DEBUG << "RpcChannel::dtor - " << this;
   for (const auto &outstanding : outstandings_) {
     OutstandingCall out = outstanding.second;
-    delete out.response;
+    if (!out.response->GetArena()) {
+      delete out.response;
+    }
     delete out.done;
   }
 }
 
+void RpcChannel::setConnection(const TcpConnectionPtr &conn) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  conn_ = conn;
+  // ids are those of the server at the other end
+  methodTableAsked_ = false;
+  idsByName_.clear();
+  methodIds_.clear();
+}
+
 void RpcChannel::CallMethod(const ::google::protobuf::MethodDescriptor  *method,      // 要调用的具体 RPC 方法
                                   ::google::protobuf::RpcController     *controller,  // 管理 RPC 调用的状态和信息
                             const ::google::protobuf::Message           *request,     // RPC 方法的请求参数
                                   ::google::protobuf::Message           *response,    // 存储来自服务器端的响应
                                   ::google::protobuf::Closure           *done) {      // 服务器处理完请求后，回调函数将被调用
-  RpcMessage message;
-  message.set_type(REQUEST);
   int64_t id = id_.fetch_add(1) + 1;                      // 生成一个全局唯一的请求 ID
-  message.set_id(id);
-  message.set_service(method->service()->full_name());    // 获取该方法所属服务的完整名称
-  message.set_method(method->name());                     // 获取被调用方法的名称
-  message.set_request(request->SerializeAsString());      // 请求对象序列化为字符串
 
-  OutstandingCall out = {response, done};
+  OutstandingCall out = {response, done, method, controller};
+  uint32_t methodId = 0;
+  bool askTable = false;
   {
     std::unique_lock<std::mutex> lock(mutex_);
     outstandings_[id] = out;
+    if (useMethodIds_) {
+      methodId = methodIdOf(method, &askTable);
+    }
+  }
+  if (askTable) {
+    // ahead of the call, which goes named
+    requestMethodTable();
+  }
+  codec_.sendRequest(conn_, id, method, *request, methodId);
+}
+
+uint32_t RpcChannel::methodIdOf(
+    const ::google::protobuf::MethodDescriptor *method, bool *askTable) {
+  if (!methodTableAsked_) {
+    methodTableAsked_ = true;
+    *askTable = true;
+    return 0;
+  }
+  auto it = methodIds_.find(method);
+  if (it != methodIds_.end()) {
+    return it->second;
+  }
+  if (idsByName_.empty()) {
+    // not in yet, or the server has none
+    return 0;
   }
-  codec_.send(conn_, message);
+  auto name = idsByName_.find(method->full_name());
+  const uint32_t methodId = name != idsByName_.end() ? name->second : 0;
+  methodIds_[method] = methodId;
+  return methodId;
+}
+
+void RpcChannel::requestMethodTable() {
+  MethodTableRequest request;
+  MethodTable *table = new MethodTable;
+  // through CallMethod, methodTableAsked_ is set already
+  CallMethod(MethodTableService::descriptor()->method(0), NULL, &request,
+             table,
+             ::google::protobuf::NewCallback(this, &RpcChannel::onMethodTable,
+                                             table));
+}
+
+void RpcChannel::onMethodTable(MethodTable *table) {
+  // empty if the server has no MethodTableService
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (int i = 0; i < table->methods_size(); ++i) {
+    idsByName_[table->methods(i)] = static_cast<uint32_t>(i + 1);
+  }
+  LOG_DEBUG << "RpcChannel - " << idsByName_.size() << " method ids";
 }
 
 void RpcChannel::onMessage(const TcpConnectionPtr &conn, Buffer *buf) {
@@ -67,25 +175,72 @@ void RpcChannel::onRpcMessage(const TcpConnectionPtr &conn,
   }
 }
 
-void RpcChannel::handle_response_msg(const RpcMessagePtr &messagePtr) {
-  RpcMessage &message = *messagePtr;
-  int64_t id = message.id();
+void RpcChannel::onRpcFrame(const TcpConnectionPtr &conn,
+                            const RpcFrame &frame) {
+  assert(conn == conn_);
+  if (frame.type == RESPONSE) {
+    handle_response_frame(frame);
+  } else if (frame.type == REQUEST) {
+    handle_request_frame(frame);
+  }
+}
 
-  OutstandingCall out = {NULL, NULL};
+void RpcChannel::handle_response_msg(const RpcMessagePtr &messagePtr) {
+  const RpcMessage &message = *messagePtr;
+  completeCall(takeCall(message.id()), message.error(),
+               message.response().data(),
+               static_cast<int>(message.response().size()));
+}
 
-  {
-    std::unique_lock<std::mutex> lock(mutex_);
-    auto it = outstandings_.find(id);
-    if (it != outstandings_.end()) {
-      out = it->second;
-      outstandings_.erase(it);
+void RpcChannel::handle_response_frame(const RpcFrame &frame) {
+  OutstandingCall out = takeCall(frame.id);
+  if (out.response && frame.error == NO_ERROR &&
+      (frame.flags & RpcFrame::kCompressed)) {
+    std::string response;
+    if (!codec_.uncompress(frame, out.method, &response)) {
+      LOG(ERROR) << "RpcChannel - bad compressed response to "
+                 << out.method->full_name();
+      completeCall(out, INVALID_RESPONSE, NULL, 0);
+      return;
     }
+    completeCall(out, NO_ERROR, response.data(),
+                 static_cast<int>(response.size()));
+  } else {
+    // parsed straight from the input buffer, or its slices
+    completeCall(out, frame.error, frame.payload, frame.payloadLen,
+                 frame.payloadSlices);
   }
+}
 
+RpcChannel::OutstandingCall RpcChannel::takeCall(int64_t id) {
+  OutstandingCall out = {NULL, NULL, NULL, NULL};
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = outstandings_.find(id);
+  if (it != outstandings_.end()) {
+    out = it->second;
+    outstandings_.erase(it);
+  }
+  return out;
+}
+
+void RpcChannel::completeCall(const OutstandingCall &out, ErrorCode error,
+                              const char *response, int len,
+                              const std::vector<Slice> *slices) {
   if (out.response) {
-    std::unique_ptr<google::protobuf::Message> d(out.response);
-    if (!message.response().empty()) {
-      out.response->ParseFromString(message.response());    // 将消息体解析到 response 对象中
+    // responses the caller put on an arena go with it
+    std::unique_ptr<google::protobuf::Message> d(
+        out.response->GetArena() ? NULL : out.response);
+    // 将消息体解析到 response 对象中
+    if (error == NO_ERROR && len > 0 &&
+        !ProtoRpcCodec::parsePayload(response, len, slices, out.response)) {
+      error = INVALID_RESPONSE;
+    }
+    if (error != NO_ERROR) {
+      LOG_DEBUG << "RpcChannel - " << out.method->full_name() << " failed, "
+                << ErrorCode_Name(error);
+      if (out.controller) {
+        out.controller->SetFailed(ErrorCode_Name(error));
+      }
     }
     if (out.done) {
       out.done->Run();    // RPC 调用已经完成，并执行用户提供的回调函数
@@ -93,58 +248,208 @@ void RpcChannel::handle_response_msg(const RpcMessagePtr &messagePtr) {
   }
 }
 
-void RpcChannel::handle_request_msg(const TcpConnectionPtr &conn,
+void RpcChannel::handle_request_msg(const TcpConnectionPtr &,
                                     const RpcMessagePtr &messagePtr) {
-  RpcMessage &message = *messagePtr;
-  ErrorCode error = WRONG_PROTO;
-  if (services_) {
-    std::map<std::string, google::protobuf::Service *>::const_iterator it =
-        services_->find(message.service());
-    if (it != services_->end()) {
-      google::protobuf::Service *service = it->second;
-      assert(service != NULL);
-      const google::protobuf::ServiceDescriptor *desc = service->GetDescriptor();
-      const google::protobuf::MethodDescriptor *method = desc->FindMethodByName(message.method());
-      
-      if (method) {
-        std::unique_ptr<google::protobuf::Message> request(
-            service->GetRequestPrototype(method).New());   // 获取当前 RPC 方法的请求消息原型
-        if (request->ParseFromString(message.request())) {
-          google::protobuf::Message *response =
-              service->GetResponsePrototype(method).New(); // 用于存储服务器生成的响应数据
-          // response is deleted in doneCallback
-          int64_t id = message.id();
-          service->CallMethod(
-              method, NULL, request.get(), response,
-              NewCallback(this, &RpcChannel::doneCallback, response, id));  // 处理请求
-          error = NO_ERROR;
-        } else {
-          error = INVALID_REQUEST;
-        }
-      } else {
-        error = NO_METHOD;
-      }
+  const RpcMessage &message = *messagePtr;
+  MethodEntry entry;
+  ErrorCode error =
+      message.method_id()
+          ? resolveId(message.method_id(), &entry)
+          : resolve(message.service().data(), message.service().size(),
+                    message.method().data(), message.method().size(),
+                    &entry);
+  if (error != NO_ERROR) {
+    sendError(message.id(), error);
+    return;
+  }
+  // the envelope owns its arena, if any
+  google::protobuf::Arena *arena = messagePtr->GetArena();
+  std::shared_ptr<const void> arenaOwner;
+  if (arena) {
+    arenaOwner = messagePtr;
+  }
+  if (entry.executor) {
+    // parsing and the call itself leave the I/O loop
+    RpcChannelPtr self(shared_from_this());
+    entry.executor->submit([self, entry, messagePtr, arena, arenaOwner] {
+      const std::string &request = messagePtr->request();
+      self->invokeMethod(entry, messagePtr->id(), request.data(),
+                         static_cast<int>(request.size()), NULL, self, arena,
+                         arenaOwner);
+    });
+  } else {
+    invokeMethod(entry, message.id(), message.request().data(),
+                 static_cast<int>(message.request().size()), NULL,
+                 RpcChannelPtr(), arena, arenaOwner);
+  }
+}
+
+void RpcChannel::handle_request_frame(const RpcFrame &frame) {
+  MethodEntry entry;
+  ErrorCode error = frame.methodId
+                        ? resolveId(frame.methodId, &entry)
+                        : resolve(frame.service, frame.serviceLen,
+                                  frame.method, frame.methodLen, &entry);
+  if (error != NO_ERROR) {
+    sendError(frame.id, error);
+    return;
+  }
+  std::string uncompressed;
+  const bool compressed = frame.flags & RpcFrame::kCompressed;
+  if (compressed && !codec_.uncompress(frame, entry.method, &uncompressed)) {
+    sendError(frame.id, INVALID_REQUEST);
+    return;
+  }
+  CallArenaPtr callArena;
+  google::protobuf::Arena *arena = NULL;
+  if (arenaPerCall_) {
+    callArena = std::make_shared<CallArena>();
+    arena = callArena->arena();
+  }
+  // parsed straight from the input buffer if not compressed
+  const char *request = compressed ? uncompressed.data() : frame.payload;
+  const int len =
+      compressed ? static_cast<int>(uncompressed.size()) : frame.payloadLen;
+  const int64_t id = frame.id;
+  WorkStealingPool *executor = entry.executor;
+  if (frame.payloadSlices) {
+    // a large frame, parsed from the slices it came in, which a worker
+    // shares rather than copies
+    if (executor) {
+      RpcChannelPtr self(shared_from_this());
+      executor->submit([self, entry, id, slices = *frame.payloadSlices, len,
+                        arena, callArena] {
+        self->invokeMethod(entry, id, NULL, len, &slices, self, arena,
+                           callArena);
+      });
     } else {
-      error = NO_SERVICE;
+      invokeMethod(entry, id, NULL, len, frame.payloadSlices, RpcChannelPtr(),
+                   arena, callArena);
     }
+  } else if (executor && arena) {
+    // the frame is gone once this returns, the worker gets a copy
+    char *copy = google::protobuf::Arena::CreateArray<char>(arena, len);
+    if (len > 0) {
+      ::memcpy(copy, request, len);
+    }
+    RpcChannelPtr self(shared_from_this());
+    executor->submit([self, entry, id, copy, len, arena, callArena] {
+      self->invokeMethod(entry, id, copy, len, NULL, self, arena, callArena);
+    });
+  } else if (executor) {
+    RpcChannelPtr self(shared_from_this());
+    std::string copy =
+        compressed ? std::move(uncompressed) : std::string(request, len);
+    executor->submit([self, entry, id, copy = std::move(copy)] {
+      self->invokeMethod(entry, id, copy.data(),
+                         static_cast<int>(copy.size()), NULL, self, NULL,
+                         std::shared_ptr<const void>());
+    });
   } else {
-    error = NO_SERVICE;
+    invokeMethod(entry, id, request, len, NULL, RpcChannelPtr(), arena,
+                 callArena);
   }
-  if (error != NO_ERROR) {
-    RpcMessage response;
-    response.set_type(RESPONSE);
-    response.set_id(message.id());
-    response.set_error(error);
-    codec_.send(conn_, response);  // // 通过 codec_ 发送回客户端
-  }
-}
-
-void RpcChannel::doneCallback(::google::protobuf::Message *response,
-                              int64_t id) {
-  std::unique_ptr<google::protobuf::Message> d(response);
-  RpcMessage message;
-  message.set_type(RESPONSE);
-  message.set_id(id);
-  message.set_response(response->SerializeAsString());  // FIXME: error check
-  codec_.send(conn_, message);
+}
+
+ErrorCode RpcChannel::resolve(const char *service, size_t serviceLen,
+                              const char *method, size_t methodLen,
+                              MethodEntry *entry) {
+  if (dispatch_) {
+    const MethodEntry *found =
+        dispatch_->find(service, serviceLen, method, methodLen);
+    if (found) {
+      *entry = *found;
+      return NO_ERROR;
+    }
+  }
+  if (!services_) {
+    return NO_SERVICE;
+  }
+  serviceName_.assign(service, serviceLen);
+  std::map<std::string, google::protobuf::Service *>::const_iterator it =
+      services_->find(serviceName_);
+  if (it == services_->end()) {
+    return NO_SERVICE;
+  }
+  if (dispatch_) {
+    return NO_METHOD;
+  }
+  entry->service = it->second;
+  assert(entry->service != NULL);
+  methodName_.assign(method, methodLen);
+  const google::protobuf::ServiceDescriptor *desc =
+      entry->service->GetDescriptor();
+  entry->method = desc->FindMethodByName(methodName_);
+  if (!entry->method) {
+    return NO_METHOD;
+  }
+  entry->requestPrototype = &entry->service->GetRequestPrototype(entry->method);
+  entry->responsePrototype =
+      &entry->service->GetResponsePrototype(entry->method);
+  entry->executor = executorOf(entry->method);
+  entry->stats = NULL;
+  return NO_ERROR;
+}
+
+ErrorCode RpcChannel::resolveId(uint32_t methodId, MethodEntry *entry) {
+  const MethodEntry *found = dispatch_ ? dispatch_->findById(methodId) : NULL;
+  if (!found) {
+    return NO_METHOD;
+  }
+  *entry = *found;
+  return NO_ERROR;
+}
+
+WorkStealingPool *RpcChannel::executorOf(
+    const google::protobuf::MethodDescriptor *method) const {
+  if (executors_) {
+    ExecutorMap::const_iterator e = executors_->find(method);
+    if (e != executors_->end()) {
+      return e->second;
+    }
+  }
+  return NULL;
+}
+
+void RpcChannel::invokeMethod(const MethodEntry &entry, int64_t id,
+                              const char *data, int len,
+                              const std::vector<Slice> *slices,
+                              const RpcChannelPtr &pin,
+                              google::protobuf::Arena *arena,
+                              const std::shared_ptr<const void> &arenaOwner) {
+  if (entry.stats) {
+    entry.stats->calls.fetch_add(1, std::memory_order_relaxed);
+  }
+  google::protobuf::Message *request =
+      entry.requestPrototype->New(arena);   // 当前 RPC 方法的请求消息原型
+  // on the heap it goes when the method returns, on an arena after done
+  std::unique_ptr<google::protobuf::Message> d(arena ? NULL : request);
+  if (!ProtoRpcCodec::parsePayload(data, len, slices, request)) {
+    if (entry.stats) {
+      entry.stats->invalidRequests.fetch_add(1, std::memory_order_relaxed);
+    }
+    sendError(id, INVALID_REQUEST);
+    return;
+  }
+  google::protobuf::Message *response =
+      entry.responsePrototype->New(arena); // 用于存储服务器生成的响应数据
+  // response is deleted in doneCallback
+  DoneClosure *done =
+      arena ? google::protobuf::Arena::Create<DoneClosure>(
+                  arena, this, pin, response, id, entry.method, arenaOwner)
+            : new DoneClosure(this, pin, response, id, entry.method,
+                              arenaOwner);
+  entry.service->CallMethod(entry.method, NULL, request, response, done);  // 处理请求
+}
+
+void RpcChannel::sendError(int64_t id, ErrorCode error) {
+  codec_.sendResponse(conn_, id, error, NULL, NULL);  // 通过 codec_ 发送回客户端
+}
+
+void RpcChannel::doneCallback(
+    ::google::protobuf::Message *response, int64_t id,
+    const ::google::protobuf::MethodDescriptor *method) {
+  std::unique_ptr<google::protobuf::Message> d(
+      response->GetArena() ? NULL : response);
+  codec_.sendResponse(conn_, id, NO_ERROR, response, method);  // FIXME: error check
 }
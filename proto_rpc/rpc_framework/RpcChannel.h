@@ -1,10 +1,14 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <mutex>
+#include <unordered_map>
 
 #include <google/protobuf/service.h>
 
+#include "CallArena.h"
+#include "DispatchTable.h"
 #include "RpcCodec.h"
 
 #include "rpc.pb.h"
@@ -28,6 +32,8 @@ class Service;
 
 namespace network {
 
+class WorkStealingPool;
+
 // Abstract interface for an RPC channel.  An RpcChannel represents a
 // communication line to a Service which can be used to call that Service's
 // methods.  The Service may be running on another machine.  Normally, you
@@ -37,26 +43,62 @@ namespace network {
 //   RpcChannel* channel = new MyRpcChannel("remotehost.example.com:1234");
 //   MyService* service = new MyService::Stub(channel);
 //   service->MyMethod(request, &response, callback);
-class RpcChannel : public ::google::protobuf::RpcChannel {
+class RpcChannel : public ::google::protobuf::RpcChannel,
+                   public std::enable_shared_from_this<RpcChannel> {
  public:
+  typedef std::map<const ::google::protobuf::MethodDescriptor *,
+                   WorkStealingPool *>
+      ExecutorMap;
+
   RpcChannel();
 
   explicit RpcChannel(const TcpConnectionPtr &conn);
 
   ~RpcChannel() override;
 
-  void setConnection(const TcpConnectionPtr &conn) { conn_ = conn; }
+  /// Method ids negotiated on the previous connection are dropped.
+  void setConnection(const TcpConnectionPtr &conn);
 
   void setServices(
       const std::map<std::string, ::google::protobuf::Service *> *services) {
     services_ = services;
   }
 
+  /// Methods in @c executors run on their pool, the others inline in the
+  /// I/O loop. The channel must be owned by a RpcChannelPtr then.
+  void setExecutors(const ExecutorMap *executors) { executors_ = executors; }
+
+  /// Requests are resolved in @c table, with no string built, what
+  /// RpcServer does. The services still tell NO_SERVICE from NO_METHOD.
+  void setDispatchTable(const DispatchTable *table) { dispatch_ = table; }
+
+  /// Serves every call on a CallArena: the envelope, the request, the
+  /// response and the done closure, and v2 requests copied for a worker.
+  /// Handlers find the arena with request->GetArena(). On a client, v1
+  /// responses are parsed on arenas. Off by default.
+  void setArenaPerCall(bool on) {
+    arenaPerCall_ = on;
+    codec_.setArenaPerMessage(on);
+  }
+
+  /// Asks the server for its MethodTableService table with the first call
+  /// and sends later calls with a method id instead of the service and
+  /// method names, named still for methods not in the table. A server
+  /// without the service answers NO_SERVICE and calls stay named. Off by
+  /// default.
+  void setMethodIds(bool on) { useMethodIds_ = on; }
+
+  /// The wire format and checksum options, see ProtoRpcCodec::setWireFormat
+  /// and ProtoRpcCodec::setChecksumType.
+  ProtoRpcCodec *codec() { return &codec_; }
+
   // Call the given method of the remote service.  The signature of this
   // procedure looks the same as Service::CallMethod(), but the requirements
   // are less strict in one important way:  the request and response objects
   // need not be of any specific class as long as their descriptors are
   // method->input_type() and method->output_type().
+  // A call the server answers with an error, or whose response doesn't
+  // parse, fails on @c controller, if not NULL, before @c done runs.
   // 负责在客户端调用远程服务的方法
   void CallMethod(const ::google::protobuf::MethodDescriptor *method,
                   ::google::protobuf::RpcController *controller,
@@ -70,19 +112,59 @@ class RpcChannel : public ::google::protobuf::RpcChannel {
   // 进一步解析 RPC 消息，并调用相应的服务方法或处理响应
   void onRpcMessage(const TcpConnectionPtr &conn,
                     const RpcMessagePtr &messagePtr);
+  // the same for v2 frames, whose payload is parsed in place
+  void onRpcFrame(const TcpConnectionPtr &conn, const RpcFrame &frame);
 
   // 处理 RPC 请求完成后的回调
   // 当服务器处理完一个 RPC 请求后，会调用这个函数将结果打包并发送回客户端
-  void doneCallback(::google::protobuf::Message *response, int64_t id);
+  void doneCallback(::google::protobuf::Message *response, int64_t id,
+                    const ::google::protobuf::MethodDescriptor *method);
 
   // 处理从远程服务器接收到的响应消息
   void handle_response_msg(const RpcMessagePtr &messagePtr);
+  void handle_response_frame(const RpcFrame &frame);
+  struct OutstandingCall;
+  // removes call @c id from outstandings_, response NULL if unknown
+  OutstandingCall takeCall(int64_t id);
+  // parses the response, from @c slices if not NULL, and runs done. The
+  // call fails on the controller with @c error, or if it doesn't parse.
+  void completeCall(const OutstandingCall &out, ErrorCode error,
+                    const char *response, int len,
+                    const std::vector<Slice> *slices = NULL);
   // 负责处理客户端发来的 RPC 请求消息，并将其转发给注册的服务（Service）进行处理，最后将响应发送回客户端
-  void handle_request_msg(const TcpConnectionPtr &conn,
+  void handle_request_msg(const TcpConnectionPtr &,
                           const RpcMessagePtr &messagePtr);
+  void handle_request_frame(const RpcFrame &frame);
+  // NO_ERROR if the service has the method
+  ErrorCode resolve(const char *service, size_t serviceLen,
+                    const char *method, size_t methodLen, MethodEntry *entry);
+  // the same for a method id, in dispatch_ only
+  ErrorCode resolveId(uint32_t methodId, MethodEntry *entry);
+  // 0 to send @c method named, @c askTable set if the table is to be asked
+  // for, with mutex_ held
+  uint32_t methodIdOf(const ::google::protobuf::MethodDescriptor *method,
+                      bool *askTable);
+  void requestMethodTable();
+  void onMethodTable(MethodTable *table);
+  // NULL for the methods run in the I/O loop
+  WorkStealingPool *executorOf(
+      const ::google::protobuf::MethodDescriptor *method) const;
+  // parses the request, from @c slices if not NULL, and calls the method,
+  // on the I/O loop or a worker, on @c arena if not NULL, which
+  // @c arenaOwner keeps
+  void invokeMethod(const MethodEntry &entry, int64_t id, const char *request,
+                    int len, const std::vector<Slice> *slices,
+                    const std::shared_ptr<RpcChannel> &pin,
+                    ::google::protobuf::Arena *arena,
+                    const std::shared_ptr<const void> &arenaOwner);
+  void sendError(int64_t id, ErrorCode error);
+  // done of a served call, keeps the channel alive if pinned
+  class DoneClosure;
   struct OutstandingCall {
     ::google::protobuf::Message *response;   // 存储服务器回复的位置
     ::google::protobuf::Closure *done;       // 收到响应后将执行的回调函数
+    const ::google::protobuf::MethodDescriptor *method;
+    ::google::protobuf::RpcController *controller;  // NULL if none
   };
 
   ProtoRpcCodec codec_;
@@ -93,6 +175,20 @@ class RpcChannel : public ::google::protobuf::RpcChannel {
   std::map<int64_t, OutstandingCall> outstandings_;      // (尚未完成)存储正在等待响应的 RPC 调用信息，包括响应消息和回调
 
   const std::map<std::string, ::google::protobuf::Service *> *services_;     // 保存服务名称到服务对象的映射，用于查找并处理 RPC 请求
+  const ExecutorMap *executors_;  // 在工作线程中执行的方法
+  const DispatchTable *dispatch_;
+  bool arenaPerCall_;
+  bool useMethodIds_;
+  // the server's method table, guarded by mutex_
+  bool methodTableAsked_;
+  std::unordered_map<std::string, uint32_t> idsByName_;
+  // resolved from idsByName_ on first use, 0 for unknown methods
+  std::unordered_map<const ::google::protobuf::MethodDescriptor *, uint32_t>
+      methodIds_;
+  // names of the request being resolved without dispatch_, reused to save
+  // the mallocs
+  std::string serviceName_;
+  std::string methodName_;
 };
 typedef std::shared_ptr<RpcChannel> RpcChannelPtr;
 
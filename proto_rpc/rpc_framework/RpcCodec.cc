@@ -2,25 +2,320 @@
 
 #include <zlib.h>
 
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/message.h>
+#include <google/protobuf/wire_format_lite.h>
 
+#include "CallArena.h"
+#include "Crc32c.h"
+#include "SliceInputStream.h"
 #include "network/Endian.h"
+#include "network/EventLoop.h"
 #include "network/TcpConnection.h"
 
 using namespace network;
 
 namespace network {
   
+namespace {
+
+const std::string kNoName;
+
+uint8_t *putInt16(uint8_t *p, int16_t x) {
+  const int16_t be16 = sockets::hostToNetwork16(x);
+  ::memcpy(p, &be16, sizeof be16);
+  return p + sizeof be16;
+}
+
+uint8_t *putInt32(uint8_t *p, int32_t x) {
+  const int32_t be32 = sockets::hostToNetwork32(x);
+  ::memcpy(p, &be32, sizeof be32);
+  return p + sizeof be32;
+}
+
+uint8_t *putInt64(uint8_t *p, int64_t x) {
+  const int64_t be64 = sockets::hostToNetwork64(x);
+  ::memcpy(p, &be64, sizeof be64);
+  return p + sizeof be64;
+}
+
+}  // namespace
+
+/// What a frame is made of, sized by frameSize() before writeFrame() puts
+/// it where it goes.
+struct ProtoRpcCodec::FrameParts {
+  FrameParts(WireFormat wireFormat, ChecksumType checksum)
+      : format(wireFormat),
+        checksumType(checksum),
+        envelope(NULL),
+        payloadField(0),
+        type(REQUEST),
+        flags(0),
+        error(NO_ERROR),
+        id(0),
+        service(&kNoName),
+        method(&kNoName),
+        methodId(0),
+        payload(NULL),
+        bytes(NULL),
+        payloadLen(0) {}
+
+  WireFormat format;
+  ChecksumType checksumType;
+  // v1, the payload goes in field payloadField of the envelope, if any
+  const ::google::protobuf::Message *envelope;
+  int payloadField;
+  // v2 header
+  MessageType type;
+  uint8_t flags;
+  ::network::ErrorCode error;
+  int64_t id;
+  const std::string *service;
+  const std::string *method;
+  uint32_t methodId;  // 0 if named
+  // serialized straight into the frame, or in @c bytes already
+  const ::google::protobuf::Message *payload;
+  const std::string *bytes;
+  size_t payloadLen;
+};
+
 void ProtoRpcCodec::send(const TcpConnectionPtr &conn,
                          const ::google::protobuf::Message &message) {
-  Buffer buf;
-  fillEmptyBuffer(&buf, message);
-  conn->send(&buf);
+  FrameParts parts(kProtobufEnvelope, checksumType());
+  parts.envelope = &message;
+  sendFrame(conn, parts);
+}
+
+void ProtoRpcCodec::sendRequest(
+    const TcpConnectionPtr &conn, int64_t id,
+    const ::google::protobuf::MethodDescriptor *method,
+    const ::google::protobuf::Message &request, uint32_t methodId) {
+  FrameParts parts(wireFormat(), checksumType());
+  RpcMessage envelope;
+  std::string raw;
+  std::string compressed;
+  if (parts.format == kFlatHeader) {
+    parts.type = REQUEST;
+    parts.id = id;
+    parts.methodId = methodId;
+    if (!methodId) {
+      parts.service = &method->service()->full_name();
+      parts.method = &method->name();
+    }
+    setPayload(&parts, &request, compressionOf(method), &raw, &compressed);
+  } else {
+    envelope.set_type(REQUEST);
+    envelope.set_id(id);
+    if (methodId) {
+      envelope.set_method_id(methodId);
+    } else {
+      envelope.set_service(method->service()->full_name());
+      envelope.set_method(method->name());
+    }
+    parts.envelope = &envelope;
+    parts.payloadField = RpcMessage::kRequestFieldNumber;
+    setPayload(&parts, &request, NULL, NULL, NULL);
+  }
+  sendFrame(conn, parts);
+}
+
+void ProtoRpcCodec::sendResponse(
+    const TcpConnectionPtr &conn, int64_t id, ::network::ErrorCode error,
+    const ::google::protobuf::Message *response,
+    const ::google::protobuf::MethodDescriptor *method) {
+  FrameParts parts(wireFormat(), checksumType());
+  RpcMessage envelope;
+  std::string raw;
+  std::string compressed;
+  if (parts.format == kFlatHeader) {
+    parts.type = RESPONSE;
+    parts.id = id;
+    parts.error = error;
+    setPayload(&parts, response, compressionOf(method), &raw, &compressed);
+  } else {
+    envelope.set_type(RESPONSE);
+    envelope.set_id(id);
+    envelope.set_error(error);
+    parts.envelope = &envelope;
+    parts.payloadField = RpcMessage::kResponseFieldNumber;
+    setPayload(&parts, response, NULL, NULL, NULL);
+  }
+  sendFrame(conn, parts);
+}
+
+void ProtoRpcCodec::sendFrame(const TcpConnectionPtr &conn,
+                              const FrameParts &parts) {
+  if (!conn->connected()) {
+    return;
+  }
+  const size_t size = frameSize(parts);
+  if (conn->getLoop()->isInLoopThread()) {
+    // serialized straight into the output queue and written from there
+    writeFrame(parts, conn->reserveOutput(size), size);
+    conn->commitOutput(size);
+  } else {
+    // serialized once, the loop takes the buffer over
+    Buffer buf;
+    buf.ensureWritableBytes(size);
+    writeFrame(parts, buf.beginWrite(), size);
+    buf.hasWritten(size);
+    conn->send(std::move(buf));
+  }
+}
+
+void ProtoRpcCodec::setPayload(FrameParts *parts,
+                               const ::google::protobuf::Message *payload,
+                               const MethodCompression *compression,
+                               std::string *raw,
+                               std::string *compressed) const {
+  parts->payload = payload;
+  // caches the sizes for the serialization
+  parts->payloadLen = payload ? payload->ByteSizeLong() : 0;
+  // larger ones the peer would reject compressed, with the same setting
+  if (!compression || parts->payloadLen == 0 ||
+      parts->payloadLen < compression->threshold ||
+      parts->payloadLen > maxUncompressedBytes_) {
+    return;
+  }
+  // compressed first, kept only if smaller
+  raw->resize(parts->payloadLen);
+  payload->SerializeWithCachedSizesToArray(
+      reinterpret_cast<uint8_t *>(&(*raw)[0]));
+  int32_t be32 =
+      sockets::hostToNetwork32(static_cast<int32_t>(parts->payloadLen));
+  compressed->append(reinterpret_cast<const char *>(&be32), sizeof be32);
+  if (compression->compressor->compress(raw->data(), raw->size(),
+                                        compressed) &&
+      compressed->size() < raw->size()) {
+    parts->flags |= RpcFrame::kCompressed;
+    parts->bytes = compressed;
+  } else {
+    parts->bytes = raw;
+  }
+  parts->payloadLen = parts->bytes->size();
+}
+
+size_t ProtoRpcCodec::frameSize(const FrameParts &parts) {
+  size_t size = kHeaderLen + kTagLen + kChecksumLen + parts.payloadLen;
+  if (parts.format == kFlatHeader) {
+    size += kFrameHeaderLen;
+    if (!parts.methodId) {
+      size += parts.service->size() + parts.method->size();
+    }
+  } else {
+    size += parts.envelope->ByteSizeLong();
+    if (parts.payloadLen > 0) {
+      const uint32_t tag = ::google::protobuf::internal::WireFormatLite::MakeTag(
+          parts.payloadField,
+          ::google::protobuf::internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+      size += ::google::protobuf::io::CodedOutputStream::VarintSize32(tag) +
+              ::google::protobuf::io::CodedOutputStream::VarintSize32(
+                  static_cast<uint32_t>(parts.payloadLen));
+    }
+  }
+  return size;
+}
+
+void ProtoRpcCodec::writeFrame(const FrameParts &parts, char *dest,
+                               size_t size) {
+  uint8_t *const start = reinterpret_cast<uint8_t *>(dest);
+  uint8_t *p = start + kHeaderLen;  // the length goes last
+  ::memcpy(p, tagOf(parts.format, parts.checksumType), kTagLen);
+  p += kTagLen;
+  if (parts.format == kFlatHeader) {
+    assert(parts.service->size() <= UINT16_MAX &&
+           parts.method->size() <= UINT16_MAX);
+    *p++ = static_cast<uint8_t>(parts.type);
+    *p++ = parts.flags | (parts.methodId ? RpcFrame::kMethodId : 0);
+    p = putInt16(p, static_cast<int16_t>(parts.error));
+    p = putInt64(p, parts.id);
+    if (parts.methodId) {
+      p = putInt32(p, static_cast<int32_t>(parts.methodId));
+    } else {
+      p = putInt16(p, static_cast<int16_t>(parts.service->size()));
+      p = putInt16(p, static_cast<int16_t>(parts.method->size()));
+      ::memcpy(p, parts.service->data(), parts.service->size());
+      p += parts.service->size();
+      ::memcpy(p, parts.method->data(), parts.method->size());
+      p += parts.method->size();
+    }
+  } else {
+    p = parts.envelope->SerializeWithCachedSizesToArray(p);
+    if (parts.payloadLen > 0) {
+      // the payload field written here rather than serialized into a
+      // string for the envelope to copy
+      p = ::google::protobuf::io::CodedOutputStream::WriteTagToArray(
+          ::google::protobuf::internal::WireFormatLite::MakeTag(
+              parts.payloadField, ::google::protobuf::internal::
+                                      WireFormatLite::WIRETYPE_LENGTH_DELIMITED),
+          p);
+      p = ::google::protobuf::io::CodedOutputStream::WriteVarint32ToArray(
+          static_cast<uint32_t>(parts.payloadLen), p);
+    }
+  }
+  if (parts.bytes) {
+    ::memcpy(p, parts.bytes->data(), parts.bytes->size());
+    p += parts.bytes->size();
+  } else if (parts.payloadLen > 0) {
+    p = parts.payload->SerializeWithCachedSizesToArray(p);
+  }
+  const int32_t sum =
+      checksum(parts.checksumType, start + kHeaderLen,
+               static_cast<int>(p - start - kHeaderLen));
+  p = putInt32(p, sum);
+  assert(p == start + size);
+  putInt32(start, static_cast<int32_t>(size - kHeaderLen));
+}
+
+bool ProtoRpcCodec::uncompress(
+    const RpcFrame &frame, const ::google::protobuf::MethodDescriptor *method,
+    std::string *message) const {
+  const MethodCompression *compression = compressionOf(method);
+  if (!compression || frame.payloadLen < static_cast<int>(sizeof(int32_t))) {
+    return false;
+  }
+  const int32_t len = asInt32(frame.payload);
+  const size_t compressedLen = frame.payloadLen - sizeof(int32_t);
+  // the length is the peer's word, checked before it is allocated
+  if (len < 0 || static_cast<size_t>(len) > maxUncompressedBytes_ ||
+      static_cast<size_t>(len) >
+          compressedLen * compression->compressor->maxRatio()) {
+    return false;
+  }
+  message->resize(len);
+  return compression->compressor->decompress(
+      frame.payload + sizeof(int32_t), compressedLen, &(*message)[0], len);
+}
+
+const MethodCompression *ProtoRpcCodec::compressionOf(
+    const ::google::protobuf::MethodDescriptor *method) const {
+  if (compressions_ && method) {
+    CompressionMap::const_iterator it = compressions_->find(method);
+    if (it != compressions_->end()) {
+      return &it->second;
+    }
+  }
+  return NULL;
 }
 
 void ProtoRpcCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf) {
-  while (buf->readableBytes() >=
-         static_cast<uint32_t>(kMinMessageLen + kHeaderLen)) {
+  // a backpressured connection gets the rest once its output drained
+  while (!conn->backpressured()) {
+    if (chainFrameLen_ > 0) {
+      if (!gather(buf)) {
+        break;
+      }
+      if (onChainedFrame(conn) != kNoError) {
+        // errorCallback_(conn, buf, receiveTime, errorCode);
+        break;
+      }
+      continue;
+    }
+    if (buf->readableBytes() <
+        static_cast<uint32_t>(kMinMessageLen + kHeaderLen)) {
+      break;
+    }
     const int32_t len = buf->peekInt32();  // 头部读取长度
     if (len > kMaxMessageLen || len < kMinMessageLen) {
       // errorCallback_(conn, buf, receiveTime, kInvalidLength);
@@ -31,23 +326,200 @@ void ProtoRpcCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf) {
       //   buf->retrieve(kHeaderLen + len);
       //   continue;
       // }
-      RpcMessagePtr message(new RpcMessage());
-      // FIXME: can we move deserialization & callback to other thread?
-      ErrorCode errorCode = parse(buf->peek() + kHeaderLen, len, message.get());
-      if (errorCode == kNoError) {
-        // FIXME: try { } catch (...) { }
-        messageCallback_(conn, message);
-        buf->retrieve(kHeaderLen + len);
-      } else {
+      ErrorCode errorCode = onFrame(conn, buf->peek() + kHeaderLen, len);
+      if (errorCode != kNoError) {
         // errorCallback_(conn, buf, receiveTime, errorCode);
         break;
       }
+      // the frame points into buf, retrieved after the callback
+      buf->retrieve(kHeaderLen + len);
+    } else if (chainThreshold_ > 0 &&
+               static_cast<size_t>(kHeaderLen + len) >= chainThreshold_) {
+      // the rest of the frame is gathered in slices as it comes
+      chainFrameLen_ = kHeaderLen + len;
+      chainBytes_ = 0;
+      gather(buf);
+      break;
     } else {
       break;
     }
   }
 }
 
+ProtoRpcCodec::ErrorCode ProtoRpcCodec::onFrame(const TcpConnectionPtr &conn,
+                                                const char *data, int len) {
+  WireFormat format = kProtobufEnvelope;
+  ChecksumType type = kAdler32;
+  ErrorCode errorCode = checkFrame(data, len, &format, &type);
+  if (errorCode != kNoError) {
+    return errorCode;
+  }
+  if (format == kProtobufEnvelope) {
+    // only the envelope is parsed here, the request payload is parsed by
+    // RpcChannel, on the method's executor if it has one
+    RpcMessagePtr message = newEnvelope();
+    if (!parseFromBuffer(data + kTagLen, len - kTagLen - kChecksumLen,
+                         message.get())) {
+      return kParseError;
+    }
+    adoptFormat(format, type);
+    // FIXME: try { } catch (...) { }
+    messageCallback_(conn, message);
+    return kNoError;
+  }
+  RpcFrame frame;
+  errorCode = frameCallback_ ? decodeFrame(data + kTagLen,
+                                           len - kTagLen - kChecksumLen,
+                                           &frame)
+                             : kUnknownMessageType;
+  if (errorCode != kNoError) {
+    return errorCode;
+  }
+  adoptFormat(format, type);
+  frameCallback_(conn, frame);
+  return kNoError;
+}
+
+bool ProtoRpcCodec::gather(Buffer *buf) {
+  const size_t need = chainFrameLen_ - chainBytes_;
+  const size_t readable = buf->readableBytes();
+  if (readable == 0) {
+    return false;
+  }
+  if (readable <= need) {
+    // the storage moves over, nothing is copied
+    chain_.push_back(Slice::fromBuffer(std::move(*buf)));
+    chainBytes_ += readable;
+  } else if (need <= readable - need) {
+    // the end of the frame is copied, what follows stays
+    Buffer end;
+    end.append(buf->peek(), need);
+    buf->retrieve(need);
+    chain_.push_back(Slice::fromBuffer(std::move(end)));
+    chainBytes_ += need;
+  } else {
+    // the start of the next frame is copied back
+    Buffer next;
+    next.append(buf->peek() + need, readable - need);
+    chain_.push_back(Slice::fromBuffer(std::move(*buf)).subslice(0, need));
+    buf->swap(next);
+    chainBytes_ += need;
+  }
+  return chainBytes_ == chainFrameLen_;
+}
+
+ProtoRpcCodec::ErrorCode ProtoRpcCodec::onChainedFrame(
+    const TcpConnectionPtr &conn) {
+  std::vector<Slice> chain;
+  chain.swap(chain_);
+  const int len = static_cast<int>(chainFrameLen_) - kHeaderLen;
+  chainFrameLen_ = 0;
+  chainBytes_ = 0;
+  SliceInputStream::removePrefix(&chain, kHeaderLen);
+
+  char tag[kTagLen];
+  char trailer[kChecksumLen];
+  WireFormat format = kProtobufEnvelope;
+  ChecksumType type = kAdler32;
+  if (len < kTagLen + kChecksumLen ||
+      !SliceInputStream::copyOut(chain, 0, kTagLen, tag) ||
+      !SliceInputStream::copyOut(chain, len - kChecksumLen, kChecksumLen,
+                                 trailer) ||
+      !typeOfTag(tag, &format, &type)) {
+    return kUnknownMessageType;
+  }
+  if (type == kNoChecksum && !acceptsUnchecked()) {
+    return kUncheckedFrame;
+  }
+  SliceInputStream::removeSuffix(&chain, kChecksumLen);
+  if (checksum(type, chain) != asInt32(trailer)) {
+    return kCheckSumError;
+  }
+  SliceInputStream::removePrefix(&chain, kTagLen);
+  const int bodyLen = len - kTagLen - kChecksumLen;
+
+  if (format == kProtobufEnvelope) {
+    RpcMessagePtr message = newEnvelope();
+    SliceInputStream in(chain);
+    if (!message->ParseFromZeroCopyStream(&in)) {
+      return kParseError;
+    }
+    adoptFormat(format, type);
+    messageCallback_(conn, message);
+    return kNoError;
+  }
+  if (!frameCallback_) {
+    return kUnknownMessageType;
+  }
+  RpcFrame frame;
+  char header[kFrameHeaderLen];
+  if (bodyLen < kFrameHeaderLen) {
+    return kInvalidLength;
+  }
+  SliceInputStream::copyOut(chain, 0, kFrameHeaderLen, header);
+  ErrorCode errorCode = decodeFrameHeader(header, &frame);
+  if (errorCode != kNoError) {
+    return errorCode;
+  }
+  const int namesLen = frame.serviceLen + frame.methodLen;
+  if (bodyLen < kFrameHeaderLen + namesLen) {
+    return kInvalidNameLen;
+  }
+  std::string names(namesLen, '\0');
+  if (namesLen > 0) {
+    SliceInputStream::copyOut(chain, kFrameHeaderLen, namesLen, &names[0]);
+  }
+  SliceInputStream::removePrefix(&chain, kFrameHeaderLen + namesLen);
+  frame.service = names.data();
+  frame.method = names.data() + frame.serviceLen;
+  frame.payloadLen = bodyLen - kFrameHeaderLen - namesLen;
+  std::string flat;
+  if (frame.flags & RpcFrame::kCompressed) {
+    // uncompress() takes the payload in one piece
+    flat.resize(frame.payloadLen);
+    SliceInputStream::copyOut(chain, 0, flat.size(), &flat[0]);
+    frame.payload = flat.data();
+    frame.payloadSlices = NULL;
+  } else {
+    frame.payload = NULL;
+    frame.payloadSlices = &chain;
+  }
+  adoptFormat(format, type);
+  frameCallback_(conn, frame);
+  return kNoError;
+}
+
+RpcMessagePtr ProtoRpcCodec::newEnvelope() const {
+  if (arenaPerMessage_) {
+    CallArenaPtr arena(std::make_shared<CallArena>());
+    return RpcMessagePtr(
+        arena, ::google::protobuf::Arena::CreateMessage<RpcMessage>(
+                   arena->arena()));
+  }
+  return std::make_shared<RpcMessage>();
+}
+
+void ProtoRpcCodec::adoptFormat(WireFormat format, ChecksumType type) {
+  if (replyInKind_) {
+    if (format != wireFormat()) {
+      setWireFormat(format);
+    }
+    if (type != checksumType()) {
+      setChecksumType(type);
+    }
+  }
+}
+
+bool ProtoRpcCodec::parsePayload(const char *data, int len,
+                                 const std::vector<Slice> *slices,
+                                 google::protobuf::Message *message) {
+  if (slices) {
+    SliceInputStream in(*slices);
+    return message->ParseFromZeroCopyStream(&in);
+  }
+  return message->ParseFromArray(data, len);
+}
+
 bool ProtoRpcCodec::parseFromBuffer(const void *buf, int len,
                                     google::protobuf::Message *message) {
   return message->ParseFromArray(buf, len);
@@ -74,46 +546,131 @@ int ProtoRpcCodec::serializeToBuffer(const google::protobuf::Message &message,
 }
 
 ProtoRpcCodec::ErrorCode ProtoRpcCodec::parse(
-    const char *buf, int len, ::google::protobuf::Message *message) {
-  ErrorCode error = kNoError;
-
-  if (validateChecksum(buf, len)) {
-    if (memcmp(buf, tag_.data(), tag_.size()) == 0) {
-      // parse from buffer
-      const char *data = buf + tag_.size();
-      int32_t dataLen = len - kChecksumLen - static_cast<int>(tag_.size());
-      if (parseFromBuffer(data, dataLen, message)) {
-        error = kNoError;
-      } else {
-        error = kParseError;
-      }
-    } else {
-      error = kUnknownMessageType;
-    }
-  } else {
-    error = kCheckSumError;
+    const char *buf, int len, ::google::protobuf::Message *message,
+    ChecksumType *type) {
+  WireFormat format = kProtobufEnvelope;
+  ChecksumType frameType = kAdler32;
+  ErrorCode error = checkFrame(buf, len, &format, &frameType);
+  if (error != kNoError) {
+    return error;
+  }
+  if (format != kProtobufEnvelope) {
+    return kUnknownMessageType;
   }
+  if (type) {
+    *type = frameType;
+  }
+  // parse from buffer
+  const char *data = buf + kTagLen;
+  int32_t dataLen = len - kChecksumLen - kTagLen;
+  return parseFromBuffer(data, dataLen, message) ? kNoError : kParseError;
+}
+
+ProtoRpcCodec::ErrorCode ProtoRpcCodec::checkFrame(const char *buf, int len,
+                                                   WireFormat *format,
+                                                   ChecksumType *type) const {
+  if (len < kTagLen + kChecksumLen || !typeOfTag(buf, format, type)) {
+    return kUnknownMessageType;
+  }
+  if (*type == kNoChecksum && !acceptsUnchecked()) {
+    return kUncheckedFrame;
+  }
+  return validateChecksum(*type, buf, len) ? kNoError : kCheckSumError;
+}
+
+ProtoRpcCodec::ErrorCode ProtoRpcCodec::decodeFrame(const char *buf, int len,
+                                                    RpcFrame *frame) {
+  if (len < kFrameHeaderLen) {
+    return kInvalidLength;
+  }
+  ErrorCode error = decodeFrameHeader(buf, frame);
+  if (error != kNoError) {
+    return error;
+  }
+  const int namesLen = frame->serviceLen + frame->methodLen;
+  if (len < kFrameHeaderLen + namesLen) {
+    return kInvalidNameLen;
+  }
+  frame->service = buf + kFrameHeaderLen;
+  frame->method = frame->service + frame->serviceLen;
+  frame->payload = frame->method + frame->methodLen;
+  frame->payloadLen = len - kFrameHeaderLen - namesLen;
+  frame->payloadSlices = NULL;
+  return kNoError;
+}
 
-  return error;
+ProtoRpcCodec::ErrorCode ProtoRpcCodec::decodeFrameHeader(const char *buf,
+                                                          RpcFrame *frame) {
+  const uint8_t type = static_cast<uint8_t>(buf[0]);
+  if (type != REQUEST && type != RESPONSE) {
+    return kUnknownMessageType;
+  }
+  frame->type = static_cast<MessageType>(type);
+  frame->flags = static_cast<uint8_t>(buf[1]);
+  uint16_t be16 = 0;
+  ::memcpy(&be16, buf + 2, sizeof be16);
+  frame->error = static_cast<::network::ErrorCode>(
+      sockets::networkToHost16(be16));
+  uint64_t be64 = 0;
+  ::memcpy(&be64, buf + 4, sizeof be64);
+  frame->id = static_cast<int64_t>(sockets::networkToHost64(be64));
+  if (frame->flags & RpcFrame::kMethodId) {
+    frame->methodId = static_cast<uint32_t>(asInt32(buf + 12));
+    frame->serviceLen = 0;
+    frame->methodLen = 0;
+  } else {
+    frame->methodId = 0;
+    ::memcpy(&be16, buf + 12, sizeof be16);
+    frame->serviceLen = sockets::networkToHost16(be16);
+    ::memcpy(&be16, buf + 14, sizeof be16);
+    frame->methodLen = sockets::networkToHost16(be16);
+  }
+  return kNoError;
 }
 
 void ProtoRpcCodec::fillEmptyBuffer(Buffer *buf,
                                     const google::protobuf::Message &message) {
   assert(buf->readableBytes() == 0);
-  buf->append(tag_);
+  const ChecksumType type = checksumType();
+  buf->append(tagOf(kProtobufEnvelope, type), kTagLen);
 
   int byte_size = serializeToBuffer(message, buf);
 
   int32_t checkSum =
-      checksum(buf->peek(), static_cast<int>(buf->readableBytes()));
+      checksum(type, buf->peek(), static_cast<int>(buf->readableBytes()));
   buf->appendInt32(checkSum);
-  assert(buf->readableBytes() == tag_.size() + byte_size + kChecksumLen);
+  assert(buf->readableBytes() ==
+         static_cast<size_t>(kTagLen + byte_size + kChecksumLen));
   (void)byte_size;
   int32_t len =
       sockets::hostToNetwork32(static_cast<int32_t>(buf->readableBytes()));
   buf->prepend(&len, sizeof len);
 }
 
+void ProtoRpcCodec::fillFrame(Buffer *buf, MessageType type, int64_t id,
+                              ::network::ErrorCode error,
+                              const std::string &service,
+                              const std::string &method,
+                              const google::protobuf::Message *payload,
+                              const MethodCompression *compression,
+                              uint32_t methodId) {
+  assert(buf->readableBytes() == 0);
+  FrameParts parts(kFlatHeader, checksumType());
+  parts.type = type;
+  parts.id = id;
+  parts.error = error;
+  parts.service = &service;
+  parts.method = &method;
+  parts.methodId = methodId;
+  std::string raw;
+  std::string compressed;
+  setPayload(&parts, payload, compression, &raw, &compressed);
+  const size_t size = frameSize(parts);
+  buf->ensureWritableBytes(size);
+  writeFrame(parts, buf->beginWrite(), size);
+  buf->hasWritten(size);
+}
+
 int32_t ProtoRpcCodec::asInt32(const char *buf) {
   int32_t be32 = 0;
   ::memcpy(&be32, buf, sizeof(be32));
@@ -126,10 +683,73 @@ int32_t ProtoRpcCodec::checksum(const void *buf, int len) {
 }
 
 bool ProtoRpcCodec::validateChecksum(const char *buf, int len) {
+  return validateChecksum(kAdler32, buf, len);
+}
+
+int32_t ProtoRpcCodec::checksum(ChecksumType type, const void *buf,
+                                int len) {
+  switch (type) {
+    case kCrc32c:
+      return static_cast<int32_t>(crc32c::value(buf, len));
+    case kNoChecksum:
+      return 0;
+    default:
+      return checksum(buf, len);
+  }
+}
+
+int32_t ProtoRpcCodec::checksum(ChecksumType type,
+                                const std::vector<Slice> &slices) {
+  uLong adler = ::adler32(0, NULL, 0);
+  uint32_t crc = 0;
+  for (const Slice &slice : slices) {
+    if (type == kAdler32) {
+      adler = ::adler32(adler, reinterpret_cast<const Bytef *>(slice.data()),
+                        static_cast<uInt>(slice.size()));
+    } else if (type == kCrc32c) {
+      crc = crc32c::extend(crc, slice.data(), slice.size());
+    }
+  }
+  switch (type) {
+    case kCrc32c:
+      return static_cast<int32_t>(crc);
+    case kNoChecksum:
+      return 0;
+    default:
+      return static_cast<int32_t>(adler);
+  }
+}
+
+bool ProtoRpcCodec::validateChecksum(ChecksumType type, const char *buf,
+                                     int len) {
   // check sum
   int32_t expectedCheckSum = asInt32(buf + len - kChecksumLen);
-  int32_t checkSum = checksum(buf, len - kChecksumLen);
+  int32_t checkSum = checksum(type, buf, len - kChecksumLen);
   return checkSum == expectedCheckSum;
 }
 
+// [format][checksum type]
+static const char *const kTags[2][3] = {
+    {"RPC0", "RPCC", "RPCN"},
+    {"RP20", "RP2C", "RP2N"},
+};
+
+const char *ProtoRpcCodec::tagOf(WireFormat format, ChecksumType type) {
+  return kTags[format][type];
+}
+
+bool ProtoRpcCodec::typeOfTag(const char *tag, WireFormat *format,
+                              ChecksumType *type) {
+  for (int f = kProtobufEnvelope; f <= kFlatHeader; ++f) {
+    for (int t = kAdler32; t <= kNoChecksum; ++t) {
+      if (memcmp(tag, kTags[f][t], kTagLen) == 0) {
+        *format = static_cast<WireFormat>(f);
+        *type = static_cast<ChecksumType>(t);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
 }  // namespace network
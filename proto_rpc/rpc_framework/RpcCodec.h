@@ -1,12 +1,22 @@
 #pragma once
 
+#include <atomic>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <type_traits>
+#include <vector>
 
+#include "Compressor.h"
+#include "network/Slice.h"
 #include "rpc.pb.h"
 
+namespace google {
+namespace protobuf {
+class MethodDescriptor;
+}  // namespace protobuf
+}  // namespace google
+
 namespace network {
 
 class Buffer;
@@ -26,6 +36,57 @@ extern const char rpctag[];  // = "RPC0";
 // payload   N-byte
 // checksum  4-byte  adler32 of "RPC0"+payload
 //
+// The tag tells the checksum: "RPC0" adler32, "RPCC" CRC-32C, "RPCN" none
+// (checksum field 0). A codec reads all of them, peers that only know
+// "RPC0" keep working as long as they are sent "RPC0".
+//
+// In v1 ("RPC?" tags) the payload is a RpcMessage holding the request or
+// response serialized again. v2 ("RP2?" tags, same checksums) has a flat
+// header instead, the message follows it as is:
+//
+// Field     Length  Content
+//
+// size      4-byte  N+24+service+method
+// "RP20"    4-byte
+// type      1-byte  MessageType
+// flags     1-byte  kCompressed: the payload is the length of the message
+//                   (4-byte) and the message compressed
+//                   kMethodId: the two name lengths are a method id
+//                   (4-byte) instead, no names follow
+// error     2-byte  ErrorCode
+// id        8-byte
+// service   2-byte  length, then the name, empty in responses
+// method    2-byte  length, then the name, empty in responses
+// payload   N-byte  the request or response
+// checksum  4-byte
+//
+// Method ids are those of the server's MethodTableService, in v1 they go in
+// RpcMessage.method_id.
+//
+
+/// A v2 frame decoded in place: the names and the payload point into the
+/// input buffer, valid during the frame callback only. The payload of a
+/// frame gathered in slices, see ProtoRpcCodec::setChainThreshold, is in
+/// @c payloadSlices, which can be copied to keep it.
+struct RpcFrame {
+  enum Flags {
+    kCompressed = 0x01,
+    kMethodId = 0x02,
+  };
+
+  MessageType type;
+  uint8_t flags;
+  ErrorCode error;
+  int64_t id;
+  const char *service;
+  int serviceLen;
+  const char *method;
+  int methodLen;
+  uint32_t methodId;  // 0 if named
+  const char *payload;  // NULL if in slices
+  int payloadLen;
+  const std::vector<Slice> *payloadSlices;  // NULL if contiguous
+};
 
 class ProtoRpcCodec {
  public:
@@ -33,6 +94,8 @@ class ProtoRpcCodec {
   const static int kChecksumLen = sizeof(int32_t);   // 校验和的长度
   const static int kMaxMessageLen =
       64 * 1024 * 1024;  // same as codec_stream.h kDefaultTotalBytesLimit  消息的最大长度
+  const static size_t kDefaultChainThreshold = 1024 * 1024;
+  const static size_t kDefaultMaxUncompressedBytes = 4 * 1024 * 1024;
   enum ErrorCode {
     kNoError = 0,
     kInvalidLength,
@@ -40,45 +103,211 @@ class ProtoRpcCodec {
     kInvalidNameLen,
     kUnknownMessageType,
     kParseError,
+    kUncheckedFrame,  // "RPCN" without setAcceptUnchecked()
+  };
+  enum ChecksumType {
+    kAdler32 = 0,  // "RPC0"
+    kCrc32c,       // "RPCC", SSE4.2 accelerated
+    kNoChecksum,   // "RPCN", for trusted links, e.g. loopback
+  };
+  enum WireFormat {
+    kProtobufEnvelope = 0,  // v1, "RPC?"
+    kFlatHeader,            // v2, "RP2?"
   };
   typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
   typedef std::function<void(const TcpConnectionPtr &, const RpcMessagePtr &)>
       ProtobufMessageCallback;
+  typedef std::function<void(const TcpConnectionPtr &, const RpcFrame &)>
+      RpcFrameCallback;
 
   typedef std::shared_ptr<google::protobuf::Message> MessagePtr;
 
   explicit ProtoRpcCodec(const ProtobufMessageCallback &messageCb)
-      : messageCallback_(messageCb) {}
+      : messageCallback_(messageCb),
+        compressions_(NULL),
+        wireFormat_(kProtobufEnvelope),
+        checksumType_(kAdler32),
+        replyInKind_(false),
+        acceptUnchecked_(false),
+        arenaPerMessage_(false),
+        chainThreshold_(kDefaultChainThreshold),
+        maxUncompressedBytes_(kDefaultMaxUncompressedBytes),
+        chainFrameLen_(0),
+        chainBytes_(0) {}
   ~ProtoRpcCodec() {}
 
+  /// Checksum of the frames sent, adler32 by default, which every peer
+  /// reads. kNoChecksum also accepts "RPCN" frames, a server replying in
+  /// kind answers with them. Thread safe.
+  void setChecksumType(ChecksumType type) {
+    checksumType_.store(type, std::memory_order_relaxed);
+  }
+  ChecksumType checksumType() const {
+    return checksumType_.load(std::memory_order_relaxed);
+  }
+  /// v2 frames go to @c cb, they are rejected without one.
+  void setFrameCallback(const RpcFrameCallback &cb) { frameCallback_ = cb; }
+
+  /// Format of the frames sent by sendRequest() and sendResponse(), v1 by
+  /// default, which every peer reads. Thread safe.
+  void setWireFormat(WireFormat format) {
+    wireFormat_.store(format, std::memory_order_relaxed);
+  }
+  WireFormat wireFormat() const {
+    return wireFormat_.load(std::memory_order_relaxed);
+  }
+
+  /// Payloads of the methods in @c compressions are compressed from their
+  /// threshold on, in v2 frames. The peer must have the same setting.
+  void setCompressions(const CompressionMap *compressions) {
+    compressions_ = compressions;
+  }
+
+  /// Sends with the format and checksum of the last frame received, what a
+  /// server does so that every client gets answered in a format it knows.
+  void setReplyInKind(bool on) { replyInKind_ = on; }
+  /// Accepts frames without checksum, off by default. Implied while
+  /// sending with kNoChecksum.
+  void setAcceptUnchecked(bool on) { acceptUnchecked_ = on; }
+  /// Parses every v1 envelope on a CallArena of its own, which the
+  /// RpcMessagePtr owns, so that the call can use it too.
+  void setArenaPerMessage(bool on) { arenaPerMessage_ = on; }
+  /// Frames of at least @c bytes, length field included, are not grown
+  /// contiguous in the input buffer, which copies what came in on every
+  /// growth, but moved out of it in slices as they come in and parsed from
+  /// them with a SliceInputStream. 0 turns it off. 1MB by default.
+  void setChainThreshold(size_t bytes) { chainThreshold_ = bytes; }
+  /// Compressed payloads claiming more than @c bytes uncompressed are
+  /// rejected, the memory a peer makes us allocate with a few bytes.
+  /// Larger messages are sent uncompressed, the peer should have the same
+  /// setting. 4MB by default.
+  void setMaxUncompressedBytes(size_t bytes) { maxUncompressedBytes_ = bytes; }
+
+  /// The send functions serialize the frame, in the loop of @c conn right
+  /// into its output queue, where it is sent from.
   // 消息进行序列化，并通过 TcpConnection 发送出去
   void send(const TcpConnectionPtr &conn,
             const ::google::protobuf::Message &message);
 
+  /// Sends a call of @c method in the wire format set, named or, if
+  /// @c methodId is not 0, by the id the server gave it.
+  void sendRequest(const TcpConnectionPtr &conn, int64_t id,
+                   const ::google::protobuf::MethodDescriptor *method,
+                   const ::google::protobuf::Message &request,
+                   uint32_t methodId = 0);
+  /// Sends the response to call @c id of @c method, @c response NULL for an
+  /// error.
+  void sendResponse(const TcpConnectionPtr &conn, int64_t id,
+                    ::network::ErrorCode error,
+                    const ::google::protobuf::Message *response,
+                    const ::google::protobuf::MethodDescriptor *method);
+  /// The message of a RpcFrame::kCompressed frame of @c method.
+  bool uncompress(const RpcFrame &frame,
+                  const ::google::protobuf::MethodDescriptor *method,
+                  std::string *message) const;
+
   // 读取数据并解析 接收
   void onMessage(const TcpConnectionPtr &conn, Buffer *buf);
 
   // 从缓冲区中解析数据并反序列化为 Protobuf 消息
   bool parseFromBuffer(const void *buf, int len,
                        google::protobuf::Message *message);
+  /// Parses @c len bytes at @c data, or @c slices if not NULL.
+  static bool parsePayload(const char *data, int len,
+                           const std::vector<Slice> *slices,
+                           google::protobuf::Message *message);
 
   // 将 Protobuf 消息序列化并存储到缓冲区中，准备发送
   int serializeToBuffer(const google::protobuf::Message &message, Buffer *buf);
 
+  // v1 frames only, @c type, if not NULL, is set to their checksum type
   ErrorCode parse(const char *buf, int len,
-                  ::google::protobuf::Message *message);
+                  ::google::protobuf::Message *message,
+                  ChecksumType *type = NULL);
 
   // 消息编码并填充到 Buffer 中，准备发送
   void fillEmptyBuffer(Buffer *buf, const google::protobuf::Message &message);
 
-  static int32_t checksum(const void *buf, int len);         // 生成校验
-  static bool validateChecksum(const char *buf, int len);    // 验证消息的校验和
+  // a v2 frame, the names of requests only, @c payload and @c compression
+  // may be NULL, @c methodId not 0 in place of the names
+  void fillFrame(Buffer *buf, MessageType type, int64_t id,
+                 ::network::ErrorCode error, const std::string &service,
+                 const std::string &method,
+                 const google::protobuf::Message *payload,
+                 const MethodCompression *compression,
+                 uint32_t methodId = 0);
+
+  static int32_t checksum(const void *buf, int len);         // 生成校验 (adler32)
+  static bool validateChecksum(const char *buf, int len);    // 验证消息的校验和 (adler32)
+  static int32_t checksum(ChecksumType type, const void *buf, int len);
+  /// The same over the bytes of @c slices, one after the other.
+  static int32_t checksum(ChecksumType type, const std::vector<Slice> &slices);
+  static bool validateChecksum(ChecksumType type, const char *buf, int len);
   static int32_t asInt32(const char *buf);                   // 计算 将字节数组转换为 32 位整数，用于解码消息的长度、校验和等字段
 
  private:
+  static const int kTagLen = 4;
+  static const int kFrameHeaderLen = 16;  // v2 header, without the names
+  static const char *tagOf(WireFormat format, ChecksumType type);
+  // false for an unknown tag
+  static bool typeOfTag(const char *tag, WireFormat *format,
+                        ChecksumType *type);
+  struct FrameParts;
+  // the payload of @c parts, serialized in the frame, or into @c raw and
+  // compressed into @c compressed if @c compression says so, up to
+  // maxUncompressedBytes_
+  void setPayload(FrameParts *parts,
+                  const ::google::protobuf::Message *payload,
+                  const MethodCompression *compression, std::string *raw,
+                  std::string *compressed) const;
+  static size_t frameSize(const FrameParts &parts);
+  // the @c size bytes of the frame, length and checksum included, at @c dest
+  static void writeFrame(const FrameParts &parts, char *dest, size_t size);
+  // in place in the output queue in loop, in a buffer handed over otherwise
+  void sendFrame(const TcpConnectionPtr &conn, const FrameParts &parts);
+  // checks the tag and the checksum of the frame in @c buf
+  ErrorCode checkFrame(const char *buf, int len, WireFormat *format,
+                       ChecksumType *type) const;
+  // @c buf and @c len without tag and checksum
+  static ErrorCode decodeFrame(const char *buf, int len, RpcFrame *frame);
+  // the kFrameHeaderLen bytes at @c buf, not the names
+  static ErrorCode decodeFrameHeader(const char *buf, RpcFrame *frame);
+  // hands a complete frame of @c len bytes, after the length, to the
+  // callbacks
+  ErrorCode onFrame(const TcpConnectionPtr &conn, const char *data, int len);
+  // moves what @c buf has of the frame being gathered to chain_, true once
+  // it is complete
+  bool gather(Buffer *buf);
+  // the same as onFrame for the frame gathered in chain_
+  ErrorCode onChainedFrame(const TcpConnectionPtr &conn);
+  // on a CallArena of its own with setArenaPerMessage()
+  RpcMessagePtr newEnvelope() const;
+  // replies in kind
+  void adoptFormat(WireFormat format, ChecksumType type);
+  // a codec sending "RPCN" reads the answers in kind
+  bool acceptsUnchecked() const {
+    return acceptUnchecked_ || checksumType() == kNoChecksum;
+  }
+  // NULL if the method is not compressed
+  const MethodCompression *compressionOf(
+      const ::google::protobuf::MethodDescriptor *method) const;
+
   ProtobufMessageCallback messageCallback_;
+  RpcFrameCallback frameCallback_;
+  const CompressionMap *compressions_;
   int kMinMessageLen = 4;
-  const std::string tag_ = "RPC0";
+  // responses may go from workers
+  std::atomic<WireFormat> wireFormat_;
+  std::atomic<ChecksumType> checksumType_;
+  bool replyInKind_;
+  bool acceptUnchecked_;
+  bool arenaPerMessage_;
+  size_t chainThreshold_;  // 0 for none
+  size_t maxUncompressedBytes_;
+  // the frame being gathered, length field included
+  std::vector<Slice> chain_;
+  size_t chainFrameLen_;  // 0 if none
+  size_t chainBytes_;
 };
 
 }  // namespace network
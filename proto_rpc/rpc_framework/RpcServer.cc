@@ -7,31 +7,150 @@
 #include <google/protobuf/service.h>
 
 #include "RpcChannel.h"
+#include "network/Logging.h"
+#include "network/WorkStealingPool.h"
 
 using namespace network;
 
+/// The full names of dispatch_'s entries, in order, so that a method's id is
+/// its index in the table plus one.
+class RpcServer::MethodTableServiceImpl : public MethodTableService {
+ public:
+  explicit MethodTableServiceImpl(const DispatchTable *dispatch)
+      : dispatch_(dispatch) {}
+
+  void Get(::google::protobuf::RpcController *,
+           const MethodTableRequest *, MethodTable *response,
+           ::google::protobuf::Closure *done) override {
+    for (const MethodEntry &entry : dispatch_->entries()) {
+      response->add_methods(entry.method->full_name());
+    }
+    done->Run();
+  }
+
+ private:
+  const DispatchTable *dispatch_;
+};
+
 RpcServer::RpcServer(EventLoop *loop, const InetAddress &listenAddr)
-    : server_(loop, listenAddr, "RpcServer") {
+    : server_(loop, listenAddr, "RpcServer"),
+      zeroCopyThreshold_(0),
+      highWaterMark_(0),
+      lowWaterMark_(0),
+      maxOutputBytes_(0),
+      acceptUncheckedOnLoopback_(false),
+      arenaPerCall_(false),
+      chainThreshold_(ProtoRpcCodec::kDefaultChainThreshold),
+      maxUncompressedBytes_(ProtoRpcCodec::kDefaultMaxUncompressedBytes) {
   server_.setConnectionCallback(std::bind(&RpcServer::onConnection, this, _1));
 }
 
+RpcServer::~RpcServer() {
+  // before the I/O loops go, workers send responses to them
+  for (auto &item : executors_) {
+    item.second->stop();
+  }
+}
+
 void RpcServer::registerService(google::protobuf::Service *service) {
   // GetDescriptor 返回描述该服务的 ServiceDescriptor 对象
   const google::protobuf::ServiceDescriptor *desc = service->GetDescriptor();
   services_[desc->full_name()] = service;
 }
 
-void RpcServer::start() { server_.start(); }
+void RpcServer::start() {
+  if (!methodTableService_) {
+    methodTableService_.reset(new MethodTableServiceImpl(&dispatch_));
+    registerService(get_pointer(methodTableService_));
+  }
+  buildExecutorMap();
+  buildCompressionMap();
+  dispatch_.build(services_, executors_);
+  for (auto &item : executors_) {
+    item.second->start();
+  }
+  server_.start();
+}
+
+void RpcServer::buildExecutorMap() {
+  executors_.clear();
+  for (const auto &item : services_) {
+    const google::protobuf::ServiceDescriptor *desc =
+        item.second->GetDescriptor();
+    NamedExecutors::const_iterator s = serviceExecutors_.find(desc->full_name());
+    const std::shared_ptr<WorkStealingPool> &serviceExecutor =
+        s != serviceExecutors_.end() ? s->second : defaultExecutor_;
+    for (int i = 0; i < desc->method_count(); ++i) {
+      const google::protobuf::MethodDescriptor *method = desc->method(i);
+      NamedExecutors::const_iterator m =
+          methodExecutors_.find(method->full_name());
+      WorkStealingPool *executor = m != methodExecutors_.end()
+                                       ? get_pointer(m->second)
+                                       : get_pointer(serviceExecutor);
+      if (executor) {
+        executors_[method] = executor;
+      }
+    }
+  }
+}
+
+void RpcServer::buildCompressionMap() {
+  compressions_.clear();
+  for (const auto &item : services_) {
+    const google::protobuf::ServiceDescriptor *desc =
+        item.second->GetDescriptor();
+    NamedCompressions::const_iterator s =
+        serviceCompressions_.find(desc->full_name());
+    for (int i = 0; i < desc->method_count(); ++i) {
+      const google::protobuf::MethodDescriptor *method = desc->method(i);
+      NamedCompressions::const_iterator m =
+          methodCompressions_.find(method->full_name());
+      if (m != methodCompressions_.end()) {
+        compressions_[method] = m->second;
+      } else if (s != serviceCompressions_.end()) {
+        compressions_[method] = s->second;
+      }
+    }
+  }
+}
 
 void RpcServer::onConnection(const TcpConnectionPtr &conn) {
-  LOG(INFO) << "RpcServer - " << conn->peerAddress().toIpPort() << " -> "
+  LOG_DEBUG << "RpcServer - " << conn->peerAddress().toIpPort() << " -> "
             << conn->localAddress().toIpPort() << " is "
             << (conn->connected() ? "UP" : "DOWN");
   if (conn->connected()) {
+    if (zeroCopyThreshold_ > 0) {
+      conn->setZeroCopyThreshold(zeroCopyThreshold_);
+    }
+    if (highWaterMark_ > 0) {
+      conn->setHighWaterMarkCallback(HighWaterMarkCallback(), highWaterMark_);
+      conn->setLowWaterMarkCallback(LowWaterMarkCallback(), lowWaterMark_);
+      conn->setPauseReadingAtHighWaterMark(true);
+    }
+    conn->setMaxOutputBytes(maxOutputBytes_);
     RpcChannelPtr channel(new RpcChannel(conn));
     channel->setServices(&services_);             // 传递
+    // answers every client with the checksum it sent, old clients send RPC0
+    channel->codec()->setReplyInKind(true);
+    channel->codec()->setAcceptUnchecked(acceptUncheckedOnLoopback_ &&
+                                         conn->peerAddress().isLoopback());
+    channel->setDispatchTable(&dispatch_);
+    if (!compressions_.empty()) {
+      channel->codec()->setCompressions(&compressions_);
+    }
+    channel->setArenaPerCall(arenaPerCall_);
+    channel->codec()->setChainThreshold(chainThreshold_);
+    channel->codec()->setMaxUncompressedBytes(maxUncompressedBytes_);
+    // the channel is pinned while it parses, a call that closes the
+    // connection drops it from the context
+    std::weak_ptr<RpcChannel> weakChannel(channel);
     conn->setMessageCallback(
-        std::bind(&RpcChannel::onMessage, get_pointer(channel), _1, _2));
+        [weakChannel](const TcpConnectionPtr &c, Buffer *buf) {
+          RpcChannelPtr guard(weakChannel.lock());
+          if (guard) {
+            guard->onMessage(c, buf);
+          }
+        });
     conn->setContext(channel);
   } else {
     conn->setContext(RpcChannelPtr());
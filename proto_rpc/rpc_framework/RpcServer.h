@@ -1,6 +1,12 @@
 #pragma once
 
+#include <cassert>
+#include <map>
+#include <memory>
+#include <string>
+
 #include "network/TcpServer.h"
+#include "RpcChannel.h"
 
 namespace google {
 namespace protobuf {
@@ -12,18 +18,111 @@ class Service;
 
 namespace network {
 
+class WorkStealingPool;
+
 class RpcServer {
  public:
   RpcServer(EventLoop *loop, const InetAddress &listenAddr);
+  /// Runs the calls still queued on the executors and stops them.
+  ~RpcServer();
   // 设置线程池的线程数量
   void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
   // 注册一个 Protocol Buffers 的 Service 对象
   // 把这个服务添加到 services_ 映射中
   void registerService(::google::protobuf::Service *);
+
+  /// Where the methods run, inline in the I/O loop of the connection by
+  /// default. A method with an executor is parsed and called on one of its
+  /// workers, the response is handed back to the I/O loop, so a slow method
+  /// doesn't hold up the other connections of the loop. Keep the cheap ones
+  /// inline, they skip the thread hop.
+  ///
+  /// The method's executor wins over its service's, over the default one.
+  /// NULL means inline. Names are full names, e.g. "monitor.TestService"
+  /// and "monitor.TestService.MonitorInfo". Executors are started by
+  /// @c start and stopped with the server.
+  /// Must be called before @c start
+  void setExecutor(const std::shared_ptr<WorkStealingPool> &executor) {
+    defaultExecutor_ = executor;
+  }
+  void setServiceExecutor(const std::string &service,
+                          const std::shared_ptr<WorkStealingPool> &executor) {
+    serviceExecutors_[service] = executor;
+  }
+  void setMethodExecutor(const std::string &method,
+                         const std::shared_ptr<WorkStealingPool> &executor) {
+    methodExecutors_[method] = executor;
+  }
+
+  /// Responses of at least @c bytes are sent with MSG_ZEROCOPY, see
+  /// TcpConnection::setZeroCopyThreshold. For methods returning several MB,
+  /// 0 (the default) copies everything.
+  /// Must be called before @c start
+  void setZeroCopyThreshold(size_t bytes) { zeroCopyThreshold_ = bytes; }
+
+  /// Slow consumer protection: a connection with @c highWaterMark bytes of
+  /// responses unsent gets no more requests read until they drain to
+  /// @c lowWaterMark, and is closed at @c maxOutputBytes (0 for no limit).
+  /// Off by default.
+  /// Must be called before @c start
+  void setBackpressure(size_t highWaterMark, size_t lowWaterMark,
+                       size_t maxOutputBytes) {
+    assert(highWaterMark == 0 || lowWaterMark < highWaterMark);
+    highWaterMark_ = highWaterMark;
+    lowWaterMark_ = lowWaterMark;
+    maxOutputBytes_ = maxOutputBytes;
+  }
+
+  /// Takes requests without frame checksum ("RPCN") from loopback peers,
+  /// where the kernel does not corrupt data. Off by default.
+  /// Must be called before @c start
+  void setAcceptUncheckedOnLoopback(bool on) {
+    acceptUncheckedOnLoopback_ = on;
+  }
+
+  /// Compresses requests and responses of a service or a method (full
+  /// names, the method's setting wins) in v2 frames, see
+  /// ProtoRpcCodec::setCompressions. Clients must set the same.
+  /// Must be called before @c start
+  void setServiceCompression(const std::string &service,
+                             const MethodCompression &compression) {
+    serviceCompressions_[service] = compression;
+  }
+  void setMethodCompression(const std::string &method,
+                            const MethodCompression &compression) {
+    methodCompressions_[method] = compression;
+  }
+
+  /// Serves every call on a CallArena, see RpcChannel::setArenaPerCall.
+  /// Off by default.
+  /// Must be called before @c start
+  void setArenaPerCall(bool on) { arenaPerCall_ = on; }
+
+  /// Requests of at least @c bytes are gathered and parsed in slices, see
+  /// ProtoRpcCodec::setChainThreshold. 0 turns it off.
+  /// Must be called before @c start
+  void setChainThreshold(size_t bytes) { chainThreshold_ = bytes; }
+
+  /// Compressed requests of more than @c bytes are rejected, see
+  /// ProtoRpcCodec::setMaxUncompressedBytes.
+  /// Must be called before @c start
+  void setMaxUncompressedBytes(size_t bytes) { maxUncompressedBytes_ = bytes; }
+
+  /// Registers MethodTableService, which hands clients the ids of the
+  /// methods, see RpcChannel::setMethodIds, and starts serving.
   void start();
 
+  /// The methods served, with their counters. Built by @c start
+  const DispatchTable &dispatchTable() const { return dispatch_; }
+
  private:
+  class MethodTableServiceImpl;
+
   void onConnection(const TcpConnectionPtr &conn);
+  // resolves the executor of every method of the registered services
+  void buildExecutorMap();
+  // the same for compression
+  void buildCompressionMap();
 
   // void onMessage(const TcpConnectionPtr& conn,
   //                Buffer* buf,
@@ -31,6 +130,27 @@ class RpcServer {
 
   TcpServer server_;
   std::map<std::string, ::google::protobuf::Service *> services_;
+
+  typedef std::map<std::string, std::shared_ptr<WorkStealingPool>>
+      NamedExecutors;
+  std::shared_ptr<WorkStealingPool> defaultExecutor_;
+  NamedExecutors serviceExecutors_;
+  NamedExecutors methodExecutors_;
+  RpcChannel::ExecutorMap executors_;  // resolved into dispatch_
+  typedef std::map<std::string, MethodCompression> NamedCompressions;
+  NamedCompressions serviceCompressions_;
+  NamedCompressions methodCompressions_;
+  CompressionMap compressions_;  // read by the channels
+  DispatchTable dispatch_;       // read by the channels
+  std::unique_ptr<MethodTableServiceImpl> methodTableService_;
+  size_t zeroCopyThreshold_;
+  size_t highWaterMark_;  // 0 for no backpressure
+  size_t lowWaterMark_;
+  size_t maxOutputBytes_;
+  bool acceptUncheckedOnLoopback_;
+  bool arenaPerCall_;
+  size_t chainThreshold_;
+  size_t maxUncompressedBytes_;
 };
 
 }  // namespace network
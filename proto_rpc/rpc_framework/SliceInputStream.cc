@@ -0,0 +1,96 @@
+#include "SliceInputStream.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace network {
+
+bool SliceInputStream::Next(const void **data, int *size) {
+  while (index_ < slices_.size() && offset_ == slices_[index_].size()) {
+    ++index_;
+    offset_ = 0;
+  }
+  if (index_ == slices_.size()) {
+    return false;
+  }
+  const Slice &slice = slices_[index_];
+  const size_t len =
+      std::min(slice.size() - offset_, static_cast<size_t>(INT_MAX));
+  *data = slice.data() + offset_;
+  *size = static_cast<int>(len);
+  offset_ += len;
+  byteCount_ += len;
+  return true;
+}
+
+void SliceInputStream::BackUp(int count) {
+  // right after Next(), which left offset_ in the slice it returned
+  assert(count >= 0 && static_cast<size_t>(count) <= offset_);
+  offset_ -= count;
+  byteCount_ -= count;
+}
+
+bool SliceInputStream::Skip(int count) {
+  assert(count >= 0);
+  size_t left = static_cast<size_t>(count);
+  while (left > 0 && index_ < slices_.size()) {
+    const size_t n = std::min(left, slices_[index_].size() - offset_);
+    offset_ += n;
+    byteCount_ += n;
+    left -= n;
+    if (offset_ == slices_[index_].size()) {
+      ++index_;
+      offset_ = 0;
+    }
+  }
+  return left == 0;
+}
+
+bool SliceInputStream::copyOut(const std::vector<Slice> &slices,
+                               size_t offset, size_t len, char *out) {
+  for (const Slice &slice : slices) {
+    if (len == 0) {
+      break;
+    }
+    if (offset >= slice.size()) {
+      offset -= slice.size();
+      continue;
+    }
+    const size_t n = std::min(len, slice.size() - offset);
+    ::memcpy(out, slice.data() + offset, n);
+    out += n;
+    len -= n;
+    offset = 0;
+  }
+  return len == 0;
+}
+
+void SliceInputStream::removePrefix(std::vector<Slice> *slices, size_t len) {
+  size_t drop = 0;
+  while (drop < slices->size() && len >= (*slices)[drop].size()) {
+    len -= (*slices)[drop].size();
+    ++drop;
+  }
+  slices->erase(slices->begin(), slices->begin() + drop);
+  if (len > 0) {
+    assert(!slices->empty());
+    slices->front().removePrefix(len);
+  }
+}
+
+void SliceInputStream::removeSuffix(std::vector<Slice> *slices, size_t len) {
+  while (!slices->empty() && len >= slices->back().size()) {
+    len -= slices->back().size();
+    slices->pop_back();
+  }
+  if (len > 0) {
+    assert(!slices->empty());
+    Slice &last = slices->back();
+    last = last.subslice(0, last.size() - len);
+  }
+}
+
+}  // namespace network
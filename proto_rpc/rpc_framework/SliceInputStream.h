@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <google/protobuf/io/zero_copy_stream.h>
+
+#include "network/Slice.h"
+
+namespace network {
+
+///
+/// The bytes of a chain of Slices as a protobuf ZeroCopyInputStream, so that
+/// a message spread over several receive buffers is parsed where it lies,
+/// without being copied contiguous first.
+///
+/// The slices must outlive the stream.
+/// Slice 链上的零拷贝输入流
+class SliceInputStream : public ::google::protobuf::io::ZeroCopyInputStream {
+ public:
+  explicit SliceInputStream(const std::vector<Slice> &slices)
+      : slices_(slices), index_(0), offset_(0), byteCount_(0) {}
+
+  bool Next(const void **data, int *size) override;
+  void BackUp(int count) override;
+  bool Skip(int count) override;
+  int64_t ByteCount() const override { return byteCount_; }
+
+  /// Copies @c len bytes from @c offset of @c slices to @c out, false if
+  /// there are not as many.
+  static bool copyOut(const std::vector<Slice> &slices, size_t offset,
+                      size_t len, char *out);
+  /// Drops the first, and the last, @c len bytes of @c slices.
+  static void removePrefix(std::vector<Slice> *slices, size_t len);
+  static void removeSuffix(std::vector<Slice> *slices, size_t len);
+
+ private:
+  const std::vector<Slice> &slices_;
+  size_t index_;   // of the slice read next
+  size_t offset_;  // in it
+  int64_t byteCount_;
+};
+
+}  // namespace network